@@ -0,0 +1,51 @@
+#include "allocation_counter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<std::size_t> allocations(0);
+
+	void *allocate(std::size_t size)
+	{
+		++allocations;
+		void *const memory = std::malloc(size ? size : 1);
+		if (!memory)
+		{
+			throw std::bad_alloc();
+		}
+		return memory;
+	}
+}
+
+void *operator new(std::size_t size)
+{
+	return allocate(size);
+}
+
+void *operator new[](std::size_t size)
+{
+	return allocate(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+	std::free(memory);
+}
+
+namespace fileserver
+{
+	namespace benchmarks
+	{
+		std::size_t count_allocations()
+		{
+			return allocations.load();
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef FILESERVER_BENCHMARK_ALLOCATION_COUNTER_HPP
+#define FILESERVER_BENCHMARK_ALLOCATION_COUNTER_HPP
+
+#include <cstddef>
+
+namespace fileserver
+{
+	namespace benchmarks
+	{
+		//! The number of calls to the global operator new since the start of the process.
+		std::size_t count_allocations();
+	}
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef FILESERVER_BENCHMARKS_HPP
+#define FILESERVER_BENCHMARKS_HPP
+
+#include <string>
+#include <vector>
+
+namespace fileserver
+{
+	namespace benchmarks
+	{
+		typedef int function(std::vector<std::string> const &arguments);
+
+		//! sendfile(2) compared with read(2) + send(2) through a user space buffer and with io_uring, in GB/s and system
+		//! calls per file
+		int send_file(std::vector<std::string> const &arguments);
+
+		//! keep-alive GET requests against a running server
+		int http_load(std::vector<std::string> const &arguments);
+
+		//! allocations and time per request of the generic HTTP parser compared with request_header
+		int parse_request(std::vector<std::string> const &arguments);
+
+		//! resident memory of a running server per idle connection
+		int idle_connections(std::vector<std::string> const &arguments);
+
+		//! throughput of the serial and the parallel scan of a directory in GB/s and files/s
+		int scan_directory(std::vector<std::string> const &arguments);
+
+		//! throughput of the SHA-256 engines in GB/s and messages/s for messages of different sizes
+		int sha256(std::vector<std::string> const &arguments);
+	}
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include "benchmarks.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/algorithm/string/find.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+
+namespace fileserver
+{
+	namespace benchmarks
+	{
+		namespace
+		{
+			//! Reads one response with a Content-Length from a keep-alive connection.
+			//! \return the size of the body
+			std::size_t receive_response(boost::asio::ip::tcp::socket &connection, std::vector<char> &buffer,
+			                             std::size_t &buffered)
+			{
+				char const end_of_header[] = "\r\n\r\n";
+				for (;;)
+				{
+					auto const header_end = std::search(buffer.begin(), buffer.begin() + buffered, end_of_header,
+					                                    end_of_header + 4);
+					if (header_end != (buffer.begin() + buffered))
+					{
+						std::string const header(buffer.begin(), header_end);
+						auto const length_name = boost::algorithm::ifind_first(header, "Content-Length:");
+						if (!length_name)
+						{
+							throw std::runtime_error("The response has no Content-Length");
+						}
+						std::size_t const value_begin = static_cast<std::size_t>(length_name.end() - header.begin());
+						std::size_t const value_end = header.find("\r\n", value_begin);
+						std::string value = header.substr(value_begin, value_end - value_begin);
+						value.erase(0, value.find_first_not_of(' '));
+						std::size_t const body_size = boost::lexical_cast<std::size_t>(value);
+						std::size_t const response_size =
+						    static_cast<std::size_t>(header_end - buffer.begin()) + 4 + body_size;
+						if (buffer.size() < response_size)
+						{
+							buffer.resize(response_size);
+						}
+						if (buffered < response_size)
+						{
+							boost::asio::read(connection, boost::asio::buffer(buffer.data() + buffered,
+							                                                  response_size - buffered));
+							buffered = response_size;
+						}
+						std::copy(buffer.begin() + static_cast<std::ptrdiff_t>(response_size),
+						          buffer.begin() + static_cast<std::ptrdiff_t>(buffered), buffer.begin());
+						buffered -= response_size;
+						return body_size;
+					}
+					if (buffered == buffer.size())
+					{
+						buffer.resize(buffer.size() * 2);
+					}
+					buffered += connection.read_some(
+					    boost::asio::buffer(buffer.data() + buffered, buffer.size() - buffered));
+				}
+			}
+		}
+
+		int http_load(std::vector<std::string> const &arguments)
+		{
+			if (arguments.size() < 3)
+			{
+				std::cerr << "Arguments: <host> <port> <path> [connections] [requests per connection]\n"
+				             "To see the system calls per request, count the system calls of the server while\n"
+				             "this runs, for example with\n"
+				             "  perf stat -e raw_syscalls:sys_enter -p <pid of the server>\n"
+				             "or\n"
+				             "  strace -c -f -p <pid of the server>\n"
+				             "and divide by the number of requests printed here.\n";
+				return 1;
+			}
+			std::string const &host = arguments[0];
+			std::string const &port = arguments[1];
+			std::string const &path = arguments[2];
+			std::size_t const connections =
+			    (arguments.size() >= 4) ? boost::lexical_cast<std::size_t>(arguments[3]) : 8;
+			std::size_t const requests_per_connection =
+			    (arguments.size() >= 5) ? boost::lexical_cast<std::size_t>(arguments[4]) : 10000;
+
+			std::string const request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\n\r\n";
+			auto const started = std::chrono::steady_clock::now();
+			std::vector<std::future<boost::uint64_t>> clients;
+			for (std::size_t i = 0; i < connections; ++i)
+			{
+				clients.emplace_back(std::async(
+				    std::launch::async, [&host, &port, &request, requests_per_connection]() -> boost::uint64_t
+				    {
+					    boost::asio::io_service io;
+					    boost::asio::ip::tcp::resolver resolver(io);
+					    boost::asio::ip::tcp::socket connection(io);
+					    boost::asio::connect(connection,
+					                         resolver.resolve(boost::asio::ip::tcp::resolver::query(host, port)));
+					    connection.set_option(boost::asio::ip::tcp::no_delay(true));
+					    std::vector<char> buffer(64 * 1024);
+					    std::size_t buffered = 0;
+					    boost::uint64_t received = 0;
+					    for (std::size_t k = 0; k < requests_per_connection; ++k)
+					    {
+						    boost::asio::write(connection, boost::asio::buffer(request));
+						    received += receive_response(connection, buffer, buffered);
+					    }
+					    return received;
+					}));
+			}
+			boost::uint64_t received = 0;
+			for (std::future<boost::uint64_t> &client : clients)
+			{
+				received += client.get();
+			}
+			double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+			std::size_t const requests = connections * requests_per_connection;
+			std::cout << requests << " requests on " << connections << " connections in " << seconds << " s: "
+			          << (static_cast<double>(requests) / seconds) << " requests/s, "
+			          << (static_cast<double>(received) / seconds / 1e6) << " MB/s of content\n";
+			return 0;
+		}
+	}
+}
@@ -0,0 +1,92 @@
+#include "benchmarks.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+namespace fileserver
+{
+	namespace benchmarks
+	{
+#ifdef __linux__
+		namespace
+		{
+			//! \return the resident memory of a process in KiB
+			boost::uint64_t get_resident_kib(std::string const &pid)
+			{
+				std::ifstream status("/proc/" + pid + "/status");
+				std::string line;
+				while (std::getline(status, line))
+				{
+					if (line.compare(0, 6, "VmRSS:") == 0)
+					{
+						std::string value = line.substr(6);
+						value.erase(0, value.find_first_not_of(" \t"));
+						value.erase(value.find_first_of(" \t"));
+						return boost::lexical_cast<boost::uint64_t>(value);
+					}
+				}
+				throw std::runtime_error("Could not read the memory usage of process " + pid);
+			}
+		}
+#endif
+
+		int idle_connections(std::vector<std::string> const &arguments)
+		{
+#ifdef __linux__
+			if (arguments.size() < 3)
+			{
+				std::cerr << "Arguments: <host> <port> <pid of the server> [connections]\n"
+				             "Opens connections without sending anything and compares the resident memory of the\n"
+				             "server before and after. The server needs a file descriptor limit above the number\n"
+				             "of connections.\n";
+				return 1;
+			}
+			std::string const &host = arguments[0];
+			std::string const &port = arguments[1];
+			std::string const &pid = arguments[2];
+			std::size_t const connection_count =
+			    (arguments.size() >= 4) ? boost::lexical_cast<std::size_t>(arguments[3]) : 10000;
+
+			// this process needs a descriptor for every connection, too
+			rlimit descriptors;
+			if (::getrlimit(RLIMIT_NOFILE, &descriptors) == 0)
+			{
+				descriptors.rlim_cur = descriptors.rlim_max;
+				::setrlimit(RLIMIT_NOFILE, &descriptors);
+			}
+
+			boost::asio::io_service io;
+			boost::asio::ip::tcp::resolver resolver(io);
+			auto const endpoints = resolver.resolve(boost::asio::ip::tcp::resolver::query(host, port));
+			boost::uint64_t const before = get_resident_kib(pid);
+			std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> connections;
+			for (std::size_t i = 0; i < connection_count; ++i)
+			{
+				connections.emplace_back(new boost::asio::ip::tcp::socket(io));
+				boost::asio::connect(*connections.back(), endpoints);
+			}
+			// the server accepts asynchronously
+			std::this_thread::sleep_for(std::chrono::seconds(2));
+			boost::uint64_t const after = get_resident_kib(pid);
+			std::cout << connection_count << " idle connections: resident memory of the server went from " << before
+			          << " KiB to " << after << " KiB, "
+			          << (static_cast<double>(after - before) * 1024.0 / static_cast<double>(connection_count))
+			          << " bytes per connection\n";
+			return 0;
+#else
+			boost::ignore_unused_variable_warning(arguments);
+			std::cerr << "idle_connections is only available on Linux\n";
+			return 1;
+#endif
+		}
+	}
+}
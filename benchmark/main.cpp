@@ -0,0 +1,27 @@
+#include "benchmarks.hpp"
+#include <iostream>
+#include <map>
+
+int main(int argc, char **argv)
+{
+	std::map<std::string, fileserver::benchmarks::function *> const benchmarks = {
+	    {"sendfile", &fileserver::benchmarks::send_file},
+	    {"http_load", &fileserver::benchmarks::http_load},
+	    {"parse_request", &fileserver::benchmarks::parse_request},
+	    {"idle_connections", &fileserver::benchmarks::idle_connections},
+	    {"scan_directory", &fileserver::benchmarks::scan_directory},
+	    {"sha256", &fileserver::benchmarks::sha256}};
+
+	auto const chosen = (argc >= 2) ? benchmarks.find(argv[1]) : benchmarks.end();
+	if (chosen == benchmarks.end())
+	{
+		std::cerr << "Usage: " << argv[0] << " <benchmark> [arguments]\nAvailable benchmarks:\n";
+		for (auto const &benchmark : benchmarks)
+		{
+			std::cerr << "  " << benchmark.first << '\n';
+		}
+		return 1;
+	}
+	std::vector<std::string> const arguments(argv + 2, argv + argc);
+	return chosen->second(arguments);
+}
@@ -0,0 +1,123 @@
+#include "benchmarks.hpp"
+#include "allocation_counter.hpp"
+#include <server/file_repository.hpp>
+#include <server/request_header.hpp>
+#include <server/request_target.hpp>
+#include <silicium/http/http.hpp>
+#include <silicium/http/uri.hpp>
+#include <silicium/source/memory_source.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <iostream>
+
+namespace fileserver
+{
+	namespace benchmarks
+	{
+		namespace
+		{
+			//! How requests were parsed before request_header existed: the generic HTTP parser with a map of header
+			//! strings, the generic URI parser and a digest of unknown length.
+			bool find_with_generic_parsers(std::string const &request, file_repository const &repository)
+			{
+				auto source = Si::make_container_source(request);
+				Si::optional<Si::http::request> const header = Si::http::parse_request(source);
+				if (!header)
+				{
+					return false;
+				}
+				Si::optional<Si::http::uri> const uri = Si::http::parse_uri(Si::make_memory_range(header->path));
+				if (!uri || (uri->path.size() != 3))
+				{
+					return false;
+				}
+				boost::optional<unknown_digest> const digest = parse_digest(uri->path[2]);
+				return digest && repository.find_location(*digest);
+			}
+
+			bool find_without_allocating(std::string const &request, file_repository const &repository)
+			{
+				request_parse_result const parsed =
+				    parse_request_header(Si::make_memory_range(request.data(), request.data() + request.size()));
+				if (parsed.status != request_parse_status::complete)
+				{
+					return false;
+				}
+				Si::optional<parsed_request> const target = parse_request_target(parsed.header.target);
+				if (!target)
+				{
+					return false;
+				}
+				return Si::visit<bool>(
+				    *target,
+				    [&repository](get_request const &get)
+				    {
+					    return Si::visit<bool>(get.what,
+					                           [&repository](sha256_digest const &digest)
+					                           {
+						                           return repository.find_entry(digest) != nullptr;
+						                       },
+					                           [](Si::memory_range const &)
+					                           {
+						                           return false;
+						                       });
+					},
+				    [](browse_request const &)
+				    {
+					    return false;
+					});
+			}
+
+			template <class Parse>
+			void measure(char const *name, std::size_t iterations, Parse const &parse)
+			{
+				std::size_t found = 0;
+				std::size_t const allocations_before = count_allocations();
+				auto const started = std::chrono::steady_clock::now();
+				for (std::size_t i = 0; i < iterations; ++i)
+				{
+					found += parse();
+				}
+				double const nanoseconds = static_cast<double>(
+				    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started)
+				        .count());
+				std::size_t const allocations = count_allocations() - allocations_before;
+				if (found != iterations)
+				{
+					throw std::logic_error("The benchmark request was not found");
+				}
+				std::cout << name << ": "
+				          << (static_cast<double>(allocations) / static_cast<double>(iterations)) << " allocations, "
+				          << (nanoseconds / static_cast<double>(iterations)) << " ns per request\n";
+			}
+		}
+
+		int parse_request(std::vector<std::string> const &arguments)
+		{
+			std::size_t const iterations =
+			    arguments.empty() ? 1000000 : boost::lexical_cast<std::size_t>(arguments[0]);
+
+			sha256_digest content;
+			for (std::size_t i = 0; i < content.bytes.size(); ++i)
+			{
+				content.bytes[i] = static_cast<byte>(i);
+			}
+			file_repository repository;
+			repository.add_entry(to_unknown_digest(content)).locations.emplace_back(
+			    in_memory_location{std::make_shared<std::vector<char> const>()});
+
+			std::string const request = "GET /get/hash/" + format_digest<std::string>(to_unknown_digest(content)) +
+			                            " HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: benchmark\r\n"
+			                            "Accept: */*\r\nIf-None-Match: \"0\"\r\n\r\n";
+			measure("generic parsers", iterations, [&request, &repository]
+			        {
+				        return find_with_generic_parsers(request, repository);
+				    });
+			measure("request_header", iterations, [&request, &repository]
+			        {
+				        return find_without_allocating(request, repository);
+				    });
+			return 0;
+		}
+	}
+}
@@ -0,0 +1,125 @@
+#include "benchmarks.hpp"
+#include <server/scan_directory.hpp>
+#include <server/pool_executor.hpp>
+#include <silicium/std_threading.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+namespace fileserver
+{
+	namespace benchmarks
+	{
+		namespace
+		{
+			struct scan_totals
+			{
+				boost::uint64_t files = 0;
+				boost::uint64_t bytes = 0;
+			};
+
+			scan_totals count_files(file_repository const &repository)
+			{
+				scan_totals totals;
+				repository.for_each_entry([&totals](unknown_digest const &, repository_entry const &entry)
+				                          {
+					                          for (location const &found : entry.locations)
+					                          {
+						                          if (file_system_location const *const file =
+						                                  Si::try_get_ptr<file_system_location>(found))
+						                          {
+							                          ++totals.files;
+							                          totals.bytes += file->size;
+						                          }
+					                          }
+					                      });
+				return totals;
+			}
+
+			template <class Scan>
+			typed_reference measure(char const *name, Scan const &scan)
+			{
+				auto const started = std::chrono::steady_clock::now();
+				std::pair<file_repository, name_tree> const scanned = scan();
+				double const seconds =
+				    std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+				scan_totals const totals = count_files(scanned.first);
+				std::cout << name << ": " << (static_cast<double>(totals.bytes) / seconds / 1e9) << " GB/s, "
+				          << (static_cast<double>(totals.files) / seconds) << " files/s (" << totals.files
+				          << " files in " << seconds << " s)\n";
+				return scanned.second.reference;
+			}
+
+			//! 64 directories with files of up to 64 KiB
+			void generate_tree(boost::filesystem::path const &root, std::size_t file_count)
+			{
+				std::vector<char> content(64 * 1024);
+				for (std::size_t i = 0; i < content.size(); ++i)
+				{
+					content[i] = static_cast<char>(i * 7);
+				}
+				for (std::size_t i = 0; i < file_count; ++i)
+				{
+					boost::filesystem::path const directory = root / std::to_string(i % 64);
+					boost::filesystem::create_directories(directory);
+					// the first bytes differ so that every file has its own digest
+					std::string const unique = std::to_string(i);
+					boost::filesystem::ofstream file(directory / unique, std::ios::binary);
+					file.write(unique.data(), static_cast<std::streamsize>(unique.size()));
+					file.write(content.data(), static_cast<std::streamsize>(i % content.size()));
+				}
+			}
+		}
+
+		int scan_directory(std::vector<std::string> const &arguments)
+		{
+			std::size_t const threads = (arguments.size() >= 2)
+			                                ? boost::lexical_cast<std::size_t>(arguments[1])
+			                                : std::max(1u, std::thread::hardware_concurrency());
+			boost::filesystem::path generated;
+			boost::filesystem::path root;
+			if (!arguments.empty() && !arguments[0].empty())
+			{
+				root = boost::filesystem::absolute(arguments[0]);
+			}
+			else
+			{
+				generated = boost::filesystem::temp_directory_path() /
+				            boost::filesystem::unique_path("fileserver-benchmark-%%%%-%%%%-%%%%");
+				std::cout << "Generating a tree of 20000 files\n";
+				generate_tree(generated, 20000);
+				root = generated;
+			}
+
+			pool_executor<Si::std_threading> pool(threads);
+			auto const scan_serially = [&root]()
+			{
+				return fileserver::scan_directory(root, directory_listing_to_json_bytes, detail::hash_files);
+			};
+			auto const scan_in_parallel = [&root, &pool]()
+			{
+				return fileserver::scan_directory(root, directory_listing_to_json_bytes, detail::hash_files, pool);
+			};
+
+			// The first scan fills the page cache, so the following ones compare hashing and not the disk. Drop the
+			// caches before a run to measure a cold start instead.
+			scan_in_parallel();
+			typed_reference const serial = measure("serial", scan_serially);
+			std::string const parallel_name = std::to_string(threads) + " threads";
+			typed_reference const parallel = measure(parallel_name.c_str(), scan_in_parallel);
+
+			if (!generated.empty())
+			{
+				boost::filesystem::remove_all(generated);
+			}
+			if (!(serial == parallel))
+			{
+				std::cerr << "The parallel scan produced a different tree\n";
+				return 1;
+			}
+			return 0;
+		}
+	}
+}
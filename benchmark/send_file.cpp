@@ -0,0 +1,233 @@
+#include "benchmarks.hpp"
+#include <server/zero_copy.hpp>
+#include <server/linux/io_uring_engine.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <future>
+#include <iostream>
+
+namespace fileserver
+{
+	namespace benchmarks
+	{
+#ifdef __linux__
+		namespace
+		{
+			//! the chunk size of the copying path in the server
+			std::size_t const copy_buffer_size = 64 * 1024;
+
+			//! Sends the whole file with one system call per call of send_some.
+			//! \return the number of system calls
+			template <class SendSome>
+			boost::uint64_t send_in_calls(int socket, int file, boost::uint64_t file_size, SendSome const &send_some)
+			{
+				boost::uint64_t calls = 0;
+				boost::uint64_t position = 0;
+				while (position < file_size)
+				{
+					Si::error_or<std::size_t> const sent =
+					    send_some(socket, file, position, static_cast<std::size_t>(file_size - position));
+					++calls;
+					if (sent.is_error())
+					{
+						boost::throw_exception(boost::system::system_error(sent.error()));
+					}
+					if (sent.get() == 0)
+					{
+						throw std::runtime_error("The file is shorter than expected");
+					}
+					position += sent.get();
+				}
+				return calls;
+			}
+
+#ifdef FILESERVER_HAS_IO_URING
+			//! the number of buffers that the server reads and sends with one chain
+			std::size_t const io_uring_buffers_per_chain = 4;
+
+			//! Sends the whole file with chains of reads and sends like the server does.
+			//! \return the number of system calls: every submit and every read of the completion eventfd
+			boost::uint64_t send_with_io_uring(boost::asio::io_service &io, io_uring_engine &engine, int socket,
+			                                   int file, boost::uint64_t file_size)
+			{
+				boost::uint64_t const calls_before = engine.submit_calls() + engine.completion_wakeups();
+				auto const buffers = std::make_shared<io_uring_buffers>(engine, io_uring_buffers_per_chain);
+				if (buffers->indices().empty())
+				{
+					throw std::runtime_error("No io_uring buffer is free");
+				}
+				boost::uint64_t position = 0;
+				while (position < file_size)
+				{
+					io_uring_engine::chain operations;
+					for (unsigned buffer : buffers->indices())
+					{
+						if (position == file_size)
+						{
+							break;
+						}
+						std::size_t const size = static_cast<std::size_t>(
+						    std::min<boost::uint64_t>(io_uring_engine::buffer_size, file_size - position));
+						operations.read(file, position, buffer, size);
+						operations.send(socket, Si::make_memory_range(engine.get_buffer(buffer),
+						                                              engine.get_buffer(buffer) + size));
+						position += size;
+					}
+					Si::optional<boost::system::error_code> completed;
+					engine.start(operations, buffers, [&completed](boost::system::error_code ec)
+					             {
+						             completed = ec;
+						         });
+					// the engine always waits for the next completion, so the io_service does not run out of work
+					while (!completed)
+					{
+						io.run_one();
+					}
+					if (*completed)
+					{
+						boost::throw_exception(boost::system::system_error(*completed));
+					}
+				}
+				return engine.submit_calls() + engine.completion_wakeups() - calls_before;
+			}
+#endif
+
+			//! \param send_whole_file sends the file to the socket and returns the number of system calls needed
+			template <class SendFile>
+			void measure(char const *name, boost::asio::io_service &io, boost::uint64_t file_size,
+			             unsigned repetitions, SendFile const &send_whole_file)
+			{
+				boost::asio::ip::tcp::acceptor acceptor(
+				    io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+				boost::asio::ip::tcp::socket sender(io);
+				boost::asio::ip::tcp::socket receiver(io);
+				sender.connect(acceptor.local_endpoint());
+				acceptor.accept(receiver);
+
+				auto draining = std::async(std::launch::async, [&receiver]() -> boost::uint64_t
+				                           {
+					                           std::vector<char> buffer(1024 * 1024);
+					                           boost::uint64_t total_received = 0;
+					                           for (;;)
+					                           {
+						                           boost::system::error_code ec;
+						                           std::size_t const received =
+						                               receiver.read_some(boost::asio::buffer(buffer), ec);
+						                           if (ec)
+						                           {
+							                           return total_received;
+						                           }
+						                           total_received += received;
+					                           }
+					                       });
+
+				boost::uint64_t calls = 0;
+				auto const started = std::chrono::steady_clock::now();
+				for (unsigned i = 0; i < repetitions; ++i)
+				{
+					calls += send_whole_file(sender.native_handle());
+				}
+				sender.shutdown(boost::asio::ip::tcp::socket::shutdown_send);
+				boost::uint64_t const received = draining.get();
+				double const seconds =
+				    std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+				boost::uint64_t const total = file_size * repetitions;
+				if (received != total)
+				{
+					throw std::runtime_error("The receiver got an unexpected number of bytes");
+				}
+				std::cout << name << ": " << (static_cast<double>(total) / seconds / 1e9) << " GB/s, " << calls
+				          << " calls (" << (static_cast<double>(calls) / static_cast<double>(repetitions))
+				          << " per file)\n";
+			}
+		}
+#endif
+
+		int send_file(std::vector<std::string> const &arguments)
+		{
+#ifdef __linux__
+			boost::uint64_t const file_size_mib =
+			    (arguments.size() >= 1) ? boost::lexical_cast<boost::uint64_t>(arguments[0]) : 256;
+			unsigned const repetitions = (arguments.size() >= 2) ? boost::lexical_cast<unsigned>(arguments[1]) : 8;
+			boost::uint64_t const file_size = file_size_mib * 1024 * 1024;
+
+			boost::filesystem::path const file_name =
+			    boost::filesystem::temp_directory_path() /
+			    boost::filesystem::unique_path("fileserver-benchmark-%%%%-%%%%-%%%%");
+			{
+				boost::filesystem::ofstream content(file_name, std::ios::binary);
+				std::vector<char> block(1024 * 1024);
+				for (std::size_t i = 0; i < block.size(); ++i)
+				{
+					block[i] = static_cast<char>(i * 7);
+				}
+				for (boost::uint64_t i = 0; i < file_size_mib; ++i)
+				{
+					content.write(block.data(), static_cast<std::streamsize>(block.size()));
+				}
+			}
+
+			int const file = ::open(file_name.c_str(), O_RDONLY);
+			if (file < 0)
+			{
+				std::cerr << "Could not open " << file_name << '\n';
+				return 1;
+			}
+
+			// both paths are measured with a warm page cache, so that the disk does not dominate
+			prefetch_file(file, 0, static_cast<std::size_t>(file_size));
+			// a receiver that fails shows up as an error instead of ending the benchmark without a word
+			ignore_broken_pipes();
+
+			std::cout << "Sending a " << file_size_mib << " MiB file " << repetitions << " times over loopback TCP\n";
+			boost::asio::io_service io;
+			measure("sendfile", io, file_size, repetitions, [file, file_size](int socket)
+			        {
+				        return send_in_calls(socket, file, file_size,
+				                             [](int socket, int file, boost::uint64_t position, std::size_t size)
+				                             {
+					                             return send_file_to_socket(socket, file, position, size);
+					                         });
+				    });
+			std::vector<char> buffer(copy_buffer_size);
+			measure("read+send", io, file_size, repetitions, [file, file_size, &buffer](int socket)
+			        {
+				        return send_in_calls(socket, file, file_size,
+				                             [&buffer](int socket, int file, boost::uint64_t position, std::size_t size)
+				                             {
+					                             return copy_file_to_socket(socket, file, position, buffer.data(),
+					                                                        std::min(size, buffer.size()));
+					                         });
+				    });
+#ifdef FILESERVER_HAS_IO_URING
+			std::unique_ptr<io_uring_engine> const engine =
+			    io_uring_engine::create(io, io_uring_buffers_per_chain);
+			if (engine)
+			{
+				measure("io_uring", io, file_size, repetitions, [&io, &engine, file, file_size](int socket)
+				        {
+					        return send_with_io_uring(io, *engine, socket, file, file_size);
+					    });
+			}
+			else
+			{
+				std::cout << "io_uring: not supported by this kernel\n";
+			}
+#endif
+
+			::close(file);
+			boost::filesystem::remove(file_name);
+			return 0;
+#else
+			boost::ignore_unused_variable_warning(arguments);
+			std::cerr << "sendfile is only available on Linux\n";
+			return 1;
+#endif
+		}
+	}
+}
@@ -0,0 +1,135 @@
+#include "benchmarks.hpp"
+#include <server/sha256_engine.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+
+namespace fileserver
+{
+	namespace benchmarks
+	{
+		namespace
+		{
+			struct size_distribution
+			{
+				char const *name;
+				std::function<std::size_t(std::mt19937 &)> next_size;
+
+				//! whether messages of similar size are hashed together like the scan of a directory does
+				bool is_sorted;
+			};
+
+			std::vector<Si::memory_range> split_messages(std::vector<char> const &content,
+			                                             size_distribution const &sizes)
+			{
+				std::mt19937 random(1);
+				std::vector<Si::memory_range> messages;
+				char const *next = content.data();
+				char const *const end = content.data() + content.size();
+				for (;;)
+				{
+					std::size_t const size = sizes.next_size(random);
+					if (size > static_cast<std::size_t>(end - next))
+					{
+						break;
+					}
+					messages.emplace_back(Si::make_memory_range(next, next + size));
+					next += size;
+				}
+				if (sizes.is_sorted)
+				{
+					std::sort(messages.begin(), messages.end(), [](Si::memory_range left, Si::memory_range right)
+					          {
+						          return left.size() < right.size();
+						      });
+				}
+				return messages;
+			}
+
+			void measure(sha256_engine engine, std::vector<Si::memory_range> const &messages,
+			             std::vector<sha256_digest> &digests)
+			{
+				boost::uint64_t bytes = 0;
+				for (Si::memory_range const &message : messages)
+				{
+					bytes += static_cast<boost::uint64_t>(message.size());
+				}
+				digests.resize(messages.size());
+				// the same batches of 64 messages that the scan of a directory hashes
+				std::size_t const batch_size = 64;
+				auto const started = std::chrono::steady_clock::now();
+				for (std::size_t i = 0; i < messages.size(); i += batch_size)
+				{
+					std::size_t const count = std::min(batch_size, messages.size() - i);
+					sha256_many(engine, messages.data() + i, count, digests.data() + i);
+				}
+				double const seconds =
+				    std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+				std::cout << "  " << sha256_engine_name(engine) << ": "
+				          << (static_cast<double>(bytes) / seconds / 1e9) << " GB/s, "
+				          << (static_cast<double>(messages.size()) / seconds) << " messages/s\n";
+			}
+		}
+
+		int sha256(std::vector<std::string> const &arguments)
+		{
+			std::size_t const megabytes =
+			    arguments.empty() ? 256 : boost::lexical_cast<std::size_t>(arguments[0]);
+			std::vector<char> content(megabytes * 1024 * 1024);
+			for (std::size_t i = 0; i < content.size(); ++i)
+			{
+				content[i] = static_cast<char>(i * 7);
+			}
+
+			auto const fixed = [](std::size_t size)
+			{
+				return [size](std::mt19937 &)
+				{
+					return size;
+				};
+			};
+			// most files in a source tree are small, but most of the bytes are in the few large ones
+			auto const mixed = [](std::mt19937 &random)
+			{
+				return static_cast<std::size_t>(std::exp2(std::uniform_real_distribution<double>(0, 16)(random)));
+			};
+			std::vector<size_distribution> const distributions = {{"64 B", fixed(64), false},
+			                                                      {"1 KiB", fixed(1024), false},
+			                                                      {"4 KiB", fixed(4 * 1024), false},
+			                                                      {"16 KiB", fixed(16 * 1024), false},
+			                                                      {"64 KiB", fixed(64 * 1024), false},
+			                                                      {"mixed up to 64 KiB", mixed, false},
+			                                                      {"mixed up to 64 KiB, sorted", mixed, true}};
+
+			std::vector<sha256_engine> const engines = {sha256_engine::openssl, sha256_engine::sha_ni,
+			                                            sha256_engine::avx2, sha256_engine::avx512};
+			std::cout << "best engine on this CPU: " << sha256_engine_name(best_sha256_engine()) << '\n';
+			for (size_distribution const &sizes : distributions)
+			{
+				std::vector<Si::memory_range> const messages = split_messages(content, sizes);
+				std::cout << sizes.name << " (" << messages.size() << " messages)\n";
+				std::vector<sha256_digest> expected;
+				measure(sha256_engine::openssl, messages, expected);
+				for (sha256_engine const engine : engines)
+				{
+					if ((engine == sha256_engine::openssl) || !is_supported(engine))
+					{
+						continue;
+					}
+					std::vector<sha256_digest> digests;
+					measure(engine, messages, digests);
+					if (digests != expected)
+					{
+						std::cerr << sha256_engine_name(engine) << " computed different digests\n";
+						return 1;
+					}
+				}
+			}
+			return 0;
+		}
+	}
+}
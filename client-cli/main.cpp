@@ -102,13 +102,16 @@ int main(int argc, char **argv)
 	std::string digest;
 	boost::filesystem::path given_mount_point;
 	std::string host;
+	bool use_pack = false;
 
 	boost::program_options::options_description desc("Allowed options");
 	desc.add_options()("help", "produce help message")("verb", boost::program_options::value(&verb),
 	                                                   "what to do (get)")(
 	    "digest,d", boost::program_options::value(&digest), "the hash of the file to get/mount")(
 	    "mountpoint", boost::program_options::value(&given_mount_point), "an absolute directory to mount at")(
-	    "host", boost::program_options::value(&host), "the IP address of the server");
+	    "host", boost::program_options::value(&host), "the IP address of the server")(
+	    "pack", boost::program_options::bool_switch(&use_pack),
+	    "clone: receive the whole tree in a single response instead of one request per directory");
 
 	boost::program_options::positional_options_description positional;
 	positional.add("verb", 1);
@@ -215,8 +218,10 @@ int main(int argc, char **argv)
 		fileserver::filesystem_directory_manipulator mount_point_manipulator(*mount_point);
 		boost::asio::io_service io;
 		fileserver::http_storage_reader service(io, server, "/");
-		auto all = Si::for_each(fileserver::clone_directory(*requested, mount_point_manipulator, service, io),
-		                        [&rc](boost::system::error_code ec)
+		auto cloning =
+		    use_pack ? fileserver::clone_directory_from_pack(*requested, mount_point_manipulator, service)
+		             : fileserver::clone_directory(*requested, mount_point_manipulator, service, io);
+		auto all = Si::for_each(std::move(cloning), [&rc](boost::system::error_code ec)
 		                        {
 			                        if (ec)
 			                        {
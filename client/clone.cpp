@@ -1,6 +1,8 @@
 #include "clone.hpp"
 #include "storage_reader/http_storage_reader.hpp"
 #include <server/directory_listing.hpp>
+#include <server/pack_format.hpp>
+#include <silicium/source/memory_source.hpp>
 #include <silicium/source/virtualized_source.hpp>
 #include <silicium/source/observable_source.hpp>
 #include <silicium/source/received_from_socket_source.hpp>
@@ -12,6 +14,7 @@
 #include <boost/filesystem/operations.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
 #include <boost/asio/write.hpp>
+#include <boost/unordered_map.hpp>
 
 namespace fileserver
 {
@@ -46,17 +49,9 @@ namespace fileserver
 			return boost::system::error_code();
 		}
 
-		boost::system::error_code clone_regular_file(storage_reader &service, std::string const &file_name,
-		                                             unknown_digest const &blob_digest,
+		boost::system::error_code clone_regular_file(linear_file remote_file, std::string const &file_name,
 		                                             directory_manipulator &destination, Si::yield_context yield)
 		{
-			Si::error_or<linear_file> maybe_remote_file;
-			yield.get_one(service.open(blob_digest), maybe_remote_file);
-			if (maybe_remote_file.is_error())
-			{
-				return maybe_remote_file.error();
-			}
-			linear_file remote_file = std::move(maybe_remote_file.get());
 			Si::error_or<std::unique_ptr<writeable_file>> maybe_local_file = destination.create_regular_file(file_name);
 			if (maybe_local_file.is_error())
 			{
@@ -94,18 +89,47 @@ namespace fileserver
 			    parsed,
 			    [&](std::unique_ptr<directory_listing> const &listing) -> boost::system::error_code
 			    {
+				    // the files of a directory are fetched together, so that small files do not cost a round trip each
+				    std::vector<std::string const *> file_names;
+				    std::vector<unknown_digest> file_digests;
 				    for (auto const &entry : listing->entries)
 				    {
 					    if (entry.second.type == "blob")
 					    {
-						    boost::system::error_code const ec = clone_regular_file(
-						        service, entry.first, to_unknown_digest(entry.second.referenced), destination, yield);
+						    file_names.emplace_back(&entry.first);
+						    file_digests.emplace_back(to_unknown_digest(entry.second.referenced));
+					    }
+					    else if (entry.second.type != "json_v1")
+					    {
+						    return boost::system::error_code(service_error::unknown_entry_type);
+					    }
+				    }
+				    if (!file_names.empty())
+				    {
+					    auto files = service.open_batch(std::move(file_digests));
+					    for (std::string const *file_name : file_names)
+					    {
+						    boost::optional<Si::error_or<linear_file>> remote_file = yield.get_one(files);
+						    if (!remote_file)
+						    {
+							    return boost::system::error_code(service_error::malformed_response);
+						    }
+						    if (remote_file->is_error())
+						    {
+							    return remote_file->error();
+						    }
+						    boost::system::error_code const ec =
+						        clone_regular_file(std::move(remote_file->get()), *file_name, destination, yield);
 						    if (ec)
 						    {
 							    return ec;
 						    }
 					    }
-					    else if (entry.second.type == "json_v1")
+				    }
+
+				    for (auto const &entry : listing->entries)
+				    {
+					    if (entry.second.type == "json_v1")
 					    {
 						    boost::system::error_code const ec =
 						        clone_recursively(service, to_unknown_digest(entry.second.referenced),
@@ -115,10 +139,6 @@ namespace fileserver
 							    return ec;
 						    }
 					    }
-					    else
-					    {
-						    throw std::logic_error("unknown directory entry type"); // TODO
-					    }
 				    }
 				    return boost::system::error_code();
 				},
@@ -127,6 +147,316 @@ namespace fileserver
 				    throw std::logic_error("todo");
 				});
 		}
+
+		//! Reads the objects of a pack one after another from the content of the response.
+		struct pack_reader
+		{
+			pack_reader(linear_file &pack, Si::yield_context yield)
+			    : pack(pack)
+			    , yield(yield)
+			{
+			}
+
+			bool is_finished() const
+			{
+				return buffered.empty() && (received >= pack.size);
+			}
+
+			Si::error_or<pack_object_header> read_header()
+			{
+				std::string line;
+				for (;;)
+				{
+					boost::system::error_code const ec = receive();
+					if (ec)
+					{
+						return ec;
+					}
+					char const *const line_end = std::find(buffered.begin(), buffered.end(), '\n');
+					line.append(buffered.begin(), line_end);
+					if (line_end != buffered.end())
+					{
+						buffered = Si::make_memory_range(line_end + 1, buffered.end());
+						break;
+					}
+					buffered = Si::memory_range();
+					if (line.size() > 1024)
+					{
+						return boost::system::error_code(service_error::malformed_response);
+					}
+				}
+				Si::optional<pack_object_header> parsed =
+				    parse_pack_object_header(Si::make_memory_range(line.data(), line.data() + line.size()));
+				if (!parsed)
+				{
+					return boost::system::error_code(service_error::malformed_response);
+				}
+				return std::move(*parsed);
+			}
+
+			//! Passes the content of the current object piece by piece to the consumer.
+			template <class Consumer>
+			boost::system::error_code read_content(boost::uint64_t size, Consumer &&consume)
+			{
+				while (size > 0)
+				{
+					boost::system::error_code ec = receive();
+					if (ec)
+					{
+						return ec;
+					}
+					std::size_t const taken =
+					    static_cast<std::size_t>(std::min(static_cast<boost::uint64_t>(buffered.size()), size));
+					Si::memory_range const piece = Si::make_memory_range(buffered.begin(), buffered.begin() + taken);
+					buffered = Si::make_memory_range(piece.end(), buffered.end());
+					size -= taken;
+					ec = consume(piece);
+					if (ec)
+					{
+						return ec;
+					}
+				}
+				return boost::system::error_code();
+			}
+
+		private:
+			linear_file &pack;
+			Si::yield_context yield;
+
+			//! received, but not consumed yet
+			Si::memory_range buffered;
+			file_offset received = 0;
+
+			//! makes sure that something is buffered
+			boost::system::error_code receive()
+			{
+				if (!buffered.empty())
+				{
+					return boost::system::error_code();
+				}
+				if (received >= pack.size)
+				{
+					return boost::system::error_code(service_error::malformed_response);
+				}
+				boost::optional<Si::error_or<Si::memory_range>> const piece = yield.get_one(pack.content);
+				if (!piece)
+				{
+					return boost::system::error_code(service_error::malformed_response);
+				}
+				if (piece->is_error())
+				{
+					return piece->error();
+				}
+				if (piece->get().empty())
+				{
+					return boost::system::error_code(service_error::malformed_response);
+				}
+				buffered = piece->get();
+				received += buffered.size();
+				return boost::system::error_code();
+			}
+		};
+
+		//! Where the objects of a pack have to go. All listings arrive before the first blob, so every name of a blob
+		//! is known when its content arrives.
+		struct unpacking
+		{
+			std::vector<std::unique_ptr<directory_manipulator>> directories;
+
+			//! directories whose listing has not arrived yet
+			boost::unordered_map<unknown_digest, std::vector<directory_manipulator *>> unlisted_directories;
+
+			//! a listing is sent only once, but the same directory can appear in more than one place
+			boost::unordered_map<unknown_digest, std::unique_ptr<directory_listing>> listings;
+
+			boost::unordered_map<unknown_digest, std::vector<std::pair<directory_manipulator *, std::string>>>
+			    blob_destinations;
+
+			boost::system::error_code fill_directory(directory_manipulator &destination,
+			                                         directory_listing const &listing)
+			{
+				boost::system::error_code ec = destination.require_exists();
+				if (ec)
+				{
+					return ec;
+				}
+				for (auto const &entry : listing.entries)
+				{
+					unknown_digest const referenced = to_unknown_digest(entry.second.referenced);
+					if (entry.second.type == "blob")
+					{
+						blob_destinations[referenced].emplace_back(&destination, entry.first);
+					}
+					else if (entry.second.type == "json_v1")
+					{
+						directories.emplace_back(destination.edit_subdirectory(entry.first));
+						directory_manipulator &subdirectory = *directories.back();
+						auto const known = listings.find(referenced);
+						if (known == listings.end())
+						{
+							unlisted_directories[referenced].emplace_back(&subdirectory);
+							continue;
+						}
+						ec = fill_directory(subdirectory, *known->second);
+						if (ec)
+						{
+							return ec;
+						}
+					}
+					else
+					{
+						return boost::system::error_code(service_error::unknown_entry_type);
+					}
+				}
+				return boost::system::error_code();
+			}
+
+			bool is_complete() const
+			{
+				return unlisted_directories.empty() && blob_destinations.empty();
+			}
+		};
+
+		boost::system::error_code unpack_listing(pack_reader &reader, pack_object_header const &object,
+		                                         unpacking &state)
+		{
+			std::vector<char> serialized;
+			boost::system::error_code ec = reader.read_content(object.size, [&serialized](Si::memory_range piece)
+			                                                   {
+				                                                   serialized.insert(serialized.end(), piece.begin(),
+				                                                                     piece.end());
+				                                                   return boost::system::error_code();
+				                                               });
+			if (ec)
+			{
+				return ec;
+			}
+			Si::memory_source<char> serialized_source(
+			    Si::make_memory_range(serialized.data(), serialized.data() + serialized.size()));
+			Si::variant<std::unique_ptr<directory_listing>, std::size_t> parsed = deserialize_json(serialized_source);
+			std::unique_ptr<directory_listing> *const listing =
+			    Si::try_get_ptr<std::unique_ptr<directory_listing>>(parsed);
+			if (!listing)
+			{
+				return boost::system::error_code(service_error::malformed_response);
+			}
+			auto const waiting = state.unlisted_directories.find(object.digest);
+			if (waiting != state.unlisted_directories.end())
+			{
+				std::vector<directory_manipulator *> const filled = std::move(waiting->second);
+				state.unlisted_directories.erase(waiting);
+				for (directory_manipulator *directory : filled)
+				{
+					ec = state.fill_directory(*directory, **listing);
+					if (ec)
+					{
+						return ec;
+					}
+				}
+			}
+			state.listings.emplace(object.digest, std::move(*listing));
+			return boost::system::error_code();
+		}
+
+		//! The content is written to the first place of the blob and then copied locally to the other places, so
+		//! that a blob with very many names does not need a file descriptor for each of them at the same time.
+		boost::system::error_code unpack_blob(pack_reader &reader, pack_object_header const &object, unpacking &state)
+		{
+			auto const destinations = state.blob_destinations.find(object.digest);
+			if (destinations == state.blob_destinations.end())
+			{
+				return boost::system::error_code(service_error::malformed_response);
+			}
+			std::vector<std::pair<directory_manipulator *, std::string>> const places =
+			    std::move(destinations->second);
+			state.blob_destinations.erase(destinations);
+			assert(!places.empty());
+			{
+				Si::error_or<std::unique_ptr<writeable_file>> first =
+				    places[0].first->create_regular_file(places[0].second);
+				if (first.is_error())
+				{
+					return first.error();
+				}
+				writeable_file &file = *first.get();
+				boost::system::error_code const ec = reader.read_content(object.size, [&file](Si::memory_range piece)
+				                                                         {
+					                                                         return file.write(piece);
+					                                                     });
+				if (ec)
+				{
+					return ec;
+				}
+			}
+			for (std::size_t i = 1; i < places.size(); ++i)
+			{
+				Si::error_or<read_write_file> original = places[0].first->read_write_regular_file(places[0].second);
+				if (original.is_error())
+				{
+					return original.error();
+				}
+				auto content = original.get().readable->read(0);
+				if (content.is_error())
+				{
+					return content.error();
+				}
+				Si::error_or<std::unique_ptr<writeable_file>> copy =
+				    places[i].first->create_regular_file(places[i].second);
+				if (copy.is_error())
+				{
+					return copy.error();
+				}
+				boost::system::error_code const ec =
+				    copy_bytes(*content.get(), static_cast<file_offset>(object.size), *copy.get());
+				if (ec)
+				{
+					return ec;
+				}
+			}
+			return boost::system::error_code();
+		}
+
+		boost::system::error_code unpack_directory(linear_file &pack, unknown_digest const &root_digest,
+		                                           directory_manipulator &destination, Si::yield_context yield)
+		{
+			pack_reader reader(pack, yield);
+			unpacking state;
+			state.unlisted_directories[root_digest].emplace_back(&destination);
+			while (!reader.is_finished())
+			{
+				Si::error_or<pack_object_header> const object = reader.read_header();
+				if (object.is_error())
+				{
+					return object.error();
+				}
+				boost::system::error_code ec;
+				if (object.get().type == "json_v1")
+				{
+					ec = unpack_listing(reader, object.get(), state);
+				}
+				else if (object.get().type == "blob")
+				{
+					ec = unpack_blob(reader, object.get(), state);
+				}
+				else
+				{
+					// a newer server may send things this client cannot use
+					ec = reader.read_content(object.get().size, [](Si::memory_range)
+					                         {
+						                         return boost::system::error_code();
+						                     });
+				}
+				if (ec)
+				{
+					return ec;
+				}
+			}
+			if (!state.is_complete())
+			{
+				return boost::system::error_code(service_error::malformed_response);
+			}
+			return boost::system::error_code();
+		}
 	}
 
 	Si::unique_observable<boost::system::error_code> clone_directory(unknown_digest const &root_digest,
@@ -141,4 +471,21 @@ namespace fileserver
 			    yield(ec);
 			}));
 	}
+
+	Si::unique_observable<boost::system::error_code> clone_directory_from_pack(unknown_digest const &root_digest,
+	                                                                           directory_manipulator &destination,
+	                                                                           storage_reader &server)
+	{
+		return Si::erase_unique(Si::make_coroutine_generator<boost::system::error_code>(
+		    [&root_digest, &destination, &server](Si::push_context<boost::system::error_code> yield)
+		    {
+			    Si::error_or<linear_file> maybe_pack;
+			    yield.get_one(server.open_pack(root_digest), maybe_pack);
+			    if (maybe_pack.is_error())
+			    {
+				    return yield(maybe_pack.error());
+			    }
+			    yield(unpack_directory(maybe_pack.get(), root_digest, destination, yield));
+			}));
+	}
 }
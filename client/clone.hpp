@@ -209,6 +209,12 @@ namespace fileserver
 	                                                                 directory_manipulator &destination,
 	                                                                 storage_reader &server,
 	                                                                 boost::asio::io_service &io);
+
+	//! Like clone_directory, but the whole tree arrives in a single response, which makes a clone of many small files
+	//! much faster when the server is far away.
+	Si::unique_observable<boost::system::error_code> clone_directory_from_pack(unknown_digest const &root_digest,
+	                                                                           directory_manipulator &destination,
+	                                                                           storage_reader &server);
 }
 
 #endif
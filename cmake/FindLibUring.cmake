@@ -0,0 +1,13 @@
+FIND_PATH(LIBURING_INCLUDE_DIR NAMES liburing.h)
+MARK_AS_ADVANCED(LIBURING_INCLUDE_DIR)
+FIND_LIBRARY(LIBURING_LIBRARY NAMES uring)
+MARK_AS_ADVANCED(LIBURING_LIBRARY)
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LIBURING DEFAULT_MSG LIBURING_LIBRARY LIBURING_INCLUDE_DIR)
+IF (LIBURING_FOUND)
+	SET(LIBURING_LIBRARIES ${LIBURING_LIBRARY})
+	SET(LIBURING_INCLUDE_DIRS ${LIBURING_INCLUDE_DIR})
+ELSE()
+	SET(LIBURING_LIBRARIES)
+	SET(LIBURING_INCLUDE_DIRS)
+ENDIF()
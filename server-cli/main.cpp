@@ -3,16 +3,32 @@
 #include <boost/asio.hpp>
 #endif
 #include <server/scan_directory.hpp>
+#include <server/update_directory.hpp>
+#include <server/name_tree.hpp>
+#include <server/batch_format.hpp>
+#include <server/pack_format.hpp>
 #include <server/directory_listing.hpp>
 #include <server/sha256.hpp>
 #include <server/hexadecimal.hpp>
 #include <server/path.hpp>
 #include <server/recursive_directory_watcher.hpp>
-#include <silicium/asio/tcp_acceptor.hpp>
+#include <server/socket_deadline.hpp>
+#include <server/pending_result.hpp>
+#include <server/positional_read.hpp>
+#include <server/pool_executor.hpp>
+#include <server/zero_copy.hpp>
+#include <server/byte_range.hpp>
+#include <server/entity_tag.hpp>
+#include <server/request_header.hpp>
+#include <server/request_target.hpp>
+#include <server/pooled_coroutine.hpp>
+#include <server/recycling_pool.hpp>
+#include <server/admission_control.hpp>
+#include <server/file_handle_cache.hpp>
+#include <server/blob_cache.hpp>
+#include <server/file_mapping.hpp>
+#include <server/linux/io_uring_engine.hpp>
 #include <silicium/observable/spawn_coroutine.hpp>
-#include <silicium/asio/writing_observable.hpp>
-#include <silicium/asio/reading_observable.hpp>
-#include <silicium/source/received_from_socket_source.hpp>
 #include <silicium/observable/transform_if_initialized.hpp>
 #include <silicium/observable/erase_shared.hpp>
 #include <silicium/source/observable_source.hpp>
@@ -23,7 +39,7 @@
 #include <silicium/http/http.hpp>
 #include <silicium/http/uri.hpp>
 #include <silicium/to_unique.hpp>
-#include <silicium/observable/thread_generator.hpp>
+#include <silicium/to_shared.hpp>
 #include <silicium/source/buffering_source.hpp>
 #include <ventura/open.hpp>
 #include <silicium/read_file.hpp>
@@ -42,331 +58,1981 @@
 #include <boost/program_options.hpp>
 #include <boost/container/vector.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/range/algorithm/equal.hpp>
+#include <boost/range/as_literal.hpp>
 #include <ventura/file_operations.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/format.hpp>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 namespace fileserver
 {
 	using response_part = Si::memory_range;
 
-	typedef Si::variant<unknown_digest, Si::noexcept_string> any_reference;
+	Si::http::response make_response_header(int status, char const *status_text, bool keep_alive)
+	{
+		Si::http::response header;
+		header.http_version = "HTTP/1.1";
+		header.status = status;
+		header.status_text = status_text;
+		header.arguments = Si::make_unique<Si::http::response::arguments_table>();
+		(*header.arguments)["Connection"] = connection_header_value(keep_alive);
+		return header;
+	}
+
+	std::vector<char> serialize_response(Si::http::response const &header)
+	{
+		std::vector<char> serialized;
+		auto sink = Si::make_container_sink(serialized);
+		Si::http::generate_response(sink, header);
+		return serialized;
+	}
+
+	enum class request_type
+	{
+		get,
+		head
+	};
+
+	template <class String>
+	request_type determine_request_type(String const &method)
+	{
+		if (boost::algorithm::iequals("HEAD", method))
+		{
+			return request_type::head;
+		}
+		else
+		{
+			return request_type::get;
+		}
+	}
+
+	struct serve_options
+	{
+		std::size_t threads;
+
+		//! 0 means one per hardware thread
+		std::size_t disk_threads;
+
+		std::chrono::steady_clock::duration keep_alive_timeout;
+
+		//! the time a client has to send a complete request header once it has begun
+		std::chrono::steady_clock::duration header_timeout;
+
+		//! the time every part of a response may take in addition to what the minimum send rate allows
+		std::chrono::steady_clock::duration send_timeout;
+
+		//! a client that reads a response more slowly is disconnected, 0 means no limit
+		boost::uint64_t min_send_rate;
+
+		//! the time a closing connection waits for the client to close its side
+		std::chrono::steady_clock::duration linger_timeout;
+
+		//! bytes of coroutine stack per connection
+		std::size_t stack_size;
+
+		//! connections over this limit get a 503 right after being accepted, 0 means no limit
+		std::size_t max_sessions;
+
+		//! requests for files get a 503 while this many disk operations are waiting, 0 means no limit
+		std::size_t max_disk_queue_depth;
+
+		//! how many connections the kernel may hold until they are accepted
+		int listen_backlog;
+
+		//! how many files are kept open for later requests
+		std::size_t open_file_cache_size;
+
+		//! updates the served tree when the directory changes
+		bool watch;
+
+		//! the memory for the contents of popular files
+		boost::uint64_t blob_cache_size;
+
+		//! larger files are always read from the disk
+		boost::uint64_t max_cached_blob_size;
+
+		//! sends files that are too large for the blob cache from shared memory mappings
+		bool memory_map;
+
+		//! the total size of the files that are mapped at the same time
+		boost::uint64_t max_mapped_bytes;
+
+		//! larger files are sent like without memory_map, because they would push everything else out of the mappings
+		boost::uint64_t max_mapped_file_size;
+
+		bool zero_copy;
+#ifdef FILESERVER_HAS_IO_URING
+		//! used where sendfile is disabled or not supported
+		bool io_uring;
+#endif
+
+		//! remembers the hashes of unchanged files across restarts, empty means no cache
+		boost::filesystem::path hash_cache;
+
+		serve_options()
+		    : threads(1)
+		    , disk_threads(0)
+		    , keep_alive_timeout(std::chrono::seconds(15))
+		    , header_timeout(std::chrono::seconds(10))
+		    , send_timeout(std::chrono::seconds(10))
+		    , min_send_rate(4 * 1024)
+		    , linger_timeout(std::chrono::seconds(2))
+		    , stack_size(64 * 1024)
+		    , max_sessions(10000)
+		    , max_disk_queue_depth(1024)
+		    , listen_backlog(boost::asio::socket_base::max_connections)
+		    , open_file_cache_size(256)
+		    , watch(false)
+		    , blob_cache_size(64 * 1024 * 1024)
+		    , max_cached_blob_size(1024 * 1024)
+		    , memory_map(false)
+		    , max_mapped_bytes(1024 * 1024 * 1024)
+		    , max_mapped_file_size(64 * 1024 * 1024)
+		    , zero_copy(true)
+#ifdef FILESERVER_HAS_IO_URING
+		    , io_uring(true)
+#endif
+		{
+		}
+	};
+
+	typedef file_handle_cache<path, Si::file_handle> open_file_cache;
+	typedef blob_cache<sha256_digest, sha256_digest_hash> hot_blob_cache;
+#ifndef _WIN32
+	typedef file_handle_cache<path, file_mapping> mapped_file_cache;
+#endif
+
+	//! What the serving threads remember about the served files.
+	struct file_caches
+	{
+		open_file_cache open_files;
+		hot_blob_cache blobs;
+#ifndef _WIN32
+		//! declared before the cache because the mappings give their size back when they are destroyed
+		mapping_budget mapped_memory;
+		mapped_file_cache mappings;
+		bool is_mapping_enabled;
+		boost::uint64_t max_mapped_file_size;
+#endif
+
+		explicit file_caches(serve_options const &options)
+		    : open_files(options.open_file_cache_size)
+		    , blobs(options.blob_cache_size, options.max_cached_blob_size)
+#ifndef _WIN32
+		    , mapped_memory(options.memory_map ? options.max_mapped_bytes : 0)
+		    , mappings(options.memory_map ? options.max_mapped_bytes : 0)
+		    , is_mapping_enabled(options.memory_map)
+		    , max_mapped_file_size(std::min(options.max_mapped_file_size, options.max_mapped_bytes))
+#endif
+		{
+		}
+
+		//! \param changed_file nullptr if any file may have changed
+		void forget(path const *changed_file)
+		{
+			if (changed_file)
+			{
+				open_files.invalidate(*changed_file);
+#ifndef _WIN32
+				mappings.invalidate(*changed_file);
+#endif
+			}
+			else
+			{
+				open_files.clear();
+#ifndef _WIN32
+				mappings.clear();
+#endif
+			}
+			// A cached blob is only found by the digest that was computed from its content, but that content is read
+			// again when the blob is loaded. load_blob refuses a file that has changed since it was hashed, so the old
+			// digest cannot get the new content.
+		}
+	};
+
+	//! Runs blocking file operations on a thread pool and hands the results back to the io_service of a session.
+	struct disk_reader
+	{
+		pool_executor<Si::std_threading> &pool;
+		boost::asio::io_service &io;
+		admission_control &admission;
+		file_caches &caches;
+#ifdef FILESERVER_HAS_IO_URING
+		//! reads and sends file contents without the pool if not null
+		io_uring_engine *uring;
+#endif
+
+		//! \return true if no more reads should be queued, which is counted as a rejection
+		bool reject_if_busy()
+		{
+			if (!admission.is_disk_queue_full(pool.queue_depth()))
+			{
+				return false;
+			}
+			admission.count_rejected_disk_read();
+			return true;
+		}
+
+		template <class Result, class Operation>
+		void async_run(Operation operation, std::function<void(Result)> completion)
+		{
+			boost::asio::io_service &io = this->io;
+			pool.submit([operation, completion, &io]() mutable
+			            {
+				            Result result = operation();
+				            io.post([completion, result]() mutable
+				                    {
+					                    completion(std::move(result));
+					                });
+				        });
+		}
+	};
+
+	//! A plain text snapshot of the counters that are useful for monitoring a running server.
+	std::string format_statistics(disk_reader const &disk)
+	{
+		std::ostringstream formatted;
+		formatted << "disk_threads " << disk.pool.thread_count() << '\n';
+		formatted << "disk_queue_depth " << disk.pool.queue_depth() << '\n';
+		formatted << "disk_queue_depth_max " << disk.admission.max_disk_queue_depth() << '\n';
+		formatted << "disk_rejected_requests " << disk.admission.rejected_disk_reads() << '\n';
+		formatted << "sessions " << disk.admission.sessions() << '\n';
+		formatted << "sessions_max " << disk.admission.max_sessions() << '\n';
+		formatted << "sessions_rejected " << disk.admission.rejected_sessions() << '\n';
+		formatted << "sessions_timed_out " << disk.admission.timeouts() << '\n';
+		formatted << "open_files_cached " << disk.caches.open_files.size() << '\n';
+		formatted << "open_files_max " << disk.caches.open_files.capacity() << '\n';
+		formatted << "open_file_hits " << disk.caches.open_files.hits() << '\n';
+		formatted << "open_file_misses " << disk.caches.open_files.misses() << '\n';
+		formatted << "blob_cache_blobs " << disk.caches.blobs.size() << '\n';
+		formatted << "blob_cache_bytes " << disk.caches.blobs.bytes() << '\n';
+		formatted << "blob_cache_bytes_max " << disk.caches.blobs.max_bytes() << '\n';
+		formatted << "blob_cache_blob_size_max " << disk.caches.blobs.max_blob_size() << '\n';
+		formatted << "blob_cache_hits " << disk.caches.blobs.hits() << '\n';
+		formatted << "blob_cache_misses " << disk.caches.blobs.misses() << '\n';
+#ifndef _WIN32
+		formatted << "mapped_files " << disk.caches.mappings.size() << '\n';
+		formatted << "mapped_bytes " << disk.caches.mappings.weight() << '\n';
+		formatted << "mapped_bytes_max " << disk.caches.mappings.capacity() << '\n';
+		formatted << "mapped_bytes_live " << disk.caches.mapped_memory.used() << '\n';
+		formatted << "mapping_hits " << disk.caches.mappings.hits() << '\n';
+		formatted << "mapping_misses " << disk.caches.mappings.misses() << '\n';
+#endif
+		return formatted.str();
+	}
+
+	std::size_t const file_body_chunk_size = 64 * 1024;
+
+	typedef send_pacer<socket_deadline<boost::asio::ip::tcp::socket>> response_pacer;
+
+	//! A file that is written to in place keeps its path, but until a tree with the new digest is served, the served
+	//! tree still promises the old content under the old digest.
+	//! \return whether the opened file is still the one that was hashed for the served tree
+	inline bool is_unchanged_since_hashed(Si::file_handle const &opened, file_system_location const &file)
+	{
+#ifdef _WIN32
+		boost::ignore_unused_variable_warning(opened);
+		boost::ignore_unused_variable_warning(file);
+		return true;
+#else
+		return file.identity && (identify_file(opened.handle) == file.identity);
+#endif
+	}
+
+	//! Opens a file on the disk threads because opening can block. Recently used files are still open.
+	//! \return nullptr on failure or if the file has changed since it was hashed
+	template <class YieldContext>
+	std::shared_ptr<Si::file_handle> open_for_reading(YieldContext &yield, disk_reader &disk,
+	                                                  file_system_location const &file)
+	{
+		open_file_cache::lookup const cached = disk.caches.open_files.find(file.where);
+		if (cached.handle)
+		{
+			// fstat of a file that is open already does not wait for the disk
+			if (!is_unchanged_since_hashed(*cached.handle, file))
+			{
+				return nullptr;
+			}
+			return cached.handle;
+		}
+		pending_result<std::shared_ptr<Si::file_handle>> opened;
+		disk.async_run<std::shared_ptr<Si::file_handle>>(
+		    [file]() -> std::shared_ptr<Si::file_handle>
+		    {
+			    Si::error_or<Si::file_handle> opening =
+			        ventura::open_reading(ventura::safe_c_str(to_native_range(file.where)));
+			    if (opening.is_error())
+			    {
+				    return nullptr;
+			    }
+			    Si::file_handle opened = opening.move_value();
+			    if (!is_unchanged_since_hashed(opened, file))
+			    {
+				    return nullptr;
+			    }
+			    return Si::to_shared(std::move(opened));
+			},
+		    opened.completion());
+		Si::optional<std::shared_ptr<Si::file_handle>> result = yield.get_one(opened);
+		if (!result || !*result)
+		{
+			return nullptr;
+		}
+		disk.caches.open_files.insert(file.where, *result, cached.generation);
+		return std::move(*result);
+	}
+
+	//! Reads a whole file into memory so that it can be cached under the digest of the scan.
+	//! \return nullptr on failure or if the file has changed since it was hashed
+	template <class YieldContext>
+	std::shared_ptr<std::vector<char> const> load_blob(YieldContext &yield, disk_reader &disk,
+	                                                   file_system_location const &file)
+	{
+		std::shared_ptr<Si::file_handle> const opened = open_for_reading(yield, disk, file);
+		if (!opened)
+		{
+			return nullptr;
+		}
+		std::size_t const size = static_cast<std::size_t>(file.size);
+		pending_result<std::shared_ptr<std::vector<char> const>> loaded;
+		disk.async_run<std::shared_ptr<std::vector<char> const>>(
+		    [opened, file, size]() -> std::shared_ptr<std::vector<char> const>
+		    {
+			    auto content = std::make_shared<std::vector<char>>(size);
+			    Si::error_or<std::size_t> const read = read_fully_at(opened->handle, 0, content->data(), size);
+			    if (read.is_error() || (read.get() != size))
+			    {
+				    return nullptr;
+			    }
+			    // checked after the read, so that a write while the content was read cannot put a mix of old and new
+			    // bytes into the cache either
+			    if (!is_unchanged_since_hashed(*opened, file))
+			    {
+				    return nullptr;
+			    }
+			    return std::move(content);
+			},
+		    loaded.completion());
+		Si::optional<std::shared_ptr<std::vector<char> const>> result = yield.get_one(loaded);
+		if (!result)
+		{
+			return nullptr;
+		}
+		return std::move(*result);
+	}
+
+#ifndef _WIN32
+	//! Maps a whole file or reuses the mapping that other requests for the same file are using.
+	//! \return nullptr if the file cannot be mapped, is too large for a mapping or all of the mapped memory is in use
+	template <class YieldContext>
+	std::shared_ptr<file_mapping> map_for_sending(YieldContext &yield, disk_reader &disk,
+	                                              file_system_location const &file)
+	{
+		if (file.size > disk.caches.max_mapped_file_size)
+		{
+			return nullptr;
+		}
+		mapped_file_cache &mappings = disk.caches.mappings;
+		mapped_file_cache::lookup const cached = mappings.find(file.where);
+		if (cached.handle)
+		{
+			return cached.handle;
+		}
+		std::shared_ptr<Si::file_handle> const opened = open_for_reading(yield, disk, file);
+		if (!opened)
+		{
+			return nullptr;
+		}
+		std::size_t const size = static_cast<std::size_t>(file.size);
+		// Only the mappings that nobody is sending from give their memory back when they are forgotten. Until the
+		// others are finished, files are sent without a mapping.
+		mappings.make_room(size);
+		pending_result<std::shared_ptr<file_mapping>> mapped;
+		mapping_budget &budget = disk.caches.mapped_memory;
+		// the hints to the kernel can take a moment, so they are given on a disk thread
+		disk.async_run<std::shared_ptr<file_mapping>>(
+		    [&budget, opened, size]()
+		    {
+			    return create_counted_mapping(budget, opened->handle, size);
+			},
+		    mapped.completion());
+		Si::optional<std::shared_ptr<file_mapping>> result = yield.get_one(mapped);
+		if (!result || !*result)
+		{
+			return nullptr;
+		}
+		mappings.insert(file.where, *result, cached.generation, size);
+		return std::move(*result);
+	}
+
+	std::size_t const mapped_window_size = 1024 * 1024;
+
+	//! Sends a part of a mapped file. A page fault of the network thread would wait for the disk, so the disk threads
+	//! read the next window of the mapping into memory while the current window is being sent.
+	template <class YieldContext, class SendRange>
+	bool send_mapped_range(YieldContext &yield, SendRange const &send, disk_reader &disk,
+	                       std::shared_ptr<file_mapping> const &mapping, std::size_t begin, std::size_t length)
+	{
+		std::size_t const end = begin + length;
+		std::size_t prefetched_until = begin;
+		pending_result<Si::nothing> prefetching;
+		auto const start_prefetch = [&disk, &mapping, end, &prefetched_until, &prefetching]()
+		{
+			if (prefetched_until == end)
+			{
+				return false;
+			}
+			std::size_t const size = std::min(mapped_window_size, end - prefetched_until);
+			std::size_t const position = prefetched_until;
+			prefetched_until += size;
+			prefetching = pending_result<Si::nothing>();
+			disk.async_run<Si::nothing>(
+			    [mapping, position, size]()
+			    {
+				    mapping->prefetch(position, size);
+				    return Si::nothing();
+				},
+			    prefetching.completion());
+			return true;
+		};
+
+		std::size_t position = begin;
+		bool is_prefetching = start_prefetch();
+		while (position < end)
+		{
+			if (is_prefetching && !yield.get_one(prefetching))
+			{
+				return false;
+			}
+			std::size_t const window_end = prefetched_until;
+			is_prefetching = start_prefetch();
+			if (!send(Si::make_memory_range(mapping->data() + position, mapping->data() + window_end)))
+			{
+				return false;
+			}
+			position = window_end;
+		}
+		return true;
+	}
+#endif
+
+	struct file_body_transfer
+	{
+		std::shared_ptr<Si::file_handle> file;
+		std::array<std::vector<char>, 2> chunks;
+	};
+
+	//! Sends a part of a file in chunks of bounded size. The next chunk is read by the disk threads while the
+	//! current one is being sent, so the memory needed per connection does not depend on the size of the file.
+	template <class YieldContext, class SendRange>
+	bool send_file_body(YieldContext &yield, SendRange const &send, disk_reader &disk,
+	                    file_system_location const &file, boost::uint64_t begin, boost::uint64_t length)
+	{
+		if (length == 0)
+		{
+			return true;
+		}
+
+		// shared with the disk threads because a read can still be running when the session gives up
+		auto const transfer = std::make_shared<file_body_transfer>();
+		transfer->file = open_for_reading(yield, disk, file);
+		if (!transfer->file)
+		{
+			return false;
+		}
+
+		boost::uint64_t const end = begin + length;
+		boost::uint64_t next_read = begin;
+		std::array<pending_result<Si::error_or<std::size_t>>, 2> reads;
+		auto const start_read = [&disk, &transfer, &next_read, end, &reads](std::size_t chunk_index)
+		{
+			std::size_t const size =
+			    static_cast<std::size_t>(std::min<boost::uint64_t>(file_body_chunk_size, end - next_read));
+			transfer->chunks[chunk_index].resize(size);
+			reads[chunk_index] = pending_result<Si::error_or<std::size_t>>();
+			boost::uint64_t const position = next_read;
+			next_read += size;
+			disk.async_run<Si::error_or<std::size_t>>(
+			    [transfer, chunk_index, position]()
+			    {
+				    std::vector<char> &chunk = transfer->chunks[chunk_index];
+				    return read_fully_at(transfer->file->handle, position, chunk.data(), chunk.size());
+				},
+			    reads[chunk_index].completion());
+		};
+
+		std::size_t current = 0;
+		start_read(current);
+		for (;;)
+		{
+			Si::optional<Si::error_or<std::size_t>> const read = yield.get_one(reads[current]);
+			std::vector<char> const &chunk = transfer->chunks[current];
+			if (!read || read->is_error() || (read->get() != chunk.size()))
+			{
+				// the file is unreadable or has become shorter, so the promised length cannot be delivered
+				return false;
+			}
+			bool const is_last = (next_read == end);
+			if (!is_last)
+			{
+				start_read(1 - current);
+			}
+			if (!send(Si::make_memory_range(chunk.data(), chunk.data() + chunk.size())))
+			{
+				return false;
+			}
+			if (is_last)
+			{
+				return true;
+			}
+			current = 1 - current;
+		}
+	}
+
+#ifdef __linux__
+	std::size_t const zero_copy_window_size = 1024 * 1024;
+
+	typedef boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_CORK> tcp_cork;
+
+	//! Holds back partial segments while it exists so that separate writes leave in full packets. The remainder is
+	//! sent when the guard is destroyed.
+	struct tcp_cork_guard
+	{
+		explicit tcp_cork_guard(boost::asio::ip::tcp::socket &socket)
+		    : m_socket(socket)
+		{
+			boost::system::error_code ignored;
+			m_socket.set_option(tcp_cork(true), ignored);
+		}
+
+		~tcp_cork_guard()
+		{
+			boost::system::error_code ignored;
+			m_socket.set_option(tcp_cork(false), ignored);
+		}
+
+		SILICIUM_DELETED_FUNCTION(tcp_cork_guard(tcp_cork_guard const &))
+		SILICIUM_DELETED_FUNCTION(tcp_cork_guard &operator=(tcp_cork_guard const &))
+
+	private:
+		boost::asio::ip::tcp::socket &m_socket;
+	};
+
+	//! Waits until a socket can take more bytes.
+	template <class YieldContext>
+	boost::system::error_code wait_until_writable(YieldContext &yield, boost::asio::ip::tcp::socket &socket)
+	{
+		pending_result<boost::system::error_code> writable;
+		auto const complete = writable.completion();
+		socket.async_write_some(boost::asio::null_buffers(), [complete](boost::system::error_code ec, std::size_t)
+		                        {
+			                        complete(ec);
+			                    });
+		Si::optional<boost::system::error_code> const ec = yield.get_one(writable);
+		if (!ec)
+		{
+			return boost::asio::error::operation_aborted;
+		}
+		return *ec;
+	}
+
+	//! Sends a part of a file with sendfile(2) so that the bytes go from the page cache to the socket without being
+	//! copied through user space. sendfile would block the network thread when the file is not cached, so the disk
+	//! threads read the next window of the file into the page cache while the current window is being sent.
+	//! \return none if the socket or the file system does not support sendfile and nothing has been sent yet
+	template <class YieldContext>
+	Si::optional<bool> send_file_body_zero_copy(YieldContext &yield, boost::asio::ip::tcp::socket &socket,
+	                                            response_pacer const &pace, disk_reader &disk,
+	                                            file_system_location const &file, boost::uint64_t begin,
+	                                            boost::uint64_t length)
+	{
+		std::shared_ptr<Si::file_handle> const opened = open_for_reading(yield, disk, file);
+		if (!opened)
+		{
+			return false;
+		}
+
+		{
+			// sendfile must not block
+			boost::system::error_code ec;
+			socket.native_non_blocking(true, ec);
+			if (ec)
+			{
+				return false;
+			}
+		}
+
+		boost::uint64_t const end = begin + length;
+		boost::uint64_t prefetched_until = begin;
+		pending_result<Si::nothing> prefetching;
+		auto const start_prefetch = [&disk, &opened, end, &prefetched_until, &prefetching]()
+		{
+			if (prefetched_until == end)
+			{
+				return false;
+			}
+			std::size_t const size =
+			    static_cast<std::size_t>(std::min<boost::uint64_t>(zero_copy_window_size, end - prefetched_until));
+			boost::uint64_t const position = prefetched_until;
+			prefetched_until += size;
+			prefetching = pending_result<Si::nothing>();
+			disk.async_run<Si::nothing>(
+			    [opened, position, size]()
+			    {
+				    prefetch_file(opened->handle, position, size);
+				    return Si::nothing();
+				},
+			    prefetching.completion());
+			return true;
+		};
+
+		boost::uint64_t position = begin;
+		bool is_prefetching = start_prefetch();
+		while (position < end)
+		{
+			if (is_prefetching && !yield.get_one(prefetching))
+			{
+				return false;
+			}
+			boost::uint64_t const window_end = prefetched_until;
+			is_prefetching = start_prefetch();
+			pace.expect(window_end - position);
+			while (position < window_end)
+			{
+				Si::error_or<std::size_t> const sent =
+				    send_file_to_socket(socket.native_handle(), opened->handle, position,
+				                        static_cast<std::size_t>(window_end - position));
+				if (sent.is_error())
+				{
+					if ((sent.error() == boost::system::errc::resource_unavailable_try_again) ||
+					    (sent.error() == boost::system::errc::operation_would_block))
+					{
+						if (wait_until_writable(yield, socket))
+						{
+							return false;
+						}
+						continue;
+					}
+					if ((position == begin) && is_zero_copy_unsupported(sent.error()))
+					{
+						return Si::none;
+					}
+					return false;
+				}
+				if (sent.get() == 0)
+				{
+					// the file has become shorter than promised
+					return false;
+				}
+				position += sent.get();
+			}
+		}
+		return true;
+	}
+#endif
+
+#ifdef FILESERVER_HAS_IO_URING
+	//! registered buffers per network thread
+	std::size_t const io_uring_buffer_count = 32;
+
+	//! the number of registered buffers that one transfer fills before it waits for the kernel
+	std::size_t const io_uring_buffers_per_transfer = 4;
+
+	//! Everything that the operations of a transfer refer to. The engine keeps it until the kernel has completed the
+	//! last chain, even when the session gives up on the transfer before that.
+	struct io_uring_transfer
+	{
+		io_uring_buffers buffers;
+		std::shared_ptr<Si::file_handle> file;
+
+		//! a duplicate of the socket, so that the number cannot refer to a connection that is accepted after the
+		//! session has closed its socket
+		Si::file_handle socket;
+
+		std::vector<char> prefix;
+
+		io_uring_transfer(io_uring_engine &engine)
+		    : buffers(engine, io_uring_buffers_per_transfer)
+		{
+		}
+	};
+
+	//! Sends a part of a file with chains of io_uring operations. Every chain reads a few buffers of the file and
+	//! sends each buffer right after it has been filled, all with a single system call. The prefix is sent ahead of
+	//! the file in the first chain.
+	//! \return none if there is no free buffer and nothing has been sent yet
+	template <class YieldContext>
+	Si::optional<bool> send_file_body_io_uring(YieldContext &yield, boost::asio::ip::tcp::socket &socket,
+	                                           response_pacer const &pace, disk_reader &disk, io_uring_engine &engine,
+	                                           file_system_location const &file, Si::memory_range prefix,
+	                                           boost::uint64_t begin, boost::uint64_t length)
+	{
+		auto const transfer = std::make_shared<io_uring_transfer>(engine);
+		if (transfer->buffers.indices().empty())
+		{
+			return Si::none;
+		}
+
+		transfer->socket = Si::file_handle(dup(socket.native_handle()));
+		if (transfer->socket.handle < 0)
+		{
+			return Si::none;
+		}
+
+		transfer->file = open_for_reading(yield, disk, file);
+		if (!transfer->file)
+		{
+			return false;
+		}
+		Si::file_handle const &opened = *transfer->file;
+
+		// the caller's prefix could be gone before the kernel has sent it
+		transfer->prefix.assign(prefix.begin(), prefix.end());
+
+		boost::uint64_t const end = begin + length;
+		boost::uint64_t position = begin;
+		bool is_first_chain = true;
+		do
+		{
+			io_uring_engine::chain operations;
+			boost::uint64_t chain_bytes = 0;
+			if (is_first_chain && !transfer->prefix.empty())
+			{
+				operations.send(transfer->socket.handle,
+				                Si::make_memory_range(transfer->prefix.data(),
+				                                      transfer->prefix.data() + transfer->prefix.size()));
+				chain_bytes += static_cast<boost::uint64_t>(transfer->prefix.size());
+			}
+			is_first_chain = false;
+			for (unsigned buffer : transfer->buffers.indices())
+			{
+				if (position == end)
+				{
+					break;
+				}
+				std::size_t const size = static_cast<std::size_t>(
+				    std::min<boost::uint64_t>(io_uring_engine::buffer_size, end - position));
+				operations.read(opened.handle, position, buffer, size);
+				operations.send(transfer->socket.handle, Si::make_memory_range(engine.get_buffer(buffer),
+				                                                                     engine.get_buffer(buffer) + size));
+				position += size;
+				chain_bytes += size;
+			}
+			if (operations.empty())
+			{
+				break;
+			}
+			pace.expect(chain_bytes);
+			pending_result<boost::system::error_code> completed;
+			engine.start(operations, transfer, completed.completion());
+			Si::optional<boost::system::error_code> const ec = yield.get_one(completed);
+			if (!ec || *ec)
+			{
+				return false;
+			}
+		} while (position < end);
+		return true;
+	}
+#endif
+
+	//! Writes all of the buffers. asio hands a buffer sequence to writev, so they usually leave with a single system
+	//! call.
+	template <class YieldContext, class ConstBufferSequence>
+	bool send_buffers(YieldContext &yield, boost::asio::ip::tcp::socket &socket, ConstBufferSequence const &buffers)
+	{
+		pending_result<boost::system::error_code> written;
+		auto const complete = written.completion();
+		boost::asio::async_write(socket, buffers, [complete](boost::system::error_code ec, std::size_t)
+		                         {
+			                         complete(ec);
+			                     });
+		Si::optional<boost::system::error_code> const ec = yield.get_one(written);
+		return ec && !*ec;
+	}
+
+	Si::memory_range as_memory_range(std::vector<char> const &bytes)
+	{
+		return Si::make_memory_range(bytes.data(), bytes.data() + bytes.size());
+	}
+
+	//! A request header has to fit into this many bytes.
+	std::size_t const max_request_header_size = 8 * 1024;
+
+	//! Everything a connection needs besides its coroutine. It is recycled for later connections, so the socket, the
+	//! timer and the buffers are only created once and the coroutine stacks stay small.
+	struct session
+	{
+		std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+		socket_deadline<boost::asio::ip::tcp::socket> deadline;
+		std::array<char, max_request_header_size> request_buffer;
+		std::vector<char> header_buffer;
+
+		explicit session(boost::asio::io_service &io)
+		    : socket(std::make_shared<boost::asio::ip::tcp::socket>(io))
+		    , deadline(socket)
+		{
+		}
+	};
+
+	//! \return true if the complete response has been sent and the connection can be used for another request
+	template <class YieldContext>
+	bool respond(YieldContext &yield, session &client, request_header const &header, bool keep_alive,
+	             serve_options const &options, disk_reader &disk, file_repository const &repository,
+	             name_tree const &root)
+	{
+		boost::asio::ip::tcp::socket &socket = *client.socket;
+		std::vector<char> &header_buffer = client.header_buffer;
+
+		// A response header is not written on its own, but together with the beginning of the body. That way a small
+		// response needs a single system call and leaves in a single packet.
+		Si::memory_range unsent_header;
+		auto const send_range = [&yield, &socket, &unsent_header](Si::memory_range data)
+		{
+			if (unsent_header.empty() && data.empty())
+			{
+				return true;
+			}
+			std::array<boost::asio::const_buffer, 2> const buffers = {
+			    {boost::asio::buffer(unsent_header.begin(), static_cast<std::size_t>(unsent_header.size())),
+			     boost::asio::buffer(data.begin(), static_cast<std::size_t>(data.size()))}};
+			unsent_header = Si::memory_range();
+			return send_buffers(yield, socket, buffers);
+		};
+		auto const send_unsent_header = [&send_range]()
+		{
+			return send_range(Si::memory_range());
+		};
+		auto const try_send = [&send_range](std::vector<char> const &data)
+		{
+			return send_range(as_memory_range(data));
+		};
+
+		if (boost::range::equal(header.target, boost::as_literal("/stats")))
+		{
+			std::string const body = format_statistics(disk);
+			Si::http::response response = make_response_header(200, "OK", keep_alive);
+			(*response.arguments)["Content-Type"] = "text/plain";
+			(*response.arguments)["Cache-Control"] = "no-store";
+			(*response.arguments)["Content-Length"] = boost::lexical_cast<Si::noexcept_string>(body.size());
+			header_buffer = serialize_response(response);
+			unsent_header = as_memory_range(header_buffer);
+			if (determine_request_type(header.method) == request_type::head)
+			{
+				return send_unsent_header();
+			}
+			return send_range(Si::make_memory_range(body.data(), body.data() + body.size()));
+		}
+
+		auto const request = parse_request_target(header.target);
+		if (!request)
+		{
+			return send_range(not_found_response(keep_alive));
+		}
+		if (Si::try_get_ptr<browse_request>(*request))
+		{
+			// there is no human readable listing yet, but the connection can still be used for other requests
+			return send_range(not_implemented_response(keep_alive));
+		}
+
+		any_reference const &reference = Si::visit<any_reference const &>(*request,
+		                                                                  [](get_request const &request)
+		                                                                      -> any_reference const &
+		                                                                  {
+			                                                                  return request.what;
+			                                                              },
+		                                                                  [](browse_request const &request)
+		                                                                      -> any_reference const &
+		                                                                  {
+			                                                                  return request.what;
+			                                                              });
+		sha256_digest const *const requested_digest = Si::visit<sha256_digest const *>(
+		    reference,
+		    [](sha256_digest const &digest)
+		    {
+			    return &digest;
+			},
+		    [&root](Si::memory_range const &name) -> sha256_digest const *
+		    {
+			    name_tree const *const resolved = resolve_name(root, name);
+			    if (!resolved)
+			    {
+				    return nullptr;
+			    }
+			    return Si::visit<sha256_digest const *>(resolved->reference.referenced,
+			                                            [](sha256_digest const &digest)
+			                                            {
+				                                            return &digest;
+				                                        });
+			});
+		if (!requested_digest)
+		{
+			return send_range(not_found_response(keep_alive));
+		}
+		repository_entry const *const found_entry = repository.find_entry(*requested_digest);
+		if (!found_entry)
+		{
+			return send_range(not_found_response(keep_alive));
+		}
+		assert(!found_entry->locations.empty());
+
+		// just try the first entry for now
+		auto &found_file = found_entry->locations[0];
+		boost::uint64_t const size = location_file_size(found_file);
+		request_type const type = determine_request_type(header.method);
+		bool const is_get_request = Si::visit<bool>(*request,
+		                                            [](get_request const &)
+		                                            {
+			                                            return true;
+			                                        },
+		                                            [](browse_request const &)
+		                                            {
+			                                            return false;
+			                                        });
+
+		// The digest is only a validator for the content itself, not for a listing of it.
+		// A name can refer to different content over time, so only hash references may be cached forever.
+		std::string const &entity_tag = found_entry->headers.entity_tag;
+		bool const is_immutable = is_get_request && Si::visit<bool>(reference,
+		                                                             [](sha256_digest const &)
+		                                                             {
+			                                                             return true;
+			                                                         },
+		                                                             [](Si::memory_range const &)
+		                                                             {
+			                                                             return false;
+			                                                         });
+		auto const add_validators = [&entity_tag, is_get_request, is_immutable](Si::http::response &response)
+		{
+			if (is_get_request)
+			{
+				(*response.arguments)["ETag"] = entity_tag.c_str();
+			}
+			if (is_immutable)
+			{
+				(*response.arguments)["Cache-Control"] = immutable_cache_control;
+			}
+		};
+
+		if (is_get_request)
+		{
+			if (header.if_none_match &&
+			    is_entity_tag_listed(*header.if_none_match, entity_tag, entity_tag_comparison::weak))
+			{
+				// the client already has the content, so there is no need to touch the file
+				serialize_not_modified_header(header_buffer, found_entry->headers, is_immutable, keep_alive);
+				return try_send(header_buffer);
+			}
+		}
+
+		std::vector<byte_range> ranges;
+		if ((type == request_type::get) && is_get_request)
+		{
+			// If-Range with anything but our strong tag asks for the complete content
+			if (header.range && (!header.if_range ||
+			                     is_entity_tag_listed(*header.if_range, entity_tag, entity_tag_comparison::strong)))
+			{
+				Si::optional<std::vector<byte_range>> parsed = parse_range_header(*header.range, size);
+				if (parsed)
+				{
+					if (parsed->empty())
+					{
+						Si::http::response response = make_response_header(416, "Range Not Satisfiable", keep_alive);
+						add_validators(response);
+						(*response.arguments)["Content-Length"] = "0";
+						(*response.arguments)["Content-Range"] = format_unsatisfied_content_range(size).c_str();
+						return try_send(serialize_response(response));
+					}
+					ranges = std::move(*parsed);
+				}
+			}
+		}
+
+		file_system_location const *const on_disk = Si::visit<file_system_location const *>(
+		    found_file,
+		    [](file_system_location const &file)
+		    {
+			    return &file;
+			},
+		    [](in_memory_location const &) -> file_system_location const *
+		    {
+			    return nullptr;
+			});
+
+		// popular small files are sent from memory without touching the disk
+		bool const is_cacheable = (type == request_type::get) && on_disk && disk.caches.blobs.admits(on_disk->size);
+		std::shared_ptr<std::vector<char> const> cached_content;
+		if (is_cacheable)
+		{
+			cached_content = disk.caches.blobs.find(*requested_digest);
+		}
+
+		if ((type == request_type::get) && on_disk && !cached_content && disk.reject_if_busy())
+		{
+			// waiting behind a long disk queue would take longer than asking again later
+			return send_range(service_unavailable_response(keep_alive));
+		}
+
+		if (is_cacheable && !cached_content)
+		{
+			cached_content = load_blob(yield, disk, *on_disk);
+			if (cached_content)
+			{
+				disk.caches.blobs.insert(*requested_digest, cached_content);
+			}
+		}
+
+		if ((type == request_type::get) && on_disk && !cached_content && !open_for_reading(yield, disk, *on_disk))
+		{
+			// A file that has changed since it was hashed is unavailable until the watcher has published the tree with
+			// its new digest. This is decided before the status is sent, and the handle stays cached for the body.
+			return send_range(service_unavailable_response(keep_alive));
+		}
+
+		// the content can never contain its own digest, so the digest is a safe multipart boundary
+		std::string boundary;
+		if (ranges.size() > 1)
+		{
+			encode_ascii_hex_digits(requested_digest->bytes.begin(), requested_digest->bytes.end(),
+			                        std::back_inserter(boundary));
+		}
+		boost::uint64_t content_length = size;
+		if (is_get_request && ranges.empty())
+		{
+			// the common case does not need to build a header from scratch
+			serialize_ok_header(header_buffer, found_entry->headers, is_immutable, keep_alive);
+		}
+		else
+		{
+			Si::http::response response =
+			    ranges.empty() ? make_response_header(200, "OK", keep_alive)
+			                   : make_response_header(206, "Partial Content", keep_alive);
+			(*response.arguments)["Accept-Ranges"] = "bytes";
+			add_validators(response);
+			if (ranges.size() == 1)
+			{
+				content_length = ranges.front().length;
+				(*response.arguments)["Content-Range"] = format_content_range(ranges.front(), size).c_str();
+			}
+			else if (ranges.size() > 1)
+			{
+				content_length = format_byte_range_end(boundary).size();
+				for (byte_range const &range : ranges)
+				{
+					content_length += format_byte_range_part_header(boundary, range, size).size() + range.length;
+				}
+				(*response.arguments)["Content-Type"] = ("multipart/byteranges; boundary=" + boundary).c_str();
+			}
+			(*response.arguments)["Content-Length"] = boost::lexical_cast<Si::noexcept_string>(content_length);
+
+			header_buffer = serialize_response(response);
+		}
+		unsent_header = as_memory_range(header_buffer);
+
+		if (type == request_type::head)
+		{
+			return send_unsent_header();
+		}
+
+		// A client that stops reading must not hold on to the session for as long as the body would take, so every
+		// part of the body gets its own time limit.
+		response_pacer const pace(client.deadline, options.min_send_rate, options.send_timeout);
+		auto const send_paced_range = [&pace, &send_range, &unsent_header](Si::memory_range data)
+		{
+			pace.expect(static_cast<boost::uint64_t>(unsent_header.size()) + static_cast<boost::uint64_t>(data.size()));
+			return send_range(data);
+		};
+
+		auto const send_shared_content = [&send_paced_range](std::vector<char> const &content,
+		                                                     byte_range const &range)
+		{
+			char const *const begin = content.data() + static_cast<std::size_t>(range.begin);
+			return send_paced_range(Si::make_memory_range(begin, begin + static_cast<std::size_t>(range.length)));
+		};
+		auto const send_body_range = [&](byte_range const &range)
+		{
+			if (cached_content)
+			{
+				return send_shared_content(*cached_content, range);
+			}
+			return Si::visit<bool>(
+			    found_file,
+			    [&](file_system_location const &location)
+			    {
+#ifndef _WIN32
+				    if (disk.caches.is_mapping_enabled)
+				    {
+					    // The socket reads the pages of the mapping directly. If the file is truncated in the
+					    // meantime, the send fails with EFAULT and the session ends like after any other error.
+					    std::shared_ptr<file_mapping> const mapping = map_for_sending(yield, disk, location);
+					    if (mapping)
+					    {
+						    return send_mapped_range(yield, send_paced_range, disk, mapping,
+						                             static_cast<std::size_t>(range.begin),
+						                             static_cast<std::size_t>(range.length));
+					    }
+				    }
+#endif
+#ifdef __linux__
+				    if (options.zero_copy)
+				    {
+					    // The header has to be written before sendfile can start. The cork holds it back until it can
+					    // leave together with the beginning of the file.
+					    tcp_cork_guard const corked(socket);
+					    if (!send_paced_range(Si::memory_range()))
+					    {
+						    return false;
+					    }
+					    Si::optional<bool> const sent = send_file_body_zero_copy(
+					        yield, socket, pace, disk, location, range.begin, range.length);
+					    if (sent)
+					    {
+						    return *sent;
+					    }
+				    }
+#else
+				    boost::ignore_unused_variable_warning(options);
+#endif
+#ifdef FILESERVER_HAS_IO_URING
+				    // for when sendfile is disabled or the file system does not support it
+				    if (disk.uring)
+				    {
+					    Si::optional<bool> const sent =
+					        send_file_body_io_uring(yield, socket, pace, disk, *disk.uring, location,
+					                                unsent_header, range.begin, range.length);
+					    if (sent)
+					    {
+						    unsent_header = Si::memory_range();
+						    return *sent;
+					    }
+				    }
+#endif
+				    return send_file_body(yield, send_paced_range, disk, location, range.begin, range.length);
+				},
+			    [&](in_memory_location const &location)
+			    {
+				    // the socket writes directly from the shared content which this reference keeps alive
+				    std::shared_ptr<std::vector<char> const> const content = location.content;
+				    return send_shared_content(*content, range);
+				});
+		};
+		auto const send_string = [&send_paced_range](std::string const &data)
+		{
+			return send_paced_range(Si::make_memory_range(data.data(), data.data() + data.size()));
+		};
 
-	struct get_request
-	{
-		any_reference what;
-	};
+		bool const body_sent = Si::visit<bool>(
+		    *request,
+		    [&](get_request const &)
+		    {
+			    if (ranges.empty())
+			    {
+				    return send_body_range(byte_range{0, size});
+			    }
+			    if (ranges.size() == 1)
+			    {
+				    return send_body_range(ranges.front());
+			    }
+			    for (byte_range const &range : ranges)
+			    {
+				    if (!send_string(format_byte_range_part_header(boundary, range, size)) || !send_body_range(range))
+				    {
+					    return false;
+				    }
+			    }
+			    return send_string(format_byte_range_end(boundary));
+			},
+		    [](browse_request const &) -> bool
+		    {
+			    // answered before anything else
+			    SILICIUM_UNREACHABLE();
+			});
+		// an empty file does not send anything, so the header may still be waiting
+		return body_sent && send_paced_range(Si::memory_range());
+	}
 
-	struct browse_request
+	//! \return 0 if the connection has been closed or has failed
+	template <class YieldContext>
+	std::size_t receive_some(YieldContext &yield, boost::asio::ip::tcp::socket &socket, char *buffer,
+	                         std::size_t size)
 	{
-		any_reference what;
-	};
-
-	typedef Si::variant<browse_request, get_request> parsed_request;
+		pending_result<std::pair<boost::system::error_code, std::size_t>> received;
+		auto const complete = received.completion();
+		socket.async_read_some(boost::asio::buffer(buffer, size),
+		                       [complete](boost::system::error_code ec, std::size_t bytes)
+		                       {
+			                       complete(std::make_pair(ec, bytes));
+			                   });
+		Si::optional<std::pair<boost::system::error_code, std::size_t>> const result = yield.get_one(received);
+		if (!result || result->first)
+		{
+			return 0;
+		}
+		return result->second;
+	}
 
-	template <class PathElementRange>
-	Si::optional<any_reference> parse_any_reference(PathElementRange const &path)
+	//! Sends a response whose body consists of repository entries, each preceded by a line from format_header. The
+	//! length of the whole body is announced up front because every size is known from the scan.
+	//! \param entries nullptr for an unknown digest, which only gets its line
+	//! \param format_header called with the index of an entry and its size (none if it is unknown)
+	//! \return true if the complete response has been sent
+	template <class YieldContext, class HeaderFormatter>
+	bool send_entry_stream(YieldContext &yield, session &client, Si::http::response response,
+	                       std::vector<sha256_digest> const &digests,
+	                       std::vector<repository_entry const *> const &entries, serve_options const &options,
+	                       disk_reader &disk, HeaderFormatter const &format_header)
 	{
-		if (path.empty())
+		assert(digests.size() == entries.size());
+		boost::asio::ip::tcp::socket &socket = *client.socket;
+		auto const entry_size = [&entries](std::size_t index) -> Si::optional<boost::uint64_t>
+		{
+			if (!entries[index])
+			{
+				return Si::none;
+			}
+			assert(!entries[index]->locations.empty());
+			return location_file_size(entries[index]->locations[0]);
+		};
+		boost::uint64_t content_length = 0;
+		for (std::size_t i = 0; i < entries.size(); ++i)
 		{
-			return any_reference{Si::noexcept_string{}};
+			Si::optional<boost::uint64_t> const size = entry_size(i);
+			content_length += format_header(i, size).size() + (size ? *size : 0);
 		}
-		if (boost::range::equal(path.front(), Si::make_c_str_range("name")))
+		(*response.arguments)["Content-Length"] = boost::lexical_cast<Si::noexcept_string>(content_length);
+
+		// every write gets its own time limit like the parts of a single file
+		response_pacer const pace(client.deadline, options.min_send_rate, options.send_timeout);
+
+		// Small blobs and the lines between them are collected, so that a tree of tiny files does not need a system
+		// call for every piece.
+		std::vector<char> &pending = client.header_buffer;
+		pending = serialize_response(response);
+		auto const flush = [&yield, &socket, &pending, &pace]() -> bool
 		{
-			auto name_begin = path.begin() + 1;
-			if (name_begin == path.end())
+			if (pending.empty())
 			{
-				return any_reference{Si::noexcept_string{}};
+				return true;
 			}
-			return any_reference{Si::noexcept_string(name_begin->begin(), name_begin->end())};
-		}
-		if (boost::range::equal(path.front(), Si::make_c_str_range("hash")))
+			pace.expect(pending.size());
+			bool const sent = send_buffers(yield, socket, boost::asio::buffer(pending));
+			pending.clear();
+			return sent;
+		};
+		auto const send_range = [&yield, &socket, &pending, &flush, &pace](Si::memory_range data) -> bool
 		{
-			auto hash_begin = path.begin() + 1;
-			if (hash_begin == path.end())
+			std::size_t const size = static_cast<std::size_t>(data.size());
+			if ((pending.size() + size) > file_body_chunk_size)
 			{
-				return Si::none;
+				if (!flush())
+				{
+					return false;
+				}
+				if (size >= file_body_chunk_size)
+				{
+					pace.expect(size);
+					return send_buffers(yield, socket, boost::asio::buffer(data.begin(), size));
+				}
+			}
+			pending.insert(pending.end(), data.begin(), data.end());
+			return true;
+		};
+
+		for (std::size_t i = 0; i < digests.size(); ++i)
+		{
+			std::string const item_header = format_header(i, entry_size(i));
+			if (!send_range(Si::make_memory_range(item_header.data(), item_header.data() + item_header.size())))
+			{
+				return false;
 			}
-			auto digest = parse_digest(*hash_begin);
-			if (!digest)
+			repository_entry const *const entry = entries[i];
+			if (!entry)
 			{
-				return Si::none;
+				continue;
+			}
+			bool const sent = Si::visit<bool>(
+			    entry->locations[0],
+			    [&](file_system_location const &location)
+			    {
+				    if (location.size == 0)
+				    {
+					    return true;
+				    }
+				    // The status has been sent already, so a stream that would queue behind a full disk is cut short.
+				    // The client sees fewer bytes than the Content-Length and can ask for the rest later.
+				    std::shared_ptr<std::vector<char> const> content;
+				    if (disk.caches.blobs.admits(location.size))
+				    {
+					    content = disk.caches.blobs.find(digests[i]);
+					    if (!content)
+					    {
+						    if (disk.reject_if_busy())
+						    {
+							    return false;
+						    }
+						    content = load_blob(yield, disk, location);
+						    if (!content)
+						    {
+							    return false;
+						    }
+						    disk.caches.blobs.insert(digests[i], content);
+					    }
+					    return send_range(as_memory_range(*content));
+				    }
+				    if (disk.reject_if_busy())
+				    {
+					    return false;
+				    }
+				    return send_file_body(yield, send_range, disk, location, 0, location.size);
+				},
+			    [&](in_memory_location const &location)
+			    {
+				    return send_range(as_memory_range(*location.content));
+				});
+			if (!sent)
+			{
+				return false;
 			}
-			return any_reference{std::move(*digest)};
 		}
-		return Si::none;
+		return flush();
 	}
 
-	Si::optional<parsed_request> parse_request_path(Si::memory_range const &path)
+	//! Sends the blobs requested by a POST to /batch one after another, so that a client can fetch many small files
+	//! with a single round trip. The connection is not kept alive afterwards because the request has a body.
+	//! \param received_body the beginning of the body which has been received together with the header
+	template <class YieldContext>
+	void respond_batch(YieldContext &yield, session &client, request_header const &header,
+	                   Si::memory_range received_body, serve_options const &options, disk_reader &disk,
+	                   file_repository const &repository)
 	{
-		Si::optional<Si::http::uri> const parsed_path = Si::http::parse_uri(path);
-		if (!parsed_path || parsed_path->path.empty())
+		boost::asio::ip::tcp::socket &socket = *client.socket;
+		auto const send_error = [&yield, &socket](Si::memory_range response)
 		{
-			return Si::none;
+			send_buffers(yield, socket,
+			             boost::asio::buffer(response.begin(), static_cast<std::size_t>(response.size())));
+		};
+		if (!header.content_length || header.transfer_encoding)
+		{
+			return send_error(length_required_response());
 		}
-
-		if (boost::range::equal(parsed_path->path.front(), Si::make_c_str_range("browse")))
+		std::size_t body_size = 0;
+		Si::memory_range const content_length_text = *header.content_length;
+		if (!boost::conversion::try_lexical_convert(content_length_text.begin(),
+		                                            static_cast<std::size_t>(content_length_text.size()), body_size))
 		{
-			Si::optional<any_reference> ref =
-			    parse_any_reference(Si::make_iterator_range(parsed_path->path.begin() + 1, parsed_path->path.end()));
-			if (!ref)
-			{
-				return Si::none;
-			}
-			return parsed_request{browse_request{std::move(*ref)}};
+			return send_error(bad_request_response());
+		}
+		if (body_size > max_batch_request_size)
+		{
+			return send_error(payload_too_large_response());
 		}
 
-		if (boost::range::equal(parsed_path->path.front(), Si::make_c_str_range("get")))
+		std::size_t received = std::min(static_cast<std::size_t>(received_body.size()), body_size);
+		std::vector<char> body(received_body.begin(), received_body.begin() + received);
+		body.resize(body_size);
+		while (received < body_size)
 		{
-			Si::optional<any_reference> ref =
-			    parse_any_reference(Si::make_iterator_range(parsed_path->path.begin() + 1, parsed_path->path.end()));
-			if (!ref)
+			std::size_t const piece = receive_some(yield, socket, body.data() + received, body_size - received);
+			if (piece == 0)
 			{
-				return Si::none;
+				return;
 			}
-			return parsed_request{get_request{std::move(*ref)}};
+			received += piece;
+		}
+		std::vector<sha256_digest> digests;
+		if (!parse_batch_request(as_memory_range(body), digests))
+		{
+			return send_error(bad_request_response());
+		}
+		if (disk.reject_if_busy())
+		{
+			return send_error(service_unavailable_response(false));
 		}
 
-		return Si::none;
+		std::vector<repository_entry const *> entries;
+		for (sha256_digest const &digest : digests)
+		{
+			entries.emplace_back(repository.find_entry(digest));
+		}
+		Si::http::response response = make_response_header(200, "OK", false);
+		(*response.arguments)["Content-Type"] = batch_content_type;
+		send_entry_stream(yield, client, std::move(response), digests, entries, options, disk,
+		                  [&digests](std::size_t index, Si::optional<boost::uint64_t> size)
+		                  {
+			                  return format_batch_item_header(digests[index], size);
+			              });
 	}
 
-	Si::http::response make_not_found_response()
+	//! Sends a directory with everything below it as a pack, so that cloning a large tree is limited by the bandwidth
+	//! and not by the latency of the connection.
+	//! \return true if the complete response has been sent
+	template <class YieldContext>
+	bool respond_pack(YieldContext &yield, session &client, sha256_digest const &requested, bool keep_alive,
+	                  serve_options const &options, disk_reader &disk, file_repository const &repository,
+	                  directory_index const &directories)
 	{
-		Si::http::response header;
-		header.http_version = "HTTP/1.0";
-		header.status = 404;
-		header.status_text = "Not Found";
-		header.arguments = Si::make_unique<Si::http::response::arguments_table>();
-		(*header.arguments)["Connection"] = "close";
-		return header;
-	}
+		boost::asio::ip::tcp::socket &socket = *client.socket;
+		auto const send_error = [&yield, &socket](Si::memory_range response)
+		{
+			return send_buffers(yield, socket,
+			                    boost::asio::buffer(response.begin(), static_cast<std::size_t>(response.size())));
+		};
+		name_tree const *const directory = find_directory(directories, requested);
+		if (!directory)
+		{
+			return send_error(not_found_response(keep_alive));
+		}
+		if (disk.reject_if_busy())
+		{
+			return send_error(service_unavailable_response(keep_alive));
+		}
 
-	std::vector<char> serialize_response(Si::http::response const &header)
-	{
-		std::vector<char> serialized;
-		auto sink = Si::make_container_sink(serialized);
-		Si::http::generate_response(sink, header);
-		return serialized;
+		std::vector<typed_reference const *> const objects = plan_pack(*directory);
+		std::vector<sha256_digest> digests;
+		std::vector<repository_entry const *> entries;
+		digests.reserve(objects.size());
+		entries.reserve(objects.size());
+		for (typed_reference const *object : objects)
+		{
+			digests.emplace_back(detail::get_sha256_digest(*object));
+			repository_entry const *const entry = repository.find_entry(digests.back());
+			if (!entry)
+			{
+				// a pack with a hole in it would be useless to the client
+				return send_error(not_found_response(keep_alive));
+			}
+			entries.emplace_back(entry);
+		}
+		Si::http::response response = make_response_header(200, "OK", keep_alive);
+		(*response.arguments)["Content-Type"] = pack_content_type;
+		return send_entry_stream(yield, client, std::move(response), digests, entries, options, disk,
+		                         [&objects](std::size_t index, Si::optional<boost::uint64_t> size)
+		                         {
+			                         assert(size);
+			                         return format_pack_object_header(*objects[index], *size);
+			                     });
 	}
 
-	enum class request_type
+	//! What is being served. A change of the directory publishes a new snapshot instead of changing the current one,
+	//! so a request sees either the old or the new tree but never a mix of both.
+	struct served_tree
 	{
-		get,
-		head
+		file_repository files;
+		name_tree root;
+
+		//! refers into root, so a served_tree must not be copied
+		directory_index directories;
 	};
 
-	template <class String>
-	request_type determine_request_type(String const &method)
+	std::shared_ptr<served_tree> make_served_tree(file_repository files, name_tree root)
 	{
-		if (boost::algorithm::iequals("HEAD", method))
-		{
-			return request_type::head;
-		}
-		else
-		{
-			return request_type::get;
-		}
+		auto made = std::make_shared<served_tree>(served_tree{std::move(files), std::move(root), directory_index()});
+		// indexed here and not on the network threads, where every pack request would have to search the tree
+		made->directories = index_directories(made->root);
+		return made;
 	}
 
-	template <class YieldContext, class MakeSender>
-	void respond(YieldContext &yield, MakeSender const &make_sender, Si::http::request const &header,
-	             file_repository const &repository, digest const &root)
+	struct published_tree
 	{
-		auto const try_send = [&yield, &make_sender](std::vector<char> const &data)
+		explicit published_tree(std::shared_ptr<served_tree const> initial)
+		    : m_current(std::move(initial))
 		{
-			char const *const begin = data.data();
-			auto sender = make_sender(Si::make_memory_range(begin, begin + data.size()));
-			Si::optional<boost::system::error_code> result = yield.get_one(sender);
-			assert(result);
-			return !*result;
-		};
+		}
 
-		auto const request = parse_request_path(Si::make_memory_range(header.path));
-		if (!request)
+		std::shared_ptr<served_tree const> get() const
 		{
-			try_send(serialize_response(make_not_found_response()));
-			return;
-		}
-
-		std::vector<location> const *const found_file_locations = repository.find_location(Si::visit<unknown_digest>(
-		    Si::visit<any_reference const &>(*request,
-		                                     [](get_request const &request) -> any_reference const &
-		                                     {
-			                                     return request.what;
-			                                 },
-		                                     [](browse_request const &request) -> any_reference const &
-		                                     {
-			                                     return request.what;
-			                                 }),
-		    [](unknown_digest const &digest)
-		    {
-			    return digest;
-			},
-		    [&root](Si::noexcept_string const &name)
-		    {
-			    // TODO: resolve the name
-			    boost::ignore_unused_variable_warning(name);
-			    return to_unknown_digest(root);
-			}));
-		if (!found_file_locations)
+			return std::atomic_load(&m_current);
+		}
+
+		void publish(std::shared_ptr<served_tree const> next)
 		{
-			try_send(serialize_response(make_not_found_response()));
-			return;
+			std::atomic_store(&m_current, std::move(next));
 		}
-		assert(!found_file_locations->empty());
 
-		// just try the first entry for now
-		auto &found_file = (*found_file_locations)[0];
+	private:
+		std::shared_ptr<served_tree const> m_current;
+	};
 
+	template <class YieldContext>
+	void serve_client(YieldContext &yield, session &client, serve_options const &options, disk_reader &disk,
+	                  published_tree const &tree)
+	{
+		boost::asio::ip::tcp::socket &socket = *client.socket;
+		socket_deadline<boost::asio::ip::tcp::socket> &deadline = client.deadline;
+		// The header is parsed where it has been received, so a request does not allocate anything before the
+		// response.
+		std::array<char, max_request_header_size> &request_buffer = client.request_buffer;
+		std::size_t buffered = 0;
+		for (;;)
 		{
-			Si::http::response response;
-			response.arguments = Si::make_unique<std::map<Si::noexcept_string, Si::noexcept_string>>();
-			response.http_version = "HTTP/1.0";
-			response.status_text = "OK";
-			response.status = 200;
-			(*response.arguments)["Content-Length"] =
-			    boost::lexical_cast<Si::noexcept_string>(location_file_size(found_file));
-			(*response.arguments)["Connection"] = "close";
+			// An idle client does not get to keep its connection forever. Once a request has begun, the complete
+			// header has to arrive in time, so a client cannot hold on to the session by sending it very slowly.
+			deadline.expires_from_now((buffered == 0) ? options.keep_alive_timeout : options.header_timeout);
+			request_parse_result parsed =
+			    parse_request_header(Si::make_memory_range(request_buffer.data(), request_buffer.data() + buffered));
+			while ((parsed.status == request_parse_status::incomplete) && (buffered < request_buffer.size()))
+			{
+				std::size_t const received =
+				    receive_some(yield, socket, request_buffer.data() + buffered, request_buffer.size() - buffered);
+				if (received == 0)
+				{
+					break;
+				}
+				if (buffered == 0)
+				{
+					deadline.expires_from_now(options.header_timeout);
+				}
+				buffered += received;
+				parsed = parse_request_header(
+				    Si::make_memory_range(request_buffer.data(), request_buffer.data() + buffered));
+			}
+			if ((parsed.status == request_parse_status::incomplete) && (buffered < request_buffer.size()))
+			{
+				// closed by the client or by the deadline
+				break;
+			}
 
-			std::vector<char> response_header = serialize_response(response);
-			if (!try_send(response_header))
+			// a small response has to be sent within this time, larger ones get more time in respond
+			deadline.expires_from_now(options.send_timeout);
+			if (parsed.status != request_parse_status::complete)
 			{
-				return;
+				Si::memory_range const error_response = (parsed.status == request_parse_status::malformed)
+				                                            ? bad_request_response()
+				                                            : header_too_large_response();
+				send_buffers(yield, socket, boost::asio::buffer(error_response.begin(),
+				                                                static_cast<std::size_t>(error_response.size())));
+				break;
 			}
-		}
 
-		switch (determine_request_type(header.method))
-		{
-		case request_type::get:
-		{
-			Si::visit<void>(*request,
-			                [&try_send, &found_file, &yield](get_request const &)
-			                {
-				                auto reading = Si::make_thread_generator<std::vector<char>, Si::std_threading>(
-				                    [&](Si::push_context<std::vector<char>> &yield) -> Si::nothing
-				                    {
-					                    yield(Si::visit<std::vector<char>>(found_file,
-					                                                       [](file_system_location const &location)
-					                                                       {
-						                                                       return ventura::read_file(location.where)
-						                                                           .get();
-						                                                   },
-					                                                       [](in_memory_location const &location)
-					                                                       {
-						                                                       return location.content;
-						                                                   }));
-					                    return {};
-					                });
-				                Si::optional<std::vector<char>> const &body = yield.get_one(Si::ref(reading));
-				                if (!body)
-				                {
-					                return;
-				                }
+			// The response may refer to the repository until it has been sent, so the snapshot is kept alive even if
+			// a newer one is published meanwhile.
+			std::shared_ptr<served_tree const> const snapshot = tree.get();
+			file_repository const &repository = snapshot->files;
+			name_tree const &root = snapshot->root;
+
+			if (boost::range::equal(parsed.header.method, boost::as_literal("POST")) &&
+			    boost::range::equal(parsed.header.target, boost::as_literal(batch_request_target)))
+			{
+				respond_batch(yield, client, parsed.header,
+				              Si::make_memory_range(request_buffer.data() + parsed.length,
+				                                    request_buffer.data() + buffered),
+				              options, disk, repository);
+				break;
+			}
 
-				                if (body->size() != location_file_size(found_file))
-				                {
-					                return;
-				                }
+			bool const keep_alive = is_persistent_connection(parsed.header);
+			Si::optional<sha256_digest> const packed =
+			    boost::range::equal(parsed.header.method, boost::as_literal("GET"))
+			        ? parse_pack_target(parsed.header.target)
+			        : Si::none;
+			bool const is_responded =
+			    packed ? respond_pack(yield, client, *packed, keep_alive, options, disk, repository,
+			                          snapshot->directories)
+			           : respond(yield, client, parsed.header, keep_alive, options, disk, repository, root);
+			deadline.cancel();
+			if (!is_responded || !keep_alive)
+			{
+				break;
+			}
 
-				                try_send(*body);
-				            },
-			                [](browse_request const &)
-			                {
-				                // TODO
-				            });
-			break;
+			// pipelined requests may already be in the buffer
+			std::copy(request_buffer.data() + parsed.length, request_buffer.data() + buffered, request_buffer.data());
+			buffered -= parsed.length;
 		}
 
-		case request_type::head:
+		if (deadline.has_expired())
 		{
-			break;
-		}
+			disk.admission.count_timeout();
 		}
-	}
 
-	template <class YieldContext, class ReceiveObservable, class MakeSender, class Shutdown>
-	void serve_client(YieldContext &yield, ReceiveObservable &receive, MakeSender const &make_sender,
-	                  Shutdown const &shutdown, file_repository const &repository, digest const &root)
-	{
-		auto receive_sync = Si::virtualize_source(Si::make_observable_source(Si::ref(receive), yield));
-		Si::received_from_socket_source receive_bytes(receive_sync);
-		auto header = Si::http::parse_request(receive_bytes);
-		if (!header)
+		// Closing a socket with unread data would reset the connection, which can destroy the end of the response
+		// before the client has read it. Whatever the client still sends is discarded until it closes its side.
+		boost::system::error_code ignored;
+		socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ignored);
+		deadline.expires_from_now(options.linger_timeout);
+		while (receive_some(yield, socket, request_buffer.data(), request_buffer.size()) > 0)
 		{
-			return;
 		}
+		deadline.cancel();
+	}
+
+	// TODO: use unique_observable
+	using session_handle = Si::shared_observable<Si::nothing>;
 
-		respond(yield, make_sender, *header, repository, root);
-		shutdown();
+#ifdef SO_REUSEPORT
+	typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
 
-		while (Si::get(receive_bytes))
+	void open_listener(boost::asio::ip::tcp::acceptor &acceptor, boost::asio::ip::tcp::endpoint const &endpoint,
+	                   bool share_port, int backlog)
+	{
+		acceptor.open(endpoint.protocol());
+		acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+		if (share_port)
 		{
+			// every thread gets its own listener and the kernel distributes the connections
+			acceptor.set_option(reuse_port(true));
 		}
+#else
+		assert(!share_port);
+#endif
+		acceptor.bind(endpoint);
+		// Connections beyond the backlog are refused by the kernel before they cost the server anything.
+		acceptor.listen(backlog);
 	}
 
-	// TODO: use unique_observable
-	using session_handle = Si::shared_observable<Si::nothing>;
+	//! How many unused sessions and coroutine stacks every serving thread keeps for new connections.
+	std::size_t const idle_session_limit = 1024;
+
+	std::chrono::milliseconds const accept_error_pause(100);
 
-	std::pair<std::vector<char>, content_type> directory_listing_to_json_bytes(directory_listing const &listing)
+	//! Answers a connection that the server has no capacity for without starting a session. The response fits into
+	//! the empty send buffer of a new socket, so nothing has to wait.
+	void reject_connection(boost::asio::ip::tcp::socket &socket)
 	{
-		std::vector<char> bytes;
-		serialize_json(Si::make_container_sink(bytes), listing);
-		return std::make_pair(std::move(bytes), json_listing_content_type);
+		boost::system::error_code ignored;
+		socket.non_blocking(true, ignored);
+		Si::memory_range const response = service_unavailable_response(false);
+		socket.send(boost::asio::buffer(response.begin(), static_cast<std::size_t>(response.size())), 0, ignored);
+		// closing a socket with unread data resets the connection, which could discard the response at the client
+		std::array<char, 1024> request;
+		socket.receive(boost::asio::buffer(request), 0, ignored);
+		socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+		socket.close(ignored);
 	}
 
-	void serve_directory(boost::filesystem::path const &served_dir)
+	void accept_clients(boost::asio::io_service &io, boost::asio::ip::tcp::acceptor &acceptor,
+	                    serve_options const &options, pool_executor<Si::std_threading> &disk_pool,
+	                    admission_control &admission, file_caches &caches, published_tree const &tree)
 	{
-		boost::asio::io_service io;
-		boost::asio::ip::tcp::acceptor acceptor(io,
-		                                        boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4(), 8080));
-		auto clients = Si::asio::make_tcp_acceptor(&acceptor);
-
-		std::pair<file_repository, typed_reference> const scanned =
-		    scan_directory(served_dir, directory_listing_to_json_bytes, detail::hash_file);
-		std::cerr << "Scan complete. Tree hash value ";
-		typed_reference const &root = scanned.second;
-		print(std::cerr, root);
-		std::cerr << "\n";
-		file_repository const &files = scanned.first;
-		digest const &root_digest = root.referenced;
-
-		Si::spawn_coroutine(
-		    [&clients, &files, &root_digest](Si::spawn_context &yield)
+		disk_reader disk{disk_pool, io, admission, caches};
+#ifdef FILESERVER_HAS_IO_URING
+		std::unique_ptr<io_uring_engine> uring;
+		if (options.io_uring)
+		{
+			uring = io_uring_engine::create(io, io_uring_buffer_count);
+			if (!uring)
+			{
+				std::cerr << "io_uring is not available, falling back to the thread pool\n";
+			}
+		}
+		disk.uring = uring.get();
+#endif
+		stack_pool stacks(options.stack_size, idle_session_limit);
+		recycling_pool<session> sessions(idle_session_limit);
+		spawn_pooled_coroutine(
+		    stacks,
+		    [&io, &acceptor, &admission, &stacks, &sessions, &options, &disk, &tree](pooled_coroutine_context &yield)
 		    {
 			    for (;;)
 			    {
-				    Si::optional<Si::asio::tcp_acceptor_result> accepted = yield.get_one(Si::ref(clients));
-				    if (!accepted)
+				    std::unique_ptr<session> client = sessions.acquire([&io]
+				                                                       {
+					                                                       return Si::make_unique<session>(io);
+					                                                   });
+				    pending_result<boost::system::error_code> accepted;
+				    acceptor.async_accept(*client->socket, accepted.completion());
+				    Si::optional<boost::system::error_code> const ec = yield.get_one(accepted);
+				    if (!ec || (*ec == boost::asio::error::operation_aborted))
 				    {
 					    return;
 				    }
-				    std::shared_ptr<boost::asio::ip::tcp::socket> socket = accepted->get(); // TODO handle error
-				    auto prepare_socket = [socket, &files, &root_digest](Si::spawn_context &yield)
+				    if (*ec)
 				    {
-					    std::array<char, 1024> receive_buffer;
-					    auto received = Si::asio::make_reading_observable(
-					        *socket, Si::make_iterator_range(receive_buffer.data(),
-					                                         receive_buffer.data() + receive_buffer.size()));
-					    auto make_sender = [socket](Si::memory_range sent)
-					    {
-						    auto sender = Si::asio::make_writing_observable(*socket);
-						    sender.set_buffer(sent);
-						    return sender;
-						};
-					    auto shutdown = [socket]()
-					    {
-						    boost::system::error_code ec; // ignored
-						    socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-						};
-					    serve_client(yield, received, make_sender, shutdown, files, root_digest);
+					    sessions.release(std::move(client));
+					    // running out of file descriptors is usually temporary, but retrying immediately would spin
+					    boost::asio::steady_timer pause(io, accept_error_pause);
+					    pending_result<boost::system::error_code> paused;
+					    pause.async_wait(paused.completion());
+					    yield.get_one(paused);
+					    continue;
+				    }
+				    if (!admission.try_start_session())
+				    {
+					    reject_connection(*client->socket);
+					    sessions.release(std::move(client));
+					    continue;
+				    }
+
+				    {
+					    // The last segment of a response must not wait for the acknowledgement of the previous one.
+					    // Small writes are avoided by combining the header and the body instead.
+					    boost::system::error_code ignored;
+					    client->socket->set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+				    }
+				    session *const served = client.release();
+				    auto serve = [served, &admission, &sessions, &options, &disk, &tree](
+				        pooled_coroutine_context &yield)
+				    {
+					    std::unique_ptr<session> finished(served);
+					    serve_client(yield, *finished, options, disk, tree);
+					    boost::system::error_code ignored;
+					    finished->socket->close(ignored);
+					    sessions.release(std::move(finished));
+					    admission.finish_session();
 					};
-				    Si::spawn_coroutine(std::move(prepare_socket));
+				    spawn_pooled_coroutine(stacks, serve);
 			    }
 			});
-
 		io.run();
 	}
 
+	//! The paths that have changed since the served tree was last updated. The watcher adds to them and the updating
+	//! thread takes all of them at once, so a burst of changes costs one update.
+	struct pending_changes
+	{
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::vector<boost::filesystem::path> paths;
+		bool is_stopped = false;
+	};
+
+	//! Forgets the open handles of files that change while they are being served, so that the next request opens the
+	//! new file, and hands the changed paths over to update_served_tree. Nothing slow happens here because this runs
+	//! on a serving thread.
+	void collect_changes(recursive_directory_watcher &watcher, ventura::absolute_path const &root, file_caches &caches,
+	                     pending_changes &pending)
+	{
+		Si::spawn_coroutine([&watcher, root, &caches, &pending](Si::spawn_context yield)
+		                    {
+			                    auto event_reader = Si::make_observable_source(Si::ref(watcher), yield);
+			                    for (;;)
+			                    {
+				                    Si::optional<Si::error_or<std::vector<ventura::file_notification>>> events =
+				                        Si::get(event_reader);
+				                    if (!events)
+				                    {
+					                    break;
+				                    }
+				                    if (events->is_error())
+				                    {
+					                    std::cerr << "Watching the served directory failed: " << events->error()
+					                              << '\n';
+					                    caches.forget(nullptr);
+					                    break;
+				                    }
+				                    if (events->get().empty())
+				                    {
+					                    continue;
+				                    }
+				                    std::vector<boost::filesystem::path> changed;
+				                    for (ventura::file_notification const &notification : events->get())
+				                    {
+					                    path const changed_file = root / notification.name;
+					                    // everything below a moved or removed directory is affected
+					                    caches.forget(notification.is_directory ? nullptr : &changed_file);
+					                    changed.emplace_back(changed_file.c_str());
+				                    }
+				                    // The handles are forgotten before the new tree can be published, so no request
+				                    // for the new content gets an old file. Until then the old tree is served, but a
+				                    // changed file no longer has the identity stored in it and is refused.
+				                    {
+					                    std::unique_lock<std::mutex> lock(pending.mutex);
+					                    pending.paths.insert(pending.paths.end(), changed.begin(), changed.end());
+				                    }
+				                    pending.changed.notify_one();
+			                    }
+			                });
+	}
+
+	//! Applies the collected changes to the served tree until it is stopped. Only the changed files are hashed again,
+	//! and the new tree is published as a whole while the old one is still being served.
+	void update_served_tree(boost::filesystem::path const &root, published_tree &tree, pending_changes &pending,
+	                        file_hasher const &hash_file, pool_executor<Si::std_threading> &disk_pool)
+	{
+		for (;;)
+		{
+			std::vector<boost::filesystem::path> changed;
+			{
+				std::unique_lock<std::mutex> lock(pending.mutex);
+				pending.changed.wait(lock, [&pending]
+				                     {
+					                     return pending.is_stopped || !pending.paths.empty();
+					                 });
+				if (pending.is_stopped)
+				{
+					return;
+				}
+				changed.swap(pending.paths);
+			}
+			// this is the only thread that publishes, so the tree cannot change between here and the publication
+			std::shared_ptr<served_tree const> const old = tree.get();
+			repository_update update;
+			name_tree updated_root;
+			try
+			{
+				updated_root = update_directory(root, old->root, changed, update, directory_listing_to_json_bytes,
+				                                hash_file, disk_pool);
+			}
+			catch (std::exception const &ex)
+			{
+				// the next change will try again
+				std::cerr << "Updating the served tree failed: " << ex.what() << '\n';
+				continue;
+			}
+			if (update.empty())
+			{
+				continue;
+			}
+			// the new snapshot shares every shard of the old repository that the update does not touch
+			std::shared_ptr<served_tree> const updated = make_served_tree(old->files, std::move(updated_root));
+			update.apply_to(updated->files);
+			std::cerr << "Update complete. Tree hash value ";
+			print(std::cerr, updated->root.reference);
+			std::cerr << "\n";
+			tree.publish(updated);
+		}
+	}
+
+	void serve_directory(boost::filesystem::path const &served_dir, serve_options const &options)
+	{
+#ifdef __linux__
+		ignore_broken_pipes();
+#endif
+		std::size_t thread_count = std::max<std::size_t>(1, options.threads);
+#ifndef SO_REUSEPORT
+		if (thread_count > 1)
+		{
+			std::cerr << "Multiple serving threads are not supported on this platform, using one\n";
+			thread_count = 1;
+		}
+#endif
+
+		// Each thread runs its own io_service with its own listener so that sessions never have to be synchronized
+		// with each other. The served tree is an immutable snapshot that is shared without locking.
+		std::vector<std::unique_ptr<boost::asio::io_service>> io_services;
+		std::vector<std::unique_ptr<boost::asio::ip::tcp::acceptor>> acceptors;
+		boost::asio::ip::tcp::endpoint const endpoint(boost::asio::ip::address_v4(), 8080);
+		for (std::size_t i = 0; i < thread_count; ++i)
+		{
+			io_services.emplace_back(Si::make_unique<boost::asio::io_service>());
+			acceptors.emplace_back(Si::make_unique<boost::asio::ip::tcp::acceptor>(*io_services.back()));
+			open_listener(*acceptors.back(), endpoint, thread_count > 1, options.listen_backlog);
+		}
+
+		// File contents are read on separate threads so that a slow disk does not block the network threads. The number
+		// of threads is fixed, so a burst of requests queues up instead of overwhelming the disk.
+		std::size_t const disk_thread_count =
+		    (options.disk_threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : options.disk_threads;
+		pool_executor<Si::std_threading> disk_pool(disk_thread_count);
+
+		file_hasher hash_file = detail::hash_files;
+#ifndef _WIN32
+		std::unique_ptr<fileserver::hash_cache> hashes;
+		if (!options.hash_cache.empty())
+		{
+			Si::error_or<std::unique_ptr<fileserver::hash_cache>> opened =
+			    fileserver::hash_cache::open(options.hash_cache);
+			if (opened.is_error())
+			{
+				// the cache only saves time, so the scan goes on without it
+				std::cerr << "Could not open the hash cache " << options.hash_cache << ": " << opened.error().message()
+				          << '\n';
+			}
+			else
+			{
+				hashes = std::move(opened.get());
+			}
+		}
+		else if (options.watch)
+		{
+			// The watcher reports every file once when it starts. Those that have not changed since the scan are
+			// found here instead of being read again.
+			hashes = fileserver::hash_cache::create_in_memory();
+		}
+		if (hashes)
+		{
+			fileserver::hash_cache &cache = *hashes;
+			hash_file = [&cache](std::vector<ventura::absolute_path> const &files)
+			{
+				return detail::hash_files_with_cache(cache, files);
+			};
+		}
+#endif
+
+		// nothing is served yet, so the scan can have all of the disk threads
+		std::pair<file_repository, name_tree> scanned =
+		    scan_directory(served_dir, directory_listing_to_json_bytes, hash_file, disk_pool);
+#ifndef _WIN32
+		if (!options.hash_cache.empty() && hashes)
+		{
+			boost::system::error_code ec = hashes->flush();
+			if (!ec)
+			{
+				ec = hashes->compact();
+			}
+			if (ec)
+			{
+				std::cerr << "Could not update the hash cache: " << ec.message() << '\n';
+			}
+			std::cerr << "Hash cache: " << hashes->hits() << " files unchanged, " << hashes->misses()
+			          << " files hashed\n";
+		}
+#endif
+		scanned.first.prepare_response_headers();
+		std::cerr << "Scan complete. Tree hash value ";
+		print(std::cerr, scanned.second.reference);
+		std::cerr << "\n";
+		published_tree tree(make_served_tree(std::move(scanned.first), std::move(scanned.second)));
+		admission_control admission(options.max_sessions, options.max_disk_queue_depth);
+		file_caches caches(options);
+
+		std::unique_ptr<recursive_directory_watcher> watcher;
+		pending_changes pending;
+		std::future<void> updating;
+		if (options.watch)
+		{
+			Si::optional<ventura::absolute_path> const watched_dir = ventura::absolute_path::create(served_dir);
+			if (!watched_dir)
+			{
+				throw std::invalid_argument("Only an absolute directory can be watched");
+			}
+			watcher = Si::make_unique<recursive_directory_watcher>(*io_services.front(), *watched_dir);
+			collect_changes(*watcher, *watched_dir, caches, pending);
+			// hashing can take a while, so it does not happen on a serving thread
+			boost::filesystem::path const watched_root(watched_dir->c_str());
+			updating = std::async(std::launch::async, [watched_root, &tree, &pending, &hash_file, &disk_pool]()
+			                      {
+				                      update_served_tree(watched_root, tree, pending, hash_file, disk_pool);
+				                  });
+		}
+
+		std::vector<std::future<void>> workers;
+		for (std::size_t i = 1; i < thread_count; ++i)
+		{
+			boost::asio::io_service &io = *io_services[i];
+			boost::asio::ip::tcp::acceptor &acceptor = *acceptors[i];
+			workers.emplace_back(std::async(
+			    std::launch::async,
+			    [&io, &acceptor, &options, &disk_pool, &admission, &caches, &tree]()
+			    {
+				    accept_clients(io, acceptor, options, disk_pool, admission, caches, tree);
+				}));
+		}
+		accept_clients(*io_services.front(), *acceptors.front(), options, disk_pool, admission, caches, tree);
+		for (std::future<void> &worker : workers)
+		{
+			worker.get();
+		}
+		if (updating.valid())
+		{
+			{
+				std::unique_lock<std::mutex> lock(pending.mutex);
+				pending.is_stopped = true;
+			}
+			pending.changed.notify_one();
+			updating.get();
+		}
+	}
+
 	char const *notification_type_name(ventura::file_notification_type type)
 	{
 		switch (type)
@@ -458,11 +2124,57 @@ int main(int argc, char **argv)
 {
 	std::string verb;
 	boost::filesystem::path where = boost::filesystem::current_path();
+	fileserver::serve_options serve_options;
+	unsigned keep_alive_timeout_seconds = 15;
+	unsigned header_timeout_seconds = 10;
+	unsigned send_timeout_seconds = 10;
+	unsigned linger_timeout_seconds = 2;
 
 	boost::program_options::options_description desc("Allowed options");
 	desc.add_options()("help", "produce help message")("verb", boost::program_options::value(&verb),
 	                                                   "what to do (serve)")(
-	    "where", boost::program_options::value(&where), "which filesystem directory to use");
+	    "where", boost::program_options::value(&where), "which filesystem directory to use")(
+	    "threads", boost::program_options::value(&serve_options.threads),
+	    "number of threads accepting and serving connections")(
+	    "disk-threads", boost::program_options::value(&serve_options.disk_threads),
+	    "number of threads reading files (default: one per hardware thread)")(
+	    "keep-alive-timeout", boost::program_options::value(&keep_alive_timeout_seconds),
+	    "seconds an idle connection is kept open for the next request")(
+	    "header-timeout", boost::program_options::value(&header_timeout_seconds),
+	    "seconds a client has to send a request header once it has begun")(
+	    "send-timeout", boost::program_options::value(&send_timeout_seconds),
+	    "seconds every part of a response may take in addition to what the minimum send rate allows")(
+	    "min-send-rate", boost::program_options::value(&serve_options.min_send_rate),
+	    "bytes per second below which a client reading a response is disconnected (0: no limit)")(
+	    "linger-timeout", boost::program_options::value(&linger_timeout_seconds),
+	    "seconds a closing connection waits for the client to close its side")(
+	    "stack-size", boost::program_options::value(&serve_options.stack_size),
+	    "bytes of coroutine stack per connection")(
+	    "max-sessions", boost::program_options::value(&serve_options.max_sessions),
+	    "connections served at the same time, more get a 503 (0: no limit)")(
+	    "max-disk-queue", boost::program_options::value(&serve_options.max_disk_queue_depth),
+	    "waiting disk operations at which file requests get a 503 (0: no limit)")(
+	    "listen-backlog", boost::program_options::value(&serve_options.listen_backlog),
+	    "connections the kernel holds until they are accepted")(
+	    "open-files", boost::program_options::value(&serve_options.open_file_cache_size),
+	    "files kept open for later requests (0: open a file for every request)")(
+	    "watch", "serve changes of the directory without a restart")(
+	    "blob-cache", boost::program_options::value(&serve_options.blob_cache_size),
+	    "bytes of memory for the contents of popular files (0: no cache)")(
+	    "max-cached-blob", boost::program_options::value(&serve_options.max_cached_blob_size),
+	    "bytes above which a file is never kept in memory")(
+	    "mmap", "send larger files from shared memory mappings")(
+	    "max-mapped", boost::program_options::value(&serve_options.max_mapped_bytes),
+	    "bytes of files that are mapped at the same time")(
+	    "max-mapped-file", boost::program_options::value(&serve_options.max_mapped_file_size),
+	    "bytes above which a file is sent without a mapping")(
+	    "hash-cache", boost::program_options::value(&serve_options.hash_cache),
+	    "file that remembers the hashes of unchanged files across restarts")(
+	    "no-sendfile", "always copy file contents through user space instead of using sendfile")
+#ifdef FILESERVER_HAS_IO_URING
+	    ("no-io-uring", "send file contents without io_uring")
+#endif
+	    ;
 
 	boost::program_options::positional_options_description positional;
 	positional.add("verb", 1);
@@ -496,7 +2208,17 @@ int main(int argc, char **argv)
 
 	if (verb == "serve")
 	{
-		fileserver::serve_directory(where);
+		serve_options.keep_alive_timeout = std::chrono::seconds(keep_alive_timeout_seconds);
+		serve_options.header_timeout = std::chrono::seconds(header_timeout_seconds);
+		serve_options.send_timeout = std::chrono::seconds(send_timeout_seconds);
+		serve_options.linger_timeout = std::chrono::seconds(linger_timeout_seconds);
+		serve_options.zero_copy = !vm.count("no-sendfile");
+		serve_options.watch = (vm.count("watch") != 0);
+		serve_options.memory_map = (vm.count("mmap") != 0);
+#ifdef FILESERVER_HAS_IO_URING
+		serve_options.io_uring = !vm.count("no-io-uring");
+#endif
+		fileserver::serve_directory(where, serve_options);
 		return 0;
 	}
 	else if (verb == "watchflat")
@@ -0,0 +1,109 @@
+#ifndef FILESERVER_ADMISSION_CONTROL_HPP
+#define FILESERVER_ADMISSION_CONTROL_HPP
+
+#include <silicium/config.hpp>
+#include <atomic>
+#include <cstddef>
+
+namespace fileserver
+{
+	//! Limits shared by all serving threads. A server that is over a limit turns new work away immediately instead of
+	//! letting it queue up until every client times out.
+	struct admission_control
+	{
+		//! \param max_sessions 0 means no limit
+		//! \param max_disk_queue_depth 0 means no limit
+		admission_control(std::size_t max_sessions, std::size_t max_disk_queue_depth)
+		    : m_max_sessions(max_sessions)
+		    , m_max_disk_queue_depth(max_disk_queue_depth)
+		    , m_sessions(0)
+		    , m_rejected_sessions(0)
+		    , m_rejected_disk_reads(0)
+		    , m_timeouts(0)
+		{
+		}
+
+		SILICIUM_DELETED_FUNCTION(admission_control(admission_control const &))
+		SILICIUM_DELETED_FUNCTION(admission_control &operator=(admission_control const &))
+
+		//! \return true if the session may be served, in which case finish_session has to be called later
+		bool try_start_session()
+		{
+			std::size_t const previous = m_sessions++;
+			if ((m_max_sessions != 0) && (previous >= m_max_sessions))
+			{
+				--m_sessions;
+				++m_rejected_sessions;
+				return false;
+			}
+			return true;
+		}
+
+		void finish_session()
+		{
+			--m_sessions;
+		}
+
+		//! A stateless check, so it has to be repeated before every read of a request that reads many files.
+		//! \param queue_depth the number of disk operations that have been submitted but have not finished yet
+		//! \return true if no more reads should be queued
+		bool is_disk_queue_full(std::size_t queue_depth) const
+		{
+			return (m_max_disk_queue_depth != 0) && (queue_depth >= m_max_disk_queue_depth);
+		}
+
+		//! to be called when a request has been turned away or cut short because the disk queue was full
+		void count_rejected_disk_read()
+		{
+			++m_rejected_disk_reads;
+		}
+
+		std::size_t max_sessions() const
+		{
+			return m_max_sessions;
+		}
+
+		std::size_t max_disk_queue_depth() const
+		{
+			return m_max_disk_queue_depth;
+		}
+
+		std::size_t sessions() const
+		{
+			return m_sessions.load();
+		}
+
+		//! the number of connections that have been closed with a 503 right after being accepted
+		std::size_t rejected_sessions() const
+		{
+			return m_rejected_sessions.load();
+		}
+
+		//! the number of requests that have been answered with a 503 or cut short because the disk was too busy
+		std::size_t rejected_disk_reads() const
+		{
+			return m_rejected_disk_reads.load();
+		}
+
+		//! to be called when a session has been closed because a client was too slow
+		void count_timeout()
+		{
+			++m_timeouts;
+		}
+
+		std::size_t timeouts() const
+		{
+			return m_timeouts.load();
+		}
+
+	private:
+		std::size_t const m_max_sessions;
+		std::size_t const m_max_disk_queue_depth;
+		std::atomic<std::size_t> m_sessions;
+		std::atomic<std::size_t> m_rejected_sessions;
+		std::atomic<std::size_t> m_rejected_disk_reads;
+		std::atomic<std::size_t> m_timeouts;
+	};
+}
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef FILESERVER_BATCH_FORMAT_HPP
+#define FILESERVER_BATCH_FORMAT_HPP
+
+#include <server/digest.hpp>
+#include <silicium/memory_range.hpp>
+#include <silicium/optional.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// A batch fetches many blobs with one request. The request is a POST to /batch whose body lists the digests as 64
+// hexadecimal digits separated by white space. The response contains the blobs in the order of the request. Each
+// blob is introduced by a line with its digest and its size in bytes, or with its digest and a dash if the blob is
+// unknown:
+//
+//     <64 hex digits> <size>\n<size bytes of content><64 hex digits> -\n...
+
+namespace fileserver
+{
+	char const batch_request_target[] = "/batch";
+	char const batch_content_type[] = "application/x-fileserver-batch";
+
+	//! enough for more than a thousand digests
+	std::size_t const max_batch_request_size = 64 * 1024;
+
+	//! \return false if the body contains anything but digests
+	inline bool parse_batch_request(Si::memory_range body, std::vector<sha256_digest> &digests)
+	{
+		auto const is_space = [](char c)
+		{
+			return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+		};
+		char const *position = body.begin();
+		for (;;)
+		{
+			position = std::find_if_not(position, body.end(), is_space);
+			if (position == body.end())
+			{
+				return true;
+			}
+			char const *const digest_end = std::find_if(position, body.end(), is_space);
+			Si::optional<sha256_digest> const digest =
+			    parse_sha256_digest(Si::make_memory_range(position, digest_end));
+			if (!digest)
+			{
+				return false;
+			}
+			digests.emplace_back(*digest);
+			position = digest_end;
+		}
+	}
+
+	//! \param size none if the blob is unknown
+	inline std::string format_batch_item_header(sha256_digest const &digest, Si::optional<boost::uint64_t> size)
+	{
+		std::string formatted;
+		encode_ascii_hex_digits(digest.bytes.begin(), digest.bytes.end(), std::back_inserter(formatted));
+		formatted += ' ';
+		if (size)
+		{
+			formatted += boost::lexical_cast<std::string>(*size);
+		}
+		else
+		{
+			formatted += '-';
+		}
+		formatted += '\n';
+		return formatted;
+	}
+
+	namespace detail
+	{
+		//! \return none unless the text consists of decimal digits only and the number fits
+		inline Si::optional<boost::uint64_t> parse_decimal_size(Si::memory_range text)
+		{
+			if (text.empty() || !std::all_of(text.begin(), text.end(), [](char c)
+			                                 {
+				                                 return (c >= '0') && (c <= '9');
+				                             }))
+			{
+				return Si::none;
+			}
+			boost::uint64_t parsed;
+			if (!boost::conversion::try_lexical_convert(text.begin(), static_cast<std::size_t>(text.size()), parsed))
+			{
+				return Si::none;
+			}
+			return parsed;
+		}
+	}
+
+	struct batch_item_header
+	{
+		unknown_digest digest;
+
+		//! none if the server does not know the blob
+		Si::optional<boost::uint64_t> size;
+	};
+
+	//! \param line without the line break
+	inline Si::optional<batch_item_header> parse_batch_item_header(Si::memory_range line)
+	{
+		char const *const space = std::find(line.begin(), line.end(), ' ');
+		if (space == line.end())
+		{
+			return Si::none;
+		}
+		Si::optional<unknown_digest> digest = parse_digest(Si::make_memory_range(line.begin(), space));
+		if (!digest || digest->empty())
+		{
+			return Si::none;
+		}
+		Si::memory_range const size = Si::make_memory_range(space + 1, line.end());
+		if ((size.size() == 1) && (*size.begin() == '-'))
+		{
+			return batch_item_header{std::move(*digest), Si::none};
+		}
+		Si::optional<boost::uint64_t> const parsed_size = detail::parse_decimal_size(size);
+		if (!parsed_size)
+		{
+			return Si::none;
+		}
+		return batch_item_header{std::move(*digest), *parsed_size};
+	}
+}
+
+#endif
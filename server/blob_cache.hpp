@@ -0,0 +1,259 @@
+#ifndef FILESERVER_BLOB_CACHE_HPP
+#define FILESERVER_BLOB_CACHE_HPP
+
+#include <silicium/config.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fileserver
+{
+	//! Keeps the contents of popular blobs in memory within a fixed budget of bytes. Can be used from any number of
+	//! threads.
+	//!
+	//! The replacement policy is 2Q: a blob that is requested for the first time only enters a small FIFO queue. It is
+	//! promoted to the main LRU list if it is requested again while it is still in the queue or soon after it has left
+	//! it. A clone that reads every blob once only cycles through the queue and does not evict the hot blobs.
+	template <class Key, class Hash = boost::hash<Key>>
+	struct blob_cache
+	{
+		typedef std::shared_ptr<std::vector<char> const> content_ptr;
+
+		//! \param max_bytes 0 disables the cache
+		//! \param max_blob_size larger blobs are never cached
+		blob_cache(boost::uint64_t max_bytes, boost::uint64_t max_blob_size)
+		    : m_max_bytes(max_bytes)
+		    , m_max_blob_size(std::min(max_blob_size, max_bytes))
+		    , m_max_probation_bytes(max_bytes / 4)
+		    , m_max_ghost_bytes(max_bytes / 2)
+		    , m_bytes(0)
+		    , m_probation_bytes(0)
+		    , m_ghost_bytes(0)
+		    , m_hits(0)
+		    , m_misses(0)
+		{
+		}
+
+		SILICIUM_DELETED_FUNCTION(blob_cache(blob_cache const &))
+		SILICIUM_DELETED_FUNCTION(blob_cache &operator=(blob_cache const &))
+
+		//! \return nullptr on a miss
+		content_ptr find(Key const &key)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto const found = m_entries.find(key);
+			if ((found == m_entries.end()) || !found->second.content)
+			{
+				++m_misses;
+				return nullptr;
+			}
+			++m_hits;
+			entry &hit = found->second;
+			switch (hit.where)
+			{
+			case queue::probation:
+				// the second request within a short time makes a blob hot
+				m_probation.erase(hit.position);
+				m_probation_bytes -= hit.size;
+				m_protected.push_front(key);
+				hit.position = m_protected.begin();
+				hit.where = queue::protected_;
+				break;
+
+			case queue::protected_:
+				m_protected.splice(m_protected.begin(), m_protected, hit.position);
+				break;
+
+			case queue::ghost:
+				break;
+			}
+			return hit.content;
+		}
+
+		//! \return whether a blob of this size would be cached at all
+		bool admits(boost::uint64_t size) const
+		{
+			return (size <= m_max_blob_size) && (m_max_bytes != 0);
+		}
+
+		//! Remembers a blob that has been read from the disk after a miss.
+		void insert(Key const &key, content_ptr content)
+		{
+			boost::uint64_t const size = content->size();
+			if (!admits(size))
+			{
+				return;
+			}
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto found = m_entries.find(key);
+			if (found == m_entries.end())
+			{
+				found = m_entries.insert(std::make_pair(key, entry())).first;
+				m_probation.push_front(key);
+				found->second.where = queue::probation;
+				found->second.position = m_probation.begin();
+				m_probation_bytes += size;
+			}
+			else if (found->second.where == queue::ghost)
+			{
+				// it has been requested again shortly after it was forgotten
+				m_ghosts.erase(found->second.position);
+				m_ghost_bytes -= found->second.size;
+				m_protected.push_front(key);
+				found->second.where = queue::protected_;
+				found->second.position = m_protected.begin();
+			}
+			else
+			{
+				// somebody else has read the same blob in the meantime
+				return;
+			}
+			found->second.content = std::move(content);
+			found->second.size = size;
+			m_bytes += size;
+			evict();
+		}
+
+		//! Forgets every blob.
+		void clear()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_entries.clear();
+			m_probation.clear();
+			m_protected.clear();
+			m_ghosts.clear();
+			m_bytes = 0;
+			m_probation_bytes = 0;
+			m_ghost_bytes = 0;
+		}
+
+		boost::uint64_t max_bytes() const
+		{
+			return m_max_bytes;
+		}
+
+		boost::uint64_t max_blob_size() const
+		{
+			return m_max_blob_size;
+		}
+
+		//! the total size of the cached blobs
+		boost::uint64_t bytes() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_bytes;
+		}
+
+		//! the number of cached blobs
+		std::size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_probation.size() + m_protected.size();
+		}
+
+		boost::uint64_t hits() const
+		{
+			return m_hits.load();
+		}
+
+		boost::uint64_t misses() const
+		{
+			return m_misses.load();
+		}
+
+	private:
+		enum class queue
+		{
+			probation,
+			protected_,
+
+			//! only the key is remembered
+			ghost
+		};
+
+		struct entry
+		{
+			content_ptr content;
+			boost::uint64_t size;
+			queue where;
+			typename std::list<Key>::iterator position;
+
+			entry()
+			    : size(0)
+			    , where(queue::probation)
+			{
+			}
+		};
+
+		boost::uint64_t const m_max_bytes;
+		boost::uint64_t const m_max_blob_size;
+		boost::uint64_t const m_max_probation_bytes;
+
+		//! the sizes of the forgotten blobs, which limits how long a blob is remembered after it has left probation
+		boost::uint64_t const m_max_ghost_bytes;
+
+		mutable std::mutex m_mutex;
+		boost::unordered_map<Key, entry, Hash> m_entries;
+
+		//! blobs that have been requested once, the newest come first
+		std::list<Key> m_probation;
+
+		//! blobs that have been requested more than once, the most recently used come first
+		std::list<Key> m_protected;
+
+		//! blobs that have recently left probation, the newest come first
+		std::list<Key> m_ghosts;
+
+		boost::uint64_t m_bytes;
+		boost::uint64_t m_probation_bytes;
+		boost::uint64_t m_ghost_bytes;
+		std::atomic<boost::uint64_t> m_hits;
+		std::atomic<boost::uint64_t> m_misses;
+
+		void evict()
+		{
+			while (m_probation_bytes > m_max_probation_bytes)
+			{
+				demote_oldest_probation();
+			}
+			while (m_bytes > m_max_bytes)
+			{
+				if (m_protected.empty())
+				{
+					demote_oldest_probation();
+					continue;
+				}
+				auto const found = m_entries.find(m_protected.back());
+				m_bytes -= found->second.size;
+				m_entries.erase(found);
+				m_protected.pop_back();
+			}
+			while (m_ghost_bytes > m_max_ghost_bytes)
+			{
+				auto const found = m_entries.find(m_ghosts.back());
+				m_ghost_bytes -= found->second.size;
+				m_entries.erase(found);
+				m_ghosts.pop_back();
+			}
+		}
+
+		void demote_oldest_probation()
+		{
+			entry &oldest = m_entries.find(m_probation.back())->second;
+			m_bytes -= oldest.size;
+			m_probation_bytes -= oldest.size;
+			m_ghost_bytes += oldest.size;
+			oldest.content.reset();
+			oldest.where = queue::ghost;
+			m_ghosts.splice(m_ghosts.begin(), m_probation, oldest.position);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef FILESERVER_BYTE_RANGE_HPP
+#define FILESERVER_BYTE_RANGE_HPP
+
+#include <silicium/optional.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/range/begin.hpp>
+#include <boost/range/end.hpp>
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fileserver
+{
+	//! A non-empty part of a file.
+	struct byte_range
+	{
+		boost::uint64_t begin;
+		boost::uint64_t length;
+	};
+
+	inline bool operator==(byte_range const &left, byte_range const &right)
+	{
+		return (left.begin == right.begin) && (left.length == right.length);
+	}
+
+	inline std::ostream &operator<<(std::ostream &out, byte_range const &range)
+	{
+		return out << range.begin << "+" << range.length;
+	}
+
+	//! More ranges than this in one request are not worth the overhead of a multipart response.
+	std::size_t const max_byte_ranges_per_request = 64;
+
+	namespace detail
+	{
+		template <class Iterator>
+		void skip_whitespace(Iterator &begin, Iterator end)
+		{
+			while ((begin != end) && ((*begin == ' ') || (*begin == '\t')))
+			{
+				++begin;
+			}
+		}
+
+		template <class Iterator>
+		Si::optional<boost::uint64_t> parse_decimal(Iterator &begin, Iterator end)
+		{
+			if ((begin == end) || (*begin < '0') || (*begin > '9'))
+			{
+				return Si::none;
+			}
+			boost::uint64_t result = 0;
+			for (; (begin != end) && (*begin >= '0') && (*begin <= '9'); ++begin)
+			{
+				boost::uint64_t const digit = static_cast<boost::uint64_t>(*begin - '0');
+				if (result > ((std::numeric_limits<boost::uint64_t>::max() - digit) / 10))
+				{
+					return Si::none;
+				}
+				result = (result * 10) + digit;
+			}
+			return result;
+		}
+
+		inline std::vector<byte_range> merge_byte_ranges(std::vector<byte_range> ranges)
+		{
+			std::sort(ranges.begin(), ranges.end(), [](byte_range const &left, byte_range const &right)
+			          {
+				          return left.begin < right.begin;
+				      });
+			std::vector<byte_range> merged;
+			for (byte_range const &range : ranges)
+			{
+				if (!merged.empty() && (range.begin <= (merged.back().begin + merged.back().length)))
+				{
+					boost::uint64_t const end =
+					    std::max(merged.back().begin + merged.back().length, range.begin + range.length);
+					merged.back().length = end - merged.back().begin;
+				}
+				else
+				{
+					merged.emplace_back(range);
+				}
+			}
+			return merged;
+		}
+	}
+
+	//! Parses the value of a Range header (RFC 7233) for a file of the given size.
+	//! \return none if the header is malformed, uses an unknown unit or asks for too many ranges. The header has to
+	//!         be ignored then. An empty vector means that none of the ranges can be satisfied.
+	//!         Overlapping and adjacent ranges are merged, so the result is sorted and a client cannot make us send
+	//!         the same bytes many times.
+	template <class CharRange>
+	Si::optional<std::vector<byte_range>> parse_range_header(CharRange const &header, boost::uint64_t size)
+	{
+		auto i = boost::begin(header);
+		auto const end = boost::end(header);
+		for (char const expected : {'b', 'y', 't', 'e', 's'})
+		{
+			if ((i == end) || (std::tolower(static_cast<unsigned char>(*i)) != expected))
+			{
+				return Si::none;
+			}
+			++i;
+		}
+		detail::skip_whitespace(i, end);
+		if ((i == end) || (*i != '='))
+		{
+			return Si::none;
+		}
+		++i;
+
+		std::vector<byte_range> satisfiable;
+		std::size_t range_count = 0;
+		for (;;)
+		{
+			detail::skip_whitespace(i, end);
+			if ((i != end) && (*i == ','))
+			{
+				// empty list elements are allowed
+				++i;
+				continue;
+			}
+			if (i == end)
+			{
+				break;
+			}
+
+			++range_count;
+			if (range_count > max_byte_ranges_per_request)
+			{
+				return Si::none;
+			}
+
+			if (*i == '-')
+			{
+				++i;
+				Si::optional<boost::uint64_t> const suffix_length = detail::parse_decimal(i, end);
+				if (!suffix_length)
+				{
+					return Si::none;
+				}
+				boost::uint64_t const length = std::min(*suffix_length, size);
+				if (length > 0)
+				{
+					satisfiable.emplace_back(byte_range{size - length, length});
+				}
+			}
+			else
+			{
+				Si::optional<boost::uint64_t> const first = detail::parse_decimal(i, end);
+				if (!first || (i == end) || (*i != '-'))
+				{
+					return Si::none;
+				}
+				++i;
+				boost::uint64_t last = std::numeric_limits<boost::uint64_t>::max();
+				if ((i != end) && (*i >= '0') && (*i <= '9'))
+				{
+					Si::optional<boost::uint64_t> const parsed_last = detail::parse_decimal(i, end);
+					if (!parsed_last || (*parsed_last < *first))
+					{
+						return Si::none;
+					}
+					last = *parsed_last;
+				}
+				if (*first < size)
+				{
+					satisfiable.emplace_back(byte_range{*first, std::min(last, size - 1) - *first + 1});
+				}
+			}
+
+			detail::skip_whitespace(i, end);
+			if (i == end)
+			{
+				break;
+			}
+			if (*i != ',')
+			{
+				return Si::none;
+			}
+			++i;
+		}
+		if (range_count == 0)
+		{
+			return Si::none;
+		}
+		return detail::merge_byte_ranges(std::move(satisfiable));
+	}
+
+	//! The value of a Content-Range header.
+	inline std::string format_content_range(byte_range const &range, boost::uint64_t size)
+	{
+		return "bytes " + std::to_string(range.begin) + "-" + std::to_string(range.begin + range.length - 1) + "/" +
+		       std::to_string(size);
+	}
+
+	//! The value of a Content-Range header for a 416 response.
+	inline std::string format_unsatisfied_content_range(boost::uint64_t size)
+	{
+		return "bytes */" + std::to_string(size);
+	}
+
+	//! The delimiter and the header that precede a part of a multipart/byteranges body.
+	inline std::string format_byte_range_part_header(std::string const &boundary, byte_range const &range,
+	                                                 boost::uint64_t size)
+	{
+		return "\r\n--" + boundary + "\r\nContent-Type: application/octet-stream\r\nContent-Range: " +
+		       format_content_range(range, size) + "\r\n\r\n";
+	}
+
+	//! The delimiter that ends a multipart/byteranges body.
+	inline std::string format_byte_range_end(std::string const &boundary)
+	{
+		return "\r\n--" + boundary + "--\r\n";
+	}
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include <server/hexadecimal.hpp>
 #include <silicium/variant.hpp>
 #include <boost/range/iterator_range.hpp>
+#include <boost/functional/hash.hpp>
 #ifndef _MSC_VER
 #include <boost/container/string.hpp>
 #endif
@@ -76,6 +77,44 @@ namespace fileserver
 		return formatted;
 	}
 
+	//! Decodes exactly 64 hexadecimal digits without going through an unknown_digest.
+	template <class CharRange>
+	boost::optional<sha256_digest> parse_sha256_digest(CharRange const &formatted)
+	{
+		using std::begin;
+		using std::end;
+		sha256_digest result;
+		if (static_cast<std::size_t>(std::distance(begin(formatted), end(formatted))) != (result.bytes.size() * 2))
+		{
+			return boost::none;
+		}
+		auto const rest = decode_ascii_hex_bytes(begin(formatted), end(formatted), result.bytes.begin());
+		if (rest.first != end(formatted))
+		{
+			return boost::none;
+		}
+		return result;
+	}
+
+	//! Hashes a sha256_digest exactly like the equal unknown_digest is hashed in a boost::unordered_map, which allows
+	//! lookups without converting the digest.
+	struct sha256_digest_hash
+	{
+		std::size_t operator()(sha256_digest const &digest) const
+		{
+			return boost::hash_range(digest.bytes.begin(), digest.bytes.end());
+		}
+	};
+
+	struct sha256_digest_equal
+	{
+		bool operator()(sha256_digest const &left, unknown_digest const &right) const
+		{
+			return (right.size() == left.bytes.size()) &&
+			       std::equal(left.bytes.begin(), left.bytes.end(), right.begin());
+		}
+	};
+
 	inline boost::optional<sha256_digest> to_sha256_digest(unknown_digest const &any)
 	{
 		if (any.size() == sha256_digest().bytes.size())
@@ -4,6 +4,7 @@
 #include <server/sink_stream.hpp>
 #include <server/typed_reference.hpp>
 #include <server/source_stream.hpp>
+#include <silicium/sink/iterator_sink.hpp>
 #include <map>
 
 // workaround for a bug in rapidjson (SizeType is "unsigned" by default)
@@ -67,6 +68,13 @@ namespace fileserver
 		writer.EndObject();
 	}
 
+	inline std::pair<std::vector<char>, content_type> directory_listing_to_json_bytes(directory_listing const &listing)
+	{
+		std::vector<char> bytes;
+		serialize_json(Si::make_container_sink(bytes), listing);
+		return std::make_pair(std::move(bytes), json_listing_content_type);
+	}
+
 	template <class CharSource>
 	inline Si::variant<std::unique_ptr<fileserver::directory_listing>, std::size_t>
 	deserialize_json(CharSource &&serialized)
@@ -0,0 +1,96 @@
+#ifndef FILESERVER_ENTITY_TAG_HPP
+#define FILESERVER_ENTITY_TAG_HPP
+
+#include <server/digest.hpp>
+#include <boost/range/algorithm/equal.hpp>
+#include <boost/range/begin.hpp>
+#include <boost/range/end.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <string>
+
+namespace fileserver
+{
+	//! Content referenced by its digest can never change, so caches may keep it for as long as they like. A year is
+	//! the longest max-age that RFC 7234 recommends.
+	char const *const immutable_cache_control = "public, max-age=31536000, immutable";
+
+	//! The digest identifies the content exactly, so it is a strong entity tag.
+	inline std::string format_entity_tag(unknown_digest const &content)
+	{
+		return "\"" + format_digest<std::string>(content) + "\"";
+	}
+
+	enum class entity_tag_comparison
+	{
+		weak,
+		strong
+	};
+
+	namespace detail
+	{
+		template <class Iterator>
+		void skip_list_separators(Iterator &begin, Iterator end)
+		{
+			while ((begin != end) && ((*begin == ' ') || (*begin == '\t') || (*begin == ',')))
+			{
+				++begin;
+			}
+		}
+	}
+
+	//! Looks for a tag in the value of an If-None-Match or If-Range header (RFC 7232).
+	//! \return false if the header does not contain the tag or if it is malformed. The requested content is sent in
+	//!         both cases, which is always correct.
+	template <class CharRange>
+	bool is_entity_tag_listed(CharRange const &header, std::string const &tag, entity_tag_comparison comparison)
+	{
+		auto i = boost::begin(header);
+		auto const end = boost::end(header);
+		for (;;)
+		{
+			detail::skip_list_separators(i, end);
+			if (i == end)
+			{
+				return false;
+			}
+			if (*i == '*')
+			{
+				// matches any current representation, but does not apply to If-Range
+				return (comparison == entity_tag_comparison::weak);
+			}
+			bool is_weak = false;
+			if (*i == 'W')
+			{
+				++i;
+				if ((i == end) || (*i != '/'))
+				{
+					return false;
+				}
+				++i;
+				is_weak = true;
+			}
+			if ((i == end) || (*i != '"'))
+			{
+				return false;
+			}
+			auto const opaque_begin = i;
+			++i;
+			while ((i != end) && (*i != '"'))
+			{
+				++i;
+			}
+			if (i == end)
+			{
+				return false;
+			}
+			++i;
+			bool const may_match = !is_weak || (comparison == entity_tag_comparison::weak);
+			if (may_match && boost::range::equal(boost::make_iterator_range(opaque_begin, i), tag))
+			{
+				return true;
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef FILESERVER_FILE_HANDLE_CACHE_HPP
+#define FILESERVER_FILE_HANDLE_CACHE_HPP
+
+#include <silicium/config.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace fileserver
+{
+	//! Keeps the most recently used files open, so that a popular file does not have to be looked up and opened for
+	//! every request. A handle that is evicted stays open for as long as somebody still uses it. Each handle has a
+	//! weight, which is 1 for a plain file descriptor or the size of a mapping, and the total weight is bounded.
+	//! Can be used from any number of threads.
+	template <class Key, class Handle>
+	struct file_handle_cache
+	{
+		typedef std::shared_ptr<Handle> handle_ptr;
+
+		struct lookup
+		{
+			//! nullptr on a miss
+			handle_ptr handle;
+
+			//! has to be passed to insert after a miss
+			boost::uint64_t generation;
+		};
+
+		//! \param capacity the maximum total weight, 0 disables the cache
+		explicit file_handle_cache(boost::uint64_t capacity)
+		    : m_capacity(capacity)
+		    , m_weight(0)
+		    , m_generation(0)
+		    , m_hits(0)
+		    , m_misses(0)
+		{
+		}
+
+		SILICIUM_DELETED_FUNCTION(file_handle_cache(file_handle_cache const &))
+		SILICIUM_DELETED_FUNCTION(file_handle_cache &operator=(file_handle_cache const &))
+
+		lookup find(Key const &key)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto const found = m_entries.find(key);
+			if (found == m_entries.end())
+			{
+				++m_misses;
+				return lookup{nullptr, m_generation};
+			}
+			++m_hits;
+			m_recently_used.splice(m_recently_used.begin(), m_recently_used, found->second.position);
+			return lookup{found->second.handle, m_generation};
+		}
+
+		//! Remembers a file that has been opened after a miss. The file is not remembered if the cache has been
+		//! invalidated since the lookup because the handle may refer to an outdated file. If another thread has
+		//! already remembered the same key in the meantime, its handle stays and the given one is not remembered:
+		//! both were opened after the last invalidation, and keeping the first one leaves the weight of a mapping
+		//! that is already being counted alone.
+		void insert(Key const &key, handle_ptr handle, boost::uint64_t generation_of_lookup,
+		            boost::uint64_t weight = 1)
+		{
+			if (weight > m_capacity)
+			{
+				return;
+			}
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (generation_of_lookup != m_generation)
+			{
+				return;
+			}
+			auto const found = m_entries.find(key);
+			if (found != m_entries.end())
+			{
+				// somebody else has opened the same file in the meantime
+				m_recently_used.splice(m_recently_used.begin(), m_recently_used, found->second.position);
+				return;
+			}
+			evict_until_free(weight);
+			m_recently_used.push_front(key);
+			m_entries.insert(std::make_pair(key, entry{std::move(handle), weight, m_recently_used.begin()}));
+			m_weight += weight;
+		}
+
+		//! Forgets the least recently used handles until the given weight fits, for example because the handles
+		//! are also limited by something else.
+		void make_room(boost::uint64_t weight)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			evict_until_free(std::min(weight, m_capacity));
+		}
+
+		//! Forgets a file that has changed.
+		void invalidate(Key const &key)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_generation;
+			auto const found = m_entries.find(key);
+			if (found == m_entries.end())
+			{
+				return;
+			}
+			m_weight -= found->second.weight;
+			m_recently_used.erase(found->second.position);
+			m_entries.erase(found);
+		}
+
+		//! Forgets every file, for example when a whole directory has changed.
+		void clear()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_generation;
+			m_entries.clear();
+			m_recently_used.clear();
+			m_weight = 0;
+		}
+
+		boost::uint64_t capacity() const
+		{
+			return m_capacity;
+		}
+
+		//! the total weight of the cached handles
+		boost::uint64_t weight() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_weight;
+		}
+
+		std::size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_entries.size();
+		}
+
+		boost::uint64_t hits() const
+		{
+			return m_hits.load();
+		}
+
+		boost::uint64_t misses() const
+		{
+			return m_misses.load();
+		}
+
+	private:
+		struct entry
+		{
+			handle_ptr handle;
+			boost::uint64_t weight;
+			typename std::list<Key>::iterator position;
+		};
+
+		boost::uint64_t const m_capacity;
+		mutable std::mutex m_mutex;
+		std::map<Key, entry> m_entries;
+
+		//! the most recently used key comes first
+		std::list<Key> m_recently_used;
+
+		boost::uint64_t m_weight;
+		boost::uint64_t m_generation;
+		std::atomic<boost::uint64_t> m_hits;
+		std::atomic<boost::uint64_t> m_misses;
+
+		void evict_until_free(boost::uint64_t weight)
+		{
+			while ((m_capacity - m_weight) < weight)
+			{
+				auto const oldest = m_entries.find(m_recently_used.back());
+				m_weight -= oldest->second.weight;
+				m_entries.erase(oldest);
+				m_recently_used.pop_back();
+			}
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef FILESERVER_FILE_IDENTITY_HPP
+#define FILESERVER_FILE_IDENTITY_HPP
+
+#ifndef _WIN32
+#include <silicium/optional.hpp>
+#include <boost/cstdint.hpp>
+#include <tuple>
+#include <sys/stat.h>
+
+namespace fileserver
+{
+	//! Everything that changes when the content of a file may have changed. The change time is updated by every write
+	//! and cannot be set by a user, so an unchanged identity means unchanged content.
+	struct file_identity
+	{
+		boost::uint64_t device;
+		boost::uint64_t inode;
+		boost::uint64_t size;
+		boost::int64_t modified_ns;
+		boost::int64_t changed_ns;
+	};
+
+	inline bool operator==(file_identity const &left, file_identity const &right)
+	{
+		return std::tie(left.device, left.inode, left.size, left.modified_ns, left.changed_ns) ==
+		       std::tie(right.device, right.inode, right.size, right.modified_ns, right.changed_ns);
+	}
+
+	//! \return none if the file cannot be inspected
+	inline Si::optional<file_identity> identify_file(int file)
+	{
+		struct stat status;
+		if (::fstat(file, &status) != 0)
+		{
+			return Si::none;
+		}
+		auto const nanoseconds = [](struct timespec const &time)
+		{
+			return static_cast<boost::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+		};
+		return file_identity{static_cast<boost::uint64_t>(status.st_dev), static_cast<boost::uint64_t>(status.st_ino),
+		                     static_cast<boost::uint64_t>(status.st_size), nanoseconds(status.st_mtim),
+		                     nanoseconds(status.st_ctim)};
+	}
+}
+#endif
+
+#endif
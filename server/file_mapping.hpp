@@ -0,0 +1,163 @@
+#ifndef FILESERVER_FILE_MAPPING_HPP
+#define FILESERVER_FILE_MAPPING_HPP
+
+#ifndef _WIN32
+#include <silicium/config.hpp>
+#include <boost/cstdint.hpp>
+#include <atomic>
+#include <memory>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fileserver
+{
+	//! A read-only mapping of a whole file that can be shared by every request for it, so that sending the file
+	//! needs neither a read system call nor a copy into a buffer of our own.
+	//!
+	//! If the file is truncated while it is mapped, the pages beyond the new end become inaccessible and touching
+	//! them in user space raises SIGBUS. The contents must therefore only be passed to system calls like send, which
+	//! fail with EFAULT in that case instead of killing the process.
+	struct file_mapping
+	{
+		//! \return nullptr if the file cannot be mapped, so the caller can read it conventionally
+		static std::unique_ptr<file_mapping> create(int file, std::size_t size)
+		{
+			if (size == 0)
+			{
+				// mmap does not accept an empty mapping
+				return nullptr;
+			}
+			void *const data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+			if (data == MAP_FAILED)
+			{
+				return nullptr;
+			}
+			// Only hints, so errors are ignored. Responses usually go from the beginning to the end, and the kernel
+			// should start reading before the first request gets to the pages.
+			::madvise(data, size, MADV_SEQUENTIAL);
+			::madvise(data, size, MADV_WILLNEED);
+			return std::unique_ptr<file_mapping>(new file_mapping(static_cast<char const *>(data), size));
+		}
+
+		~file_mapping()
+		{
+			::munmap(const_cast<char *>(m_data), m_size);
+		}
+
+		SILICIUM_DELETED_FUNCTION(file_mapping(file_mapping const &))
+		SILICIUM_DELETED_FUNCTION(file_mapping &operator=(file_mapping const &))
+
+		char const *data() const
+		{
+			return m_data;
+		}
+
+		std::size_t size() const
+		{
+			return m_size;
+		}
+
+		//! Reads a part of the file into memory, so that sending it afterwards does not wait for the disk in a page
+		//! fault. Blocks until that is done unless the kernel is too old to populate a mapping, in which case reading
+		//! ahead is only started. The pages are not touched from user space because of SIGBUS.
+		void prefetch(std::size_t begin, std::size_t length) const
+		{
+			// madvise wants an address at the start of a page
+			std::size_t const page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+			std::size_t const aligned = begin - (begin % page_size);
+			void *const address = const_cast<char *>(m_data + aligned);
+			std::size_t const aligned_length = length + (begin - aligned);
+#ifdef MADV_POPULATE_READ
+			if (::madvise(address, aligned_length, MADV_POPULATE_READ) == 0)
+			{
+				return;
+			}
+#endif
+			// only a hint, so errors are ignored
+			::madvise(address, aligned_length, MADV_WILLNEED);
+		}
+
+	private:
+		char const *m_data;
+		std::size_t m_size;
+
+		file_mapping(char const *data, std::size_t size)
+		    : m_data(data)
+		    , m_size(size)
+		{
+		}
+	};
+
+	//! Bounds the total size of all mappings. Unlike the weight of a cache, this includes the mappings that have
+	//! been evicted but are still being sent from. Can be used from any number of threads.
+	struct mapping_budget
+	{
+		explicit mapping_budget(boost::uint64_t capacity)
+		    : m_capacity(capacity)
+		    , m_used(0)
+		{
+		}
+
+		SILICIUM_DELETED_FUNCTION(mapping_budget(mapping_budget const &))
+		SILICIUM_DELETED_FUNCTION(mapping_budget &operator=(mapping_budget const &))
+
+		//! \return false if the size does not fit into what is left
+		bool try_reserve(boost::uint64_t size)
+		{
+			boost::uint64_t used = m_used.load();
+			do
+			{
+				if (size > (m_capacity - used))
+				{
+					return false;
+				}
+			} while (!m_used.compare_exchange_weak(used, used + size));
+			return true;
+		}
+
+		void release(boost::uint64_t size)
+		{
+			m_used -= size;
+		}
+
+		boost::uint64_t capacity() const
+		{
+			return m_capacity;
+		}
+
+		//! the total size of the mappings that exist right now
+		boost::uint64_t used() const
+		{
+			return m_used.load();
+		}
+
+	private:
+		boost::uint64_t const m_capacity;
+		std::atomic<boost::uint64_t> m_used;
+	};
+
+	//! Maps a file if the budget has room for it. The budget has to outlive the mapping, which gives the size back
+	//! when the last reference to it is gone.
+	//! \return nullptr if the file cannot be mapped or the budget is exhausted
+	inline std::shared_ptr<file_mapping> create_counted_mapping(mapping_budget &budget, int file, std::size_t size)
+	{
+		if (!budget.try_reserve(size))
+		{
+			return nullptr;
+		}
+		std::unique_ptr<file_mapping> created = file_mapping::create(file, size);
+		if (!created)
+		{
+			budget.release(size);
+			return nullptr;
+		}
+		return std::shared_ptr<file_mapping>(created.release(), [&budget, size](file_mapping *mapping)
+		                                     {
+			                                     delete mapping;
+			                                     budget.release(size);
+			                                 });
+	}
+}
+#endif
+
+#endif
@@ -3,31 +3,159 @@
 
 #include <server/location.hpp>
 #include <server/digest.hpp>
+#include <server/response_headers.hpp>
 #include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <memory>
 
 namespace fileserver
 {
+	struct repository_entry
+	{
+		std::vector<location> locations;
+
+		//! Filled in by file_repository::prepare_response_headers.
+		cached_response_headers headers;
+	};
+
+	//! The entries are spread over shards that copies of the repository share. A change copies only the shards that it
+	//! touches, so a new snapshot of a large tree costs little more than the changed entries.
 	struct file_repository
 	{
-		boost::unordered_map<unknown_digest, std::vector<location>> available;
+		typedef boost::unordered_map<unknown_digest, repository_entry> shard;
+
+		//! a power of two, so that the last bits of a digest pick the shard
+		static std::size_t const shard_count = 1024;
+
+		file_repository()
+		{
+			// copied as soon as anything is added
+			m_shards.fill(std::make_shared<shard>());
+		}
+
+		repository_entry const *find_entry(unknown_digest const &key) const
+		{
+			shard const &found_in = *m_shards[shard_of(key)];
+			auto i = found_in.find(key);
+			return (i == end(found_in)) ? nullptr : &i->second;
+		}
+
+		repository_entry const *find_entry(sha256_digest const &key) const
+		{
+			shard const &found_in = *m_shards[shard_of(key.bytes.data(), key.bytes.data() + key.bytes.size())];
+			auto i = found_in.find(key, sha256_digest_hash(), sha256_digest_equal());
+			return (i == end(found_in)) ? nullptr : &i->second;
+		}
 
 		std::vector<location> const *find_location(unknown_digest const &key) const
 		{
-			auto i = available.find(key);
-			return (i == end(available)) ? nullptr : &i->second;
+			repository_entry const *const entry = find_entry(key);
+			return entry ? &entry->locations : nullptr;
+		}
+
+		//! \return the entry of key, which has no locations if it is new
+		repository_entry &add_entry(unknown_digest const &key)
+		{
+			return own_shard(shard_of(key))[key];
+		}
+
+		//! \return nullptr if there is no such entry
+		repository_entry *find_entry_to_change(unknown_digest const &key)
+		{
+			if (!find_entry(key))
+			{
+				// nothing to copy
+				return nullptr;
+			}
+			return &own_shard(shard_of(key)).find(key)->second;
+		}
+
+		void erase(unknown_digest const &key)
+		{
+			if (find_entry(key))
+			{
+				own_shard(shard_of(key)).erase(key);
+			}
+		}
+
+		std::size_t size() const
+		{
+			std::size_t total = 0;
+			for (std::shared_ptr<shard> const &entries : m_shards)
+			{
+				total += entries->size();
+			}
+			return total;
+		}
+
+		//! \param visit is called with the digest and the repository_entry of every entry
+		template <class Visitor>
+		void for_each_entry(Visitor &&visit) const
+		{
+			for (std::shared_ptr<shard> const &entries : m_shards)
+			{
+				for (shard::value_type const &entry : *entries)
+				{
+					visit(entry.first, entry.second);
+				}
+			}
+		}
+
+		void merge(file_repository const &merged)
+		{
+			merged.for_each_entry([this](unknown_digest const &key, repository_entry const &entry)
+			                      {
+				                      std::vector<location> &locations = add_entry(key).locations;
+				                      locations.insert(locations.end(), entry.locations.begin(), entry.locations.end());
+				                  });
 		}
 
-		void merge(file_repository merged)
+		//! Serializes the response headers of every entry. Has to be called after the repository has been changed.
+		void prepare_response_headers()
 		{
-			for (auto &entry : merged.available)
+			for (std::size_t i = 0; i < shard_count; ++i)
 			{
-				std::vector<location> &locations = available[entry.first];
-				for (location &location_entry : entry.second)
+				for (auto &entry : own_shard(i))
 				{
-					locations.emplace_back(std::move(location_entry));
+					assert(!entry.second.locations.empty());
+					entry.second.headers =
+					    make_cached_response_headers(entry.first, location_file_size(entry.second.locations.front()));
 				}
 			}
 		}
+
+	private:
+		//! A shard is never changed while another repository can see it.
+		std::array<std::shared_ptr<shard>, shard_count> m_shards;
+
+		static std::size_t shard_of(byte const *begin, byte const *end)
+		{
+			std::size_t index = 0;
+			for (byte const *i = end - std::min<std::ptrdiff_t>(end - begin, 2); i != end; ++i)
+			{
+				index = (index << 8) | *i;
+			}
+			return index & (shard_count - 1);
+		}
+
+		static std::size_t shard_of(unknown_digest const &key)
+		{
+			return shard_of(key.data(), key.data() + key.size());
+		}
+
+		shard &own_shard(std::size_t index)
+		{
+			std::shared_ptr<shard> &entries = m_shards[index];
+			// The only reference cannot be copied by anyone else while this repository is being changed, so the
+			// count is reliable here.
+			if (entries.use_count() != 1)
+			{
+				entries = std::make_shared<shard>(*entries);
+			}
+			return *entries;
+		}
 	};
 }
 
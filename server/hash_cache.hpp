@@ -0,0 +1,400 @@
+#ifndef FILESERVER_HASH_CACHE_HPP
+#define FILESERVER_HASH_CACHE_HPP
+
+#ifndef _WIN32
+#include <server/digest.hpp>
+#include <server/file_identity.hpp>
+#include <silicium/error_or.hpp>
+#include <silicium/config.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace fileserver
+{
+	//! the clock that the file system uses for modification and change times
+	inline boost::int64_t current_time_ns()
+	{
+		struct timespec now;
+		::clock_gettime(CLOCK_REALTIME, &now);
+		return static_cast<boost::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+	}
+
+	//! Some file systems store times as coarsely as this (FAT has two seconds).
+	boost::int64_t const file_time_granularity_ns = 2000000000;
+
+	//! A file that has been changed shortly before it was identified can be changed again without getting a
+	//! different time stamp, so the identity would not reveal the second write. Like git we do not trust such an
+	//! identity until the file is older.
+	inline bool is_racily_clean(file_identity const &identity, boost::int64_t identified_ns)
+	{
+		boost::int64_t const safe = identified_ns - file_time_granularity_ns;
+		return (identity.modified_ns >= safe) || (identity.changed_ns >= safe);
+	}
+
+	namespace detail
+	{
+		char const hash_cache_magic[8] = {'F', 'S', 'H', 'A', 'S', 'H', '0', '1'};
+
+		//! five integers, the digest and a checksum that detects a record torn by a crash
+		std::size_t const hash_cache_record_size = 5 * 8 + 32 + 8;
+
+		//! FNV-1a, which unlike boost::hash gives the same result in every build
+		inline boost::uint64_t hash_cache_checksum(char const *begin, char const *end)
+		{
+			boost::uint64_t hash = 14695981039346656037ULL;
+			for (; begin != end; ++begin)
+			{
+				hash ^= static_cast<unsigned char>(*begin);
+				hash *= 1099511628211ULL;
+			}
+			return hash;
+		}
+
+		inline void serialize_hash_cache_record(file_identity const &identity, sha256_digest const &digest,
+		                                        std::vector<char> &out)
+		{
+			std::size_t const begin = out.size();
+			out.resize(begin + hash_cache_record_size);
+			char *position = out.data() + begin;
+			for (boost::uint64_t const field :
+			     {identity.device, identity.inode, identity.size, static_cast<boost::uint64_t>(identity.modified_ns),
+			      static_cast<boost::uint64_t>(identity.changed_ns)})
+			{
+				std::memcpy(position, &field, sizeof(field));
+				position += sizeof(field);
+			}
+			position = std::copy(digest.bytes.begin(), digest.bytes.end(), position);
+			boost::uint64_t const checksum = hash_cache_checksum(out.data() + begin, position);
+			std::memcpy(position, &checksum, sizeof(checksum));
+		}
+
+		//! \return none if the record is damaged
+		inline Si::optional<std::pair<file_identity, sha256_digest>> parse_hash_cache_record(char const *record)
+		{
+			char const *const checksum_position = record + hash_cache_record_size - 8;
+			boost::uint64_t checksum;
+			std::memcpy(&checksum, checksum_position, sizeof(checksum));
+			if (checksum != hash_cache_checksum(record, checksum_position))
+			{
+				return Si::none;
+			}
+			boost::uint64_t fields[5];
+			std::memcpy(fields, record, sizeof(fields));
+			file_identity const identity{fields[0], fields[1], fields[2], static_cast<boost::int64_t>(fields[3]),
+			                             static_cast<boost::int64_t>(fields[4])};
+			return std::make_pair(identity, sha256_digest(reinterpret_cast<byte const *>(record + sizeof(fields))));
+		}
+
+		inline boost::system::error_code write_all_to(int file, std::vector<char> const &data)
+		{
+			std::size_t written = 0;
+			while (written < data.size())
+			{
+				ssize_t const rc = ::write(file, data.data() + written, data.size() - written);
+				if (rc < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					return boost::system::error_code(errno, boost::system::system_category());
+				}
+				written += static_cast<std::size_t>(rc);
+			}
+			return boost::system::error_code();
+		}
+	}
+
+	//! Remembers the SHA-256 of files across restarts, so that an unchanged tree does not have to be read again. The
+	//! cache is a file of fixed size records that are only ever appended. A later record for the same file wins, and
+	//! a record torn by a crash is ignored when the file is loaded. Only the latest version of every file is kept in
+	//! memory, and the file is rewritten once most of its records are outdated, so a file that changes often does not
+	//! make the cache grow. The methods can be called from many threads.
+	struct hash_cache
+	{
+		~hash_cache()
+		{
+			if (m_file >= 0)
+			{
+				flush();
+				::close(m_file);
+			}
+		}
+
+		SILICIUM_DELETED_FUNCTION(hash_cache(hash_cache const &))
+		SILICIUM_DELETED_FUNCTION(hash_cache &operator=(hash_cache const &))
+
+		//! Loads the records of an existing cache file or creates an empty one. A file with an unknown format is left
+		//! alone and reported as an error, because it is probably something else that has been named by mistake.
+		static Si::error_or<std::unique_ptr<hash_cache>> open(boost::filesystem::path const &location)
+		{
+			std::unique_ptr<hash_cache> cache(new hash_cache(location));
+			boost::system::error_code const ec = cache->load();
+			if (ec)
+			{
+				return ec;
+			}
+			return std::move(cache);
+		}
+
+		//! A cache that is not saved anywhere, which only avoids reading files again while the process runs.
+		static std::unique_ptr<hash_cache> create_in_memory()
+		{
+			return std::unique_ptr<hash_cache>(new hash_cache(boost::filesystem::path()));
+		}
+
+		Si::optional<sha256_digest> find(file_identity const &identity)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			file_key const key(identity.device, identity.inode);
+			auto const found = m_digests.find(key);
+			if ((found == m_digests.end()) || !(found->second.first == identity))
+			{
+				++m_misses;
+				return Si::none;
+			}
+			++m_hits;
+			m_used.insert(key);
+			return found->second.second;
+		}
+
+		//! \param identified_ns when identity was taken (before the content was read), see is_racily_clean
+		//! \return false if the digest is not kept because the identity is not reliable yet
+		bool insert(file_identity const &identity, sha256_digest const &digest, boost::int64_t identified_ns)
+		{
+			if (is_racily_clean(identity, identified_ns))
+			{
+				return false;
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			file_key const key(identity.device, identity.inode);
+			m_digests[key] = std::make_pair(identity, digest);
+			m_used.insert(key);
+			if (m_file < 0)
+			{
+				return true;
+			}
+			detail::serialize_hash_cache_record(identity, digest, m_unwritten);
+			++m_records;
+			if (m_records > (2 * m_digests.size() + 1024))
+			{
+				// A watched file that changes often appends a record every time. Its old versions are dropped before
+				// they dominate the file.
+				rewrite_locked(false);
+			}
+			// a crash loses at most this many hashes
+			if (m_unwritten.size() >= (1024 * detail::hash_cache_record_size))
+			{
+				flush_locked();
+			}
+			return true;
+		}
+
+		boost::system::error_code flush()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return flush_locked();
+		}
+
+		//! Rewrites the file with only the entries that have been used since it was opened, which forgets files that
+		//! no longer exist or have changed. Nothing happens unless most of the records are stale.
+		boost::system::error_code compact()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if ((m_file < 0) || (m_records <= (2 * m_used.size() + 1024)))
+			{
+				return boost::system::error_code();
+			}
+			return rewrite_locked(true);
+		}
+
+		std::size_t size() const
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return m_digests.size();
+		}
+
+		std::size_t hits() const
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return m_hits;
+		}
+
+		std::size_t misses() const
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return m_misses;
+		}
+
+	private:
+		//! device and inode
+		typedef std::pair<boost::uint64_t, boost::uint64_t> file_key;
+
+		boost::filesystem::path m_location;
+
+		//! -1 if the cache is only in memory
+		int m_file;
+
+		mutable std::mutex m_mutex;
+		boost::unordered_map<file_key, std::pair<file_identity, sha256_digest>> m_digests;
+		boost::unordered_set<file_key> m_used;
+		std::vector<char> m_unwritten;
+
+		//! the number of records in the file including the stale ones
+		std::size_t m_records;
+
+		std::size_t m_hits;
+		std::size_t m_misses;
+
+		explicit hash_cache(boost::filesystem::path location)
+		    : m_location(std::move(location))
+		    , m_file(-1)
+		    , m_records(0)
+		    , m_hits(0)
+		    , m_misses(0)
+		{
+		}
+
+		//! Replaces the file with one record for every entry.
+		//! \param only_used forgets the entries that have not been used since the cache was opened
+		boost::system::error_code rewrite_locked(bool only_used)
+		{
+			std::vector<char> content(detail::hash_cache_magic,
+			                          detail::hash_cache_magic + sizeof(detail::hash_cache_magic));
+			for (auto const &entry : m_digests)
+			{
+				if (!only_used || m_used.count(entry.first))
+				{
+					detail::serialize_hash_cache_record(entry.second.first, entry.second.second, content);
+				}
+			}
+			// the old file stays intact until the new one is complete
+			boost::filesystem::path const temporary = m_location.string() + ".tmp";
+			int const rewritten = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (rewritten < 0)
+			{
+				return boost::system::error_code(errno, boost::system::system_category());
+			}
+			boost::system::error_code ec = detail::write_all_to(rewritten, content);
+			if (!ec && (::fsync(rewritten) != 0))
+			{
+				ec = boost::system::error_code(errno, boost::system::system_category());
+			}
+			if (!ec && (::rename(temporary.c_str(), m_location.c_str()) != 0))
+			{
+				ec = boost::system::error_code(errno, boost::system::system_category());
+			}
+			if (ec)
+			{
+				::close(rewritten);
+				::unlink(temporary.c_str());
+				return ec;
+			}
+			::close(m_file);
+			m_file = rewritten;
+			m_unwritten.clear();
+			if (only_used)
+			{
+				for (auto i = m_digests.begin(); i != m_digests.end();)
+				{
+					i = m_used.count(i->first) ? std::next(i) : m_digests.erase(i);
+				}
+			}
+			m_records = m_digests.size();
+			return boost::system::error_code();
+		}
+
+		boost::system::error_code load()
+		{
+			m_file = ::open(m_location.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+			if (m_file < 0)
+			{
+				return boost::system::error_code(errno, boost::system::system_category());
+			}
+			std::vector<char> content;
+			std::array<char, 64 * 1024> buffer;
+			for (;;)
+			{
+				ssize_t const rc = ::read(m_file, buffer.data(), buffer.size());
+				if (rc < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					return boost::system::error_code(errno, boost::system::system_category());
+				}
+				if (rc == 0)
+				{
+					break;
+				}
+				content.insert(content.end(), buffer.data(), buffer.data() + rc);
+			}
+
+			std::size_t const magic_size = sizeof(detail::hash_cache_magic);
+			std::size_t const compared = std::min(content.size(), magic_size);
+			if (!std::equal(content.begin(), content.begin() + static_cast<std::ptrdiff_t>(compared),
+			                detail::hash_cache_magic))
+			{
+				::close(m_file);
+				m_file = -1;
+				return boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+			}
+			std::size_t valid_size = magic_size;
+			if (content.size() < magic_size)
+			{
+				// new or torn while it was being created
+				valid_size = 0;
+				m_unwritten.assign(detail::hash_cache_magic, detail::hash_cache_magic + magic_size);
+			}
+			else
+			{
+				while ((content.size() - valid_size) >= detail::hash_cache_record_size)
+				{
+					Si::optional<std::pair<file_identity, sha256_digest>> const record =
+					    detail::parse_hash_cache_record(content.data() + valid_size);
+					if (!record)
+					{
+						break;
+					}
+					m_digests[file_key(record->first.device, record->first.inode)] = *record;
+					valid_size += detail::hash_cache_record_size;
+					++m_records;
+				}
+			}
+			// a damaged end is cut off, so that new records do not end up behind garbage
+			if ((::ftruncate(m_file, static_cast<off_t>(valid_size)) != 0) ||
+			    (::lseek(m_file, 0, SEEK_END) < 0))
+			{
+				return boost::system::error_code(errno, boost::system::system_category());
+			}
+			return flush_locked();
+		}
+
+		boost::system::error_code flush_locked()
+		{
+			if ((m_file < 0) || m_unwritten.empty())
+			{
+				return boost::system::error_code();
+			}
+			boost::system::error_code const ec = detail::write_all_to(m_file, m_unwritten);
+			m_unwritten.clear();
+			return ec;
+		}
+	};
+}
+#endif
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef FILESERVER_LINUX_IO_URING_ENGINE_HPP
+#define FILESERVER_LINUX_IO_URING_ENGINE_HPP
+
+#ifdef FILESERVER_HAS_IO_URING
+#include <silicium/config.hpp>
+#include <silicium/memory_range.hpp>
+#include <silicium/optional.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace fileserver
+{
+	//! Reads files and writes to sockets through an io_uring that belongs to one io_service. The operations of one
+	//! chain run in order and a chain completes with a single callback. Every chain that is started while the
+	//! io_service runs one batch of handlers goes to the kernel with the same system call. Completions are signalled
+	//! through an eventfd which the io_service waits for like for any socket.
+	//! Must only be used on the thread that runs the io_service.
+	struct io_uring_engine
+	{
+		typedef std::function<void(boost::system::error_code)> completion_handler;
+
+		//! the size of every registered buffer
+		static std::size_t const buffer_size = 64 * 1024;
+
+		//! the maximum number of operations in one chain
+		static unsigned const submission_queue_size = 256;
+
+		//! \return nullptr if the kernel does not support the operations needed, so the caller can continue without
+		static std::unique_ptr<io_uring_engine> create(boost::asio::io_service &io, std::size_t buffer_count)
+		{
+			std::unique_ptr<io_uring_engine> engine(new io_uring_engine(io));
+			if (!engine->initialize(buffer_count))
+			{
+				return nullptr;
+			}
+			return engine;
+		}
+
+		~io_uring_engine()
+		{
+			if (m_is_initialized)
+			{
+				// the kernel cancels whatever is still in flight
+				io_uring_queue_exit(&m_ring);
+			}
+			// only now that the kernel is done with them, the resources of the unfinished chains can go
+			m_pending.clear();
+		}
+
+		SILICIUM_DELETED_FUNCTION(io_uring_engine(io_uring_engine const &))
+		SILICIUM_DELETED_FUNCTION(io_uring_engine &operator=(io_uring_engine const &))
+
+		//! \return the index of a registered buffer or none if all of them are in use
+		Si::optional<unsigned> acquire_buffer()
+		{
+			if (m_free_buffers.empty())
+			{
+				return Si::none;
+			}
+			unsigned const index = m_free_buffers.back();
+			m_free_buffers.pop_back();
+			return index;
+		}
+
+		void release_buffer(unsigned index)
+		{
+			m_free_buffers.push_back(index);
+		}
+
+		char *get_buffer(unsigned index)
+		{
+			return m_buffers.data() + (index * buffer_size);
+		}
+
+		//! Collects the operations of a chain. Every operation has to transfer exactly the requested number of
+		//! bytes, otherwise the rest of the chain is cancelled and the chain fails.
+		struct chain
+		{
+			void read(int file, boost::uint64_t position, unsigned buffer, std::size_t size)
+			{
+				assert(size <= buffer_size);
+				operation added;
+				added.is_read = true;
+				added.fd = file;
+				added.position = position;
+				added.buffer = buffer;
+				added.size = size;
+				operations.emplace_back(added);
+			}
+
+			void send(int socket, Si::memory_range data)
+			{
+				operation added;
+				added.is_read = false;
+				added.fd = socket;
+				added.data = data.begin();
+				added.size = static_cast<std::size_t>(data.size());
+				operations.emplace_back(added);
+			}
+
+			bool empty() const
+			{
+				return operations.empty();
+			}
+
+		private:
+			friend struct io_uring_engine;
+
+			struct operation
+			{
+				bool is_read;
+				int fd;
+				boost::uint64_t position;
+				unsigned buffer;
+				char const *data;
+				std::size_t size;
+			};
+
+			std::vector<operation> operations;
+		};
+
+		//! \param resources owns everything that the operations refer to (buffers, files and the memory to send). It is
+		//! kept until the kernel has completed every operation, which can be long after the caller has given up on
+		//! the chain, so a coroutine that is abandoned in the middle of a transfer does not leave the kernel writing
+		//! into memory that somebody else uses.
+		void start(chain const &operations, std::shared_ptr<void> resources, completion_handler completion)
+		{
+			assert(!operations.operations.empty());
+			assert(operations.operations.size() <= submission_queue_size);
+			if (io_uring_sq_space_left(&m_ring) < operations.operations.size())
+			{
+				// a chain must not be split across system calls
+				submit();
+			}
+			boost::uint64_t const id = m_next_chain_id++;
+			pending &started = m_pending[id];
+			started.remaining = operations.operations.size();
+			started.resources = std::move(resources);
+			started.completion = std::move(completion);
+			for (std::size_t i = 0; i < operations.operations.size(); ++i)
+			{
+				chain::operation const &op = operations.operations[i];
+				io_uring_sqe *const sqe = io_uring_get_sqe(&m_ring);
+				assert(sqe);
+				if (op.is_read)
+				{
+					io_uring_prep_read_fixed(sqe, op.fd, get_buffer(op.buffer), static_cast<unsigned>(op.size),
+					                         op.position, static_cast<int>(op.buffer));
+				}
+				else
+				{
+					// MSG_WAITALL makes the kernel retry partial sends until everything is written. A send that still
+					// ends short fails and cancels the rest of the chain (see initialize).
+					io_uring_prep_send(sqe, op.fd, op.data, op.size, MSG_NOSIGNAL | MSG_WAITALL);
+				}
+				if ((i + 1) < operations.operations.size())
+				{
+					sqe->flags |= IOSQE_IO_LINK;
+				}
+				sqe->user_data = id;
+				// the operations of a chain complete in order, so the results can be checked in the same order
+				started.expected.emplace_back(static_cast<boost::int64_t>(op.size));
+			}
+			schedule_submit();
+		}
+
+		//! for monitoring
+		boost::uint64_t submit_calls() const
+		{
+			return m_submit_calls;
+		}
+
+		//! for monitoring: how often the eventfd was read, which costs a system call like a submit
+		boost::uint64_t completion_wakeups() const
+		{
+			return m_completion_wakeups;
+		}
+
+	private:
+		struct pending
+		{
+			std::size_t remaining;
+			std::vector<boost::int64_t> expected;
+			boost::system::error_code first_error;
+			std::shared_ptr<void> resources;
+			completion_handler completion;
+		};
+
+		boost::asio::io_service &m_io;
+		io_uring m_ring;
+		bool m_is_initialized;
+		std::vector<char> m_buffers;
+		std::vector<unsigned> m_free_buffers;
+		boost::asio::posix::stream_descriptor m_completion_event;
+		boost::uint64_t m_completion_event_value;
+		boost::unordered_map<boost::uint64_t, pending> m_pending;
+		boost::uint64_t m_next_chain_id;
+		bool m_is_submit_scheduled;
+		boost::uint64_t m_submit_calls;
+		boost::uint64_t m_completion_wakeups;
+
+		explicit io_uring_engine(boost::asio::io_service &io)
+		    : m_io(io)
+		    , m_is_initialized(false)
+		    , m_completion_event(io)
+		    , m_completion_event_value(0)
+		    , m_next_chain_id(0)
+		    , m_is_submit_scheduled(false)
+		    , m_submit_calls(0)
+		    , m_completion_wakeups(0)
+		{
+		}
+
+		bool initialize(std::size_t buffer_count)
+		{
+			if (io_uring_queue_init(submission_queue_size, &m_ring, 0) < 0)
+			{
+				return false;
+			}
+			m_is_initialized = true;
+
+			io_uring_probe *const probe = io_uring_get_probe_ring(&m_ring);
+			if (!probe)
+			{
+				return false;
+			}
+			// Before Linux 5.19 a send could complete short without failing, and the next operation of the chain would
+			// have sent the following bytes after a gap. There is no flag for the retrying of MSG_WAITALL, so the
+			// kernel is recognized by IORING_OP_SOCKET, which arrived in the same release.
+			bool const is_supported = io_uring_opcode_supported(probe, IORING_OP_READ_FIXED) &&
+			                          io_uring_opcode_supported(probe, IORING_OP_SEND) &&
+			                          io_uring_opcode_supported(probe, IORING_OP_SOCKET);
+			io_uring_free_probe(probe);
+			if (!is_supported)
+			{
+				return false;
+			}
+
+			m_buffers.resize(buffer_count * buffer_size);
+			std::vector<iovec> registered(buffer_count);
+			for (std::size_t i = 0; i < buffer_count; ++i)
+			{
+				registered[i].iov_base = get_buffer(static_cast<unsigned>(i));
+				registered[i].iov_len = buffer_size;
+				m_free_buffers.emplace_back(static_cast<unsigned>(i));
+			}
+			// fails when the buffers exceed RLIMIT_MEMLOCK
+			if (io_uring_register_buffers(&m_ring, registered.data(), static_cast<unsigned>(registered.size())) < 0)
+			{
+				return false;
+			}
+
+			int const event = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			if (event < 0)
+			{
+				return false;
+			}
+			m_completion_event.assign(event);
+			if (io_uring_register_eventfd(&m_ring, event) < 0)
+			{
+				return false;
+			}
+			wait_for_completions();
+			return true;
+		}
+
+		void schedule_submit()
+		{
+			if (m_is_submit_scheduled)
+			{
+				return;
+			}
+			m_is_submit_scheduled = true;
+			// the handlers that are already queued may start more chains that can go with the same system call
+			m_io.post([this]()
+			          {
+				          m_is_submit_scheduled = false;
+				          submit();
+				      });
+		}
+
+		void submit()
+		{
+			++m_submit_calls;
+			io_uring_submit(&m_ring);
+		}
+
+		void wait_for_completions()
+		{
+			m_completion_event.async_read_some(
+			    boost::asio::buffer(&m_completion_event_value, sizeof(m_completion_event_value)),
+			    [this](boost::system::error_code ec, std::size_t)
+			    {
+				    if (ec)
+				    {
+					    // the engine is being destroyed
+					    return;
+				    }
+				    ++m_completion_wakeups;
+				    handle_completions();
+				    wait_for_completions();
+				});
+		}
+
+		void handle_completions()
+		{
+			io_uring_cqe *cqe = nullptr;
+			while (io_uring_peek_cqe(&m_ring, &cqe) == 0)
+			{
+				boost::uint64_t const id = cqe->user_data;
+				boost::int64_t const result = cqe->res;
+				io_uring_cqe_seen(&m_ring, cqe);
+
+				auto const found = m_pending.find(id);
+				assert(found != m_pending.end());
+				pending &chain_state = found->second;
+				boost::int64_t const expected =
+				    chain_state.expected[chain_state.expected.size() - chain_state.remaining];
+				if (!chain_state.first_error)
+				{
+					if (result < 0)
+					{
+						chain_state.first_error =
+						    boost::system::error_code(static_cast<int>(-result), boost::system::native_ecat);
+					}
+					else if (result != expected)
+					{
+						// the file became shorter than the repository claims or the peer went away
+						chain_state.first_error = boost::asio::error::eof;
+					}
+				}
+				--chain_state.remaining;
+				if (chain_state.remaining == 0)
+				{
+					completion_handler completion = std::move(chain_state.completion);
+					boost::system::error_code const error = chain_state.first_error;
+					// releases the buffers, which the kernel does not touch any more
+					m_pending.erase(found);
+					completion(error);
+				}
+			}
+		}
+	};
+
+	//! Registered buffers that are returned to the engine on destruction. Has to be kept alive by the resources of
+	//! every chain that uses the buffers.
+	struct io_uring_buffers
+	{
+		//! Reserves up to count buffers, maybe none.
+		io_uring_buffers(io_uring_engine &engine, std::size_t count)
+		    : m_engine(engine)
+		{
+			while (m_indices.size() < count)
+			{
+				Si::optional<unsigned> const acquired = engine.acquire_buffer();
+				if (!acquired)
+				{
+					break;
+				}
+				m_indices.emplace_back(*acquired);
+			}
+		}
+
+		~io_uring_buffers()
+		{
+			for (unsigned index : m_indices)
+			{
+				m_engine.release_buffer(index);
+			}
+		}
+
+		SILICIUM_DELETED_FUNCTION(io_uring_buffers(io_uring_buffers const &))
+		SILICIUM_DELETED_FUNCTION(io_uring_buffers &operator=(io_uring_buffers const &))
+
+		std::vector<unsigned> const &indices() const
+		{
+			return m_indices;
+		}
+
+	private:
+		io_uring_engine &m_engine;
+		std::vector<unsigned> m_indices;
+	};
+}
+#endif
+
+#endif
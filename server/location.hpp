@@ -2,7 +2,10 @@
 #define FILESERVER_LOCATION_HPP
 
 #include <server/path.hpp>
+#include <server/file_identity.hpp>
 #include <silicium/variant.hpp>
+#include <memory>
+#include <vector>
 
 namespace fileserver
 {
@@ -10,11 +13,18 @@ namespace fileserver
 	{
 		path where;
 		boost::uint64_t size;
+#ifndef _WIN32
+		//! The file as it was when it was hashed. A file that is written to in place keeps its path, so only the
+		//! identity shows that the digest no longer describes the content. none if it could not be taken.
+		Si::optional<file_identity> identity;
+#endif
 	};
 
+	//! The content is immutable and shared so that a response can keep it alive while it is being sent without
+	//! copying it.
 	struct in_memory_location
 	{
-		std::vector<char> content;
+		std::shared_ptr<std::vector<char> const> content;
 	};
 
 	using location = Si::variant<file_system_location, in_memory_location>;
@@ -28,7 +38,7 @@ namespace fileserver
 			                              },
 		                                  [](in_memory_location const &memory)
 		                                  {
-			                                  return memory.content.size();
+			                                  return memory.content->size();
 			                              });
 	}
 }
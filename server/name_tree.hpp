@@ -0,0 +1,145 @@
+#ifndef FILESERVER_NAME_TREE_HPP
+#define FILESERVER_NAME_TREE_HPP
+
+#include <server/typed_reference.hpp>
+#include <server/hexadecimal.hpp>
+#include <silicium/memory_range.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string>
+
+namespace fileserver
+{
+	struct name_directory;
+
+	//! What a name refers to: a file or a directory together with the names of everything below it.
+	struct name_tree
+	{
+		typed_reference reference;
+
+		//! nullptr for a file. Directories are immutable and shared, so a changed tree only has to copy the
+		//! directories on the path to the change.
+		std::shared_ptr<name_directory const> directory;
+	};
+
+	namespace detail
+	{
+		//! Hashes a name exactly like the equal memory_range, which allows lookups without allocating.
+		struct name_hash
+		{
+			std::size_t operator()(std::string const &name) const
+			{
+				return boost::hash_range(name.begin(), name.end());
+			}
+
+			std::size_t operator()(Si::memory_range const &name) const
+			{
+				return boost::hash_range(name.begin(), name.end());
+			}
+		};
+
+		struct name_equal
+		{
+			bool operator()(std::string const &left, std::string const &right) const
+			{
+				return left == right;
+			}
+
+			bool operator()(Si::memory_range const &left, std::string const &right) const
+			{
+				return (static_cast<std::size_t>(left.size()) == right.size()) &&
+				       std::equal(left.begin(), left.end(), right.begin());
+			}
+		};
+	}
+
+	struct name_directory
+	{
+		boost::unordered_map<std::string, name_tree, detail::name_hash, detail::name_equal> entries;
+
+		name_tree const *find(Si::memory_range name) const
+		{
+			auto const found = entries.find(name, detail::name_hash(), detail::name_equal());
+			return (found == entries.end()) ? nullptr : &found->second;
+		}
+	};
+
+	namespace detail
+	{
+		//! Decodes the %XX escapes of a path segment.
+		//! \return none if the segment is malformed or does not fit into the buffer
+		template <std::size_t Capacity>
+		Si::optional<Si::memory_range> percent_decode_segment(Si::memory_range segment,
+		                                                      std::array<char, Capacity> &buffer)
+		{
+			char *out = buffer.data();
+			for (char const *in = segment.begin(); in != segment.end(); ++in)
+			{
+				if (out == (buffer.data() + buffer.size()))
+				{
+					return Si::none;
+				}
+				if (*in != '%')
+				{
+					*out++ = *in;
+					continue;
+				}
+				if ((segment.end() - in) < 3)
+				{
+					return Si::none;
+				}
+				Si::optional<unsigned char> const high = decode_ascii_hex_digit(in[1]);
+				Si::optional<unsigned char> const low = decode_ascii_hex_digit(in[2]);
+				if (!high || !low)
+				{
+					return Si::none;
+				}
+				*out++ = static_cast<char>((*high << 4u) | *low);
+				in += 2;
+			}
+			return Si::make_memory_range(buffer.data(), out);
+		}
+	}
+
+	//! Follows a path of names separated by slashes from a directory. Empty segments are skipped, so the empty path
+	//! is the directory itself. The segments may be percent-encoded. Nothing is allocated.
+	//! \return nullptr if there is nothing with that name
+	inline name_tree const *resolve_name(name_tree const &root, Si::memory_range path)
+	{
+		name_tree const *current = &root;
+		char const *position = path.begin();
+		while (position != path.end())
+		{
+			char const *const segment_end = std::find(position, path.end(), '/');
+			Si::memory_range const segment = Si::make_memory_range(position, segment_end);
+			position = (segment_end == path.end()) ? segment_end : (segment_end + 1);
+			if (segment.empty())
+			{
+				continue;
+			}
+			if (!current->directory)
+			{
+				// a file has no entries
+				return nullptr;
+			}
+			// longer names are not allowed by any of the common file systems anyway
+			std::array<char, 255> decoded_buffer;
+			Si::optional<Si::memory_range> const decoded = detail::percent_decode_segment(segment, decoded_buffer);
+			if (!decoded)
+			{
+				return nullptr;
+			}
+			current = current->directory->find(*decoded);
+			if (!current)
+			{
+				return nullptr;
+			}
+		}
+		return current;
+	}
+}
+
+#endif
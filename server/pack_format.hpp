@@ -0,0 +1,167 @@
+#ifndef FILESERVER_PACK_FORMAT_HPP
+#define FILESERVER_PACK_FORMAT_HPP
+
+#include <server/batch_format.hpp>
+#include <server/name_tree.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+// A pack contains everything below a directory in one response, so that a clone does not pay a round trip for every
+// object. The request is a GET of /pack/ followed by the 64 hexadecimal digits of the listing. Every object of the
+// tree is sent once, introduced by a line with its digest, its type and its size in bytes:
+//
+//     <64 hex digits> <type> <size>\n<size bytes of content><64 hex digits> <type> <size>\n...
+//
+// All listings come before all blobs, and a listing comes after a listing that refers to it. When a blob arrives, the
+// client therefore already knows every name it has in the tree and can write it to its final place right away.
+
+namespace fileserver
+{
+	char const pack_request_prefix[] = "/pack/";
+	char const pack_content_type[] = "application/x-fileserver-pack";
+
+	//! \return the digest of the requested listing, or none if the target is not a pack
+	inline Si::optional<sha256_digest> parse_pack_target(Si::memory_range target)
+	{
+		std::size_t const prefix_length = sizeof(pack_request_prefix) - 1;
+		if ((static_cast<std::size_t>(target.size()) < prefix_length) ||
+		    !std::equal(pack_request_prefix, pack_request_prefix + prefix_length, target.begin()))
+		{
+			return Si::none;
+		}
+		return parse_sha256_digest(Si::make_memory_range(target.begin() + prefix_length, target.end()));
+	}
+
+	inline std::string format_pack_object_header(typed_reference const &object, boost::uint64_t size)
+	{
+		std::string formatted;
+		boost::iterator_range<byte const *> const digits = get_digest_digits(object.referenced);
+		encode_ascii_hex_digits(digits.begin(), digits.end(), std::back_inserter(formatted));
+		formatted += ' ';
+		formatted.append(object.type.begin(), object.type.end());
+		formatted += ' ';
+		formatted += boost::lexical_cast<std::string>(size);
+		formatted += '\n';
+		return formatted;
+	}
+
+	struct pack_object_header
+	{
+		unknown_digest digest;
+		std::string type;
+		boost::uint64_t size;
+	};
+
+	//! \param line without the line break
+	inline Si::optional<pack_object_header> parse_pack_object_header(Si::memory_range line)
+	{
+		char const *const first_space = std::find(line.begin(), line.end(), ' ');
+		if (first_space == line.end())
+		{
+			return Si::none;
+		}
+		char const *const second_space = std::find(first_space + 1, line.end(), ' ');
+		if ((second_space == line.end()) || (second_space == (first_space + 1)))
+		{
+			return Si::none;
+		}
+		Si::optional<unknown_digest> digest = parse_digest(Si::make_memory_range(line.begin(), first_space));
+		if (!digest || digest->empty())
+		{
+			return Si::none;
+		}
+		Si::optional<boost::uint64_t> const size =
+		    detail::parse_decimal_size(Si::make_memory_range(second_space + 1, line.end()));
+		if (!size)
+		{
+			return Si::none;
+		}
+		return pack_object_header{std::move(*digest), std::string(first_space + 1, second_space), *size};
+	}
+
+	namespace detail
+	{
+		inline sha256_digest const &get_sha256_digest(typed_reference const &reference)
+		{
+			return Si::visit<sha256_digest const &>(reference.referenced,
+			                                        [](sha256_digest const &digest) -> sha256_digest const &
+			                                        {
+				                                        return digest;
+				                                    });
+		}
+	}
+
+	//! The directories of a tree by the digests of their listings, because a pack can be requested for any listing.
+	//! Built once per tree so that a request does not have to search the tree. The pointers are valid for as long as
+	//! the tree.
+	typedef boost::unordered_map<sha256_digest, name_tree const *, sha256_digest_hash> directory_index;
+
+	inline directory_index index_directories(name_tree const &root)
+	{
+		directory_index index;
+		std::vector<name_tree const *> pending(1, &root);
+		while (!pending.empty())
+		{
+			name_tree const &current = *pending.back();
+			pending.pop_back();
+			if (!current.directory)
+			{
+				continue;
+			}
+			if (!index.insert(std::make_pair(detail::get_sha256_digest(current.reference), &current)).second)
+			{
+				// an equal listing has equal entries, which are already in the index
+				continue;
+			}
+			for (auto const &entry : current.directory->entries)
+			{
+				pending.emplace_back(&entry.second);
+			}
+		}
+		return index;
+	}
+
+	//! \return nullptr if the tree contains no directory with that digest
+	inline name_tree const *find_directory(directory_index const &index, sha256_digest const &digest)
+	{
+		auto const found = index.find(digest);
+		return (found == index.end()) ? nullptr : found->second;
+	}
+
+	//! \return the objects of a directory and of everything below it in the order of a pack, each digest once
+	inline std::vector<typed_reference const *> plan_pack(name_tree const &directory)
+	{
+		assert(directory.directory);
+		boost::unordered_set<sha256_digest, sha256_digest_hash> seen;
+		std::vector<typed_reference const *> listings;
+		std::vector<typed_reference const *> blobs;
+		std::vector<name_tree const *> unvisited(1, &directory);
+		seen.insert(detail::get_sha256_digest(directory.reference));
+		listings.emplace_back(&directory.reference);
+		while (!unvisited.empty())
+		{
+			name_tree const &current = *unvisited.back();
+			unvisited.pop_back();
+			for (auto const &entry : current.directory->entries)
+			{
+				if (!seen.insert(detail::get_sha256_digest(entry.second.reference)).second)
+				{
+					continue;
+				}
+				if (entry.second.directory)
+				{
+					listings.emplace_back(&entry.second.reference);
+					unvisited.emplace_back(&entry.second);
+				}
+				else
+				{
+					blobs.emplace_back(&entry.second.reference);
+				}
+			}
+		}
+		listings.insert(listings.end(), blobs.begin(), blobs.end());
+		return listings;
+	}
+}
+
+#endif
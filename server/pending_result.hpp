@@ -0,0 +1,76 @@
+#ifndef FILESERVER_PENDING_RESULT_HPP
+#define FILESERVER_PENDING_RESULT_HPP
+
+#include <silicium/observable/erased_observer.hpp>
+#include <silicium/optional.hpp>
+#include <functional>
+#include <memory>
+#include <cassert>
+
+namespace fileserver
+{
+	//! An observable for the result of an operation that has already been started. The operation can finish before
+	//! or after somebody asks for the result, which allows a coroutine to do something else in the meantime.
+	//! The completion and the observer are expected to be used on the same thread.
+	template <class Element>
+	struct pending_result
+	{
+		typedef Element element_type;
+
+		pending_result()
+		    : m_state(std::make_shared<state>())
+		{
+		}
+
+		//! The returned function has to be called once with the result of the operation. It can outlive the
+		//! pending_result.
+		std::function<void(Element)> completion() const
+		{
+			std::shared_ptr<state> const completed = m_state;
+			return [completed](Element result)
+			{
+				completed->complete(std::move(result));
+			};
+		}
+
+		template <class Observer>
+		void async_get_one(Observer &&observer)
+		{
+			assert(!m_state->waiting);
+			if (m_state->result)
+			{
+				Element result = std::move(*m_state->result);
+				m_state->result = Si::none;
+				std::forward<Observer>(observer).got_element(std::move(result));
+				return;
+			}
+			m_state->waiting = Si::erased_observer<Element>(std::forward<Observer>(observer));
+		}
+
+	private:
+		struct state
+		{
+			Si::optional<Element> result;
+			Si::optional<Si::erased_observer<Element>> waiting;
+
+			void complete(Element completed)
+			{
+				assert(!result);
+				if (waiting)
+				{
+					Si::erased_observer<Element> receiver = std::move(*waiting);
+					waiting = Si::none;
+					receiver.got_element(std::move(completed));
+				}
+				else
+				{
+					result = std::move(completed);
+				}
+			}
+		};
+
+		std::shared_ptr<state> m_state;
+	};
+}
+
+#endif
@@ -3,9 +3,12 @@
 
 #include <boost/asio/io_service.hpp>
 #include <silicium/utility.hpp>
+#include <atomic>
 
 namespace fileserver
 {
+	//! Runs work on a fixed number of threads. Work that is submitted while every thread is busy waits in a queue, so
+	//! the concurrency is bounded no matter how much work arrives.
 	template <class ThreadingAPI>
 	struct pool_executor
 	{
@@ -19,10 +22,10 @@ namespace fileserver
 			for (std::size_t i = 0; i < threads; ++i)
 			{
 				boost::asio::io_service &queue = m_immovable->m_work_queue;
-				m_workers.emplace_back(ThreadingAPI::launch_async([&queue]
-				                                                  {
-					                                                  queue.run();
-					                                              }));
+				m_immovable->m_workers.emplace_back(ThreadingAPI::launch_async([&queue]
+				                                                               {
+					                                                               run_worker(queue);
+					                                                           }));
 			}
 		}
 
@@ -30,23 +33,88 @@ namespace fileserver
 		void submit(Action &&work)
 		{
 			assert(m_immovable);
-			m_immovable->m_work_queue.post(std::forward<Action>(work));
+			immovable &state = *m_immovable;
+			++state.m_queue_depth;
+			state.m_work_queue.post(counted_work<typename std::decay<Action>::type>{state, std::forward<Action>(work)});
+		}
+
+		std::size_t thread_count() const
+		{
+			return m_immovable ? m_immovable->m_workers.size() : 0;
+		}
+
+		//! The number of submitted actions that have not finished yet, including the ones that are running.
+		std::size_t queue_depth() const
+		{
+			return m_immovable ? m_immovable->m_queue_depth.load() : 0;
 		}
 
 	private:
+		static void run_worker(boost::asio::io_service &queue)
+		{
+			for (;;)
+			{
+				try
+				{
+					queue.run();
+					return;
+				}
+				catch (...)
+				{
+					// An action that throws has nobody to report to. The thread goes on with the rest of the queue
+					// instead of leaving the pool with one worker less.
+				}
+			}
+		}
+
 		struct immovable
 		{
 			boost::asio::io_service m_work_queue;
-			boost::asio::io_service::work m_waiting_for_work;
+			std::unique_ptr<boost::asio::io_service::work> m_waiting_for_work;
+			std::atomic<std::size_t> m_queue_depth;
+			std::vector<typename ThreadingAPI::template future<void>::type> m_workers;
 
 			immovable()
-			    : m_waiting_for_work(m_work_queue)
+			    : m_waiting_for_work(Si::make_unique<boost::asio::io_service::work>(m_work_queue))
+			    , m_queue_depth(0)
 			{
 			}
+
+			~immovable()
+			{
+				// the workers finish the queued work and return as soon as the queue is empty
+				m_waiting_for_work.reset();
+				for (auto &worker : m_workers)
+				{
+					worker.get();
+				}
+			}
+		};
+
+		template <class Action>
+		struct counted_work
+		{
+			immovable &state;
+			Action work;
+
+			void operator()()
+			{
+				// the action counts as finished even if it throws
+				struct finish
+				{
+					std::atomic<std::size_t> &queue_depth;
+
+					~finish()
+					{
+						--queue_depth;
+					}
+				};
+				finish const finishing = {state.m_queue_depth};
+				work();
+			}
 		};
 
 		std::unique_ptr<immovable> m_immovable;
-		std::vector<typename ThreadingAPI::template future<void>::type> m_workers;
 	};
 }
 
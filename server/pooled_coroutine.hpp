@@ -0,0 +1,139 @@
+#ifndef FILESERVER_POOLED_COROUTINE_HPP
+#define FILESERVER_POOLED_COROUTINE_HPP
+
+#include <server/stack_pool.hpp>
+#include <silicium/optional.hpp>
+#include <boost/coroutine/asymmetric_coroutine.hpp>
+#include <cassert>
+#include <type_traits>
+
+namespace fileserver
+{
+	namespace detail
+	{
+		struct pooled_coroutine
+		{
+			typedef boost::coroutines::asymmetric_coroutine<void> coroutine_type;
+
+			coroutine_type::push_type resumable;
+			coroutine_type::pull_type *suspension;
+			bool is_running;
+
+			pooled_coroutine()
+			    : suspension(nullptr)
+			    , is_running(false)
+			{
+			}
+
+			//! Runs the coroutine until it waits for something or returns. The state is destroyed when the coroutine
+			//! has returned, which gives its stack back to the pool.
+			void resume()
+			{
+				assert(!is_running);
+				is_running = true;
+				try
+				{
+					resumable();
+				}
+				catch (...)
+				{
+					delete this;
+					throw;
+				}
+				is_running = false;
+				if (!resumable)
+				{
+					delete this;
+				}
+			}
+
+			void suspend()
+			{
+				assert(is_running);
+				is_running = false;
+				(*suspension)();
+			}
+		};
+
+		template <class Element>
+		struct resuming_observer
+		{
+			typedef Element element_type;
+
+			Si::optional<Element> *result;
+			bool *has_completed;
+			pooled_coroutine *coroutine;
+
+			void got_element(Element value)
+			{
+				*result = std::move(value);
+				complete();
+			}
+
+			void ended()
+			{
+				complete();
+			}
+
+		private:
+			void complete()
+			{
+				*has_completed = true;
+				// the observable may complete immediately while the coroutine is still asking for the element
+				if (!coroutine->is_running)
+				{
+					coroutine->resume();
+				}
+			}
+		};
+	}
+
+	//! What a coroutine started by spawn_pooled_coroutine gets instead of a Si::spawn_context. It waits for
+	//! observables the same way, so the session code does not care how its coroutine has been started.
+	struct pooled_coroutine_context
+	{
+		explicit pooled_coroutine_context(detail::pooled_coroutine &coroutine)
+		    : m_coroutine(&coroutine)
+		{
+		}
+
+		//! \return none if the observable has ended
+		template <class Observable>
+		Si::optional<typename std::decay<Observable>::type::element_type> get_one(Observable &&from)
+		{
+			typedef typename std::decay<Observable>::type::element_type element_type;
+			Si::optional<element_type> result;
+			bool has_completed = false;
+			from.async_get_one(detail::resuming_observer<element_type>{&result, &has_completed, m_coroutine});
+			while (!has_completed)
+			{
+				m_coroutine->suspend();
+			}
+			return result;
+		}
+
+	private:
+		detail::pooled_coroutine *m_coroutine;
+	};
+
+	//! Starts a coroutine on a stack from the pool. The coroutine runs until it waits for the first time before this
+	//! function returns. It is resumed by whatever it waits for, so the caller does not have to keep anything alive
+	//! except for the pool.
+	template <class Function>
+	void spawn_pooled_coroutine(stack_pool &stacks, Function body)
+	{
+		typedef detail::pooled_coroutine::coroutine_type coroutine_type;
+		detail::pooled_coroutine *const started = new detail::pooled_coroutine();
+		started->resumable = coroutine_type::push_type(
+		    [started, body](coroutine_type::pull_type &suspension) mutable
+		    {
+			    started->suspension = &suspension;
+			    pooled_coroutine_context context(*started);
+			    body(context);
+			},
+		    boost::coroutines::attributes(stacks.mapping_size()), pooled_stack_allocator{&stacks});
+		started->resume();
+	}
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef FILESERVER_POSITIONAL_READ_HPP
+#define FILESERVER_POSITIONAL_READ_HPP
+
+#include <silicium/error_or.hpp>
+#include <silicium/file_handle.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace fileserver
+{
+	//! Reads from an absolute position without moving the file pointer, so that the same file can be read from
+	//! several threads at once.
+	inline Si::error_or<std::size_t> read_at(Si::native_file_descriptor file, boost::uint64_t position,
+	                                         char *destination, std::size_t size)
+	{
+#ifdef _WIN32
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(position);
+		overlapped.OffsetHigh = static_cast<DWORD>(position >> 32u);
+		DWORD read = 0;
+		DWORD const piece =
+		    static_cast<DWORD>(std::min(size, static_cast<std::size_t>(std::numeric_limits<DWORD>::max())));
+		if (!ReadFile(file, destination, piece, &read, &overlapped))
+		{
+			DWORD const error = GetLastError();
+			if (error == ERROR_HANDLE_EOF)
+			{
+				return std::size_t(0);
+			}
+			return boost::system::error_code(error, boost::system::native_ecat);
+		}
+		return std::size_t(read);
+#else
+		for (;;)
+		{
+			ssize_t const rc = pread(file, destination, size, static_cast<off_t>(position));
+			if (rc < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return boost::system::error_code(errno, boost::system::native_ecat);
+			}
+			return static_cast<std::size_t>(rc);
+		}
+#endif
+	}
+
+	//! Like read_at, but only returns less than size bytes when the end of the file has been reached.
+	inline Si::error_or<std::size_t> read_fully_at(Si::native_file_descriptor file, boost::uint64_t position,
+	                                               char *destination, std::size_t size)
+	{
+		std::size_t total_read = 0;
+		while (total_read < size)
+		{
+			Si::error_or<std::size_t> const read =
+			    read_at(file, position + total_read, destination + total_read, size - total_read);
+			if (read.is_error())
+			{
+				return read.error();
+			}
+			if (read.get() == 0)
+			{
+				break;
+			}
+			total_read += read.get();
+		}
+		return total_read;
+	}
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef FILESERVER_RECYCLING_POOL_HPP
+#define FILESERVER_RECYCLING_POOL_HPP
+
+#include <memory>
+#include <vector>
+
+namespace fileserver
+{
+	//! Keeps objects that are no longer needed for the next user, so that an object and whatever it owns (sockets,
+	//! buffers, timers) is created once instead of once per use. Must only be used on one thread.
+	template <class Element>
+	struct recycling_pool
+	{
+		//! \param max_idle how many unused objects are kept, the rest is destroyed
+		explicit recycling_pool(std::size_t max_idle)
+		    : m_max_idle(max_idle)
+		{
+		}
+
+		//! \param create is called if there is no unused object
+		template <class Create>
+		std::unique_ptr<Element> acquire(Create &&create)
+		{
+			if (m_idle.empty())
+			{
+				return std::forward<Create>(create)();
+			}
+			std::unique_ptr<Element> reused = std::move(m_idle.back());
+			m_idle.pop_back();
+			return reused;
+		}
+
+		//! The caller is responsible for resetting the state that must not be seen by the next user.
+		void release(std::unique_ptr<Element> element)
+		{
+			if (m_idle.size() < m_max_idle)
+			{
+				m_idle.emplace_back(std::move(element));
+			}
+		}
+
+		std::size_t idle() const
+		{
+			return m_idle.size();
+		}
+
+	private:
+		std::size_t m_max_idle;
+		std::vector<std::unique_ptr<Element>> m_idle;
+	};
+}
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef FILESERVER_REQUEST_HEADER_HPP
+#define FILESERVER_REQUEST_HEADER_HPP
+
+#include <silicium/memory_range.hpp>
+#include <silicium/optional.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace fileserver
+{
+	//! The parts of an HTTP request header that the server looks at. Every range points into the parsed buffer, so
+	//! parsing does not allocate anything. Other header fields are skipped.
+	struct request_header
+	{
+		Si::memory_range method;
+		Si::memory_range target;
+		Si::memory_range http_version;
+		Si::optional<Si::memory_range> connection;
+		Si::optional<Si::memory_range> content_length;
+		Si::optional<Si::memory_range> transfer_encoding;
+		Si::optional<Si::memory_range> range;
+		Si::optional<Si::memory_range> if_none_match;
+		Si::optional<Si::memory_range> if_range;
+	};
+
+	enum class request_parse_status
+	{
+		complete,
+		incomplete,
+		malformed
+	};
+
+	struct request_parse_result
+	{
+		request_parse_status status;
+
+		//! only valid if complete
+		request_header header;
+
+		//! the number of bytes including the empty line at the end, only valid if complete
+		std::size_t length;
+	};
+
+	namespace detail
+	{
+		inline char to_lower_ascii(char c)
+		{
+			return ((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c - 'A' + 'a') : c;
+		}
+
+		inline bool equals_ignoring_case(Si::memory_range text, char const *lower_case)
+		{
+			std::size_t const length = std::strlen(lower_case);
+			if (static_cast<std::size_t>(text.size()) != length)
+			{
+				return false;
+			}
+			return std::equal(text.begin(), text.end(), lower_case, [](char left, char right)
+			                  {
+				                  return to_lower_ascii(left) == right;
+				              });
+		}
+
+		inline Si::memory_range trim_whitespace(Si::memory_range text)
+		{
+			char const *begin = text.begin();
+			char const *end = text.end();
+			while ((begin != end) && ((*begin == ' ') || (*begin == '\t')))
+			{
+				++begin;
+			}
+			while ((begin != end) && ((end[-1] == ' ') || (end[-1] == '\t')))
+			{
+				--end;
+			}
+			return Si::make_memory_range(begin, end);
+		}
+
+		inline bool parse_request_line(Si::memory_range line, request_header &header)
+		{
+			char const *const method_end = std::find(line.begin(), line.end(), ' ');
+			if ((method_end == line.begin()) || (method_end == line.end()))
+			{
+				return false;
+			}
+			char const *const target_end = std::find(method_end + 1, line.end(), ' ');
+			if ((target_end == (method_end + 1)) || (target_end == line.end()))
+			{
+				return false;
+			}
+			if ((target_end + 1) == line.end() || (std::find(target_end + 1, line.end(), ' ') != line.end()))
+			{
+				return false;
+			}
+			header.method = Si::make_memory_range(line.begin(), method_end);
+			header.target = Si::make_memory_range(method_end + 1, target_end);
+			header.http_version = Si::make_memory_range(target_end + 1, line.end());
+			return true;
+		}
+
+		inline bool parse_header_field(Si::memory_range line, request_header &header)
+		{
+			char const *const colon = std::find(line.begin(), line.end(), ':');
+			if ((colon == line.begin()) || (colon == line.end()))
+			{
+				return false;
+			}
+			Si::memory_range const name = Si::make_memory_range(line.begin(), colon);
+			// whitespace before the colon and obsolete line folding are not allowed by RFC 7230
+			if (std::find_if(name.begin(), name.end(), [](char c)
+			                 {
+				                 return (c == ' ') || (c == '\t');
+				             }) != name.end())
+			{
+				return false;
+			}
+			Si::memory_range const value = trim_whitespace(Si::make_memory_range(colon + 1, line.end()));
+			struct known_field
+			{
+				char const *name;
+				Si::optional<Si::memory_range> request_header::*value;
+			};
+			static known_field const known[] = {{"connection", &request_header::connection},
+			                                    {"content-length", &request_header::content_length},
+			                                    {"transfer-encoding", &request_header::transfer_encoding},
+			                                    {"range", &request_header::range},
+			                                    {"if-none-match", &request_header::if_none_match},
+			                                    {"if-range", &request_header::if_range}};
+			for (known_field const &field : known)
+			{
+				if (equals_ignoring_case(name, field.name))
+				{
+					header.*field.value = value;
+					break;
+				}
+			}
+			return true;
+		}
+	}
+
+	//! Parses the header at the beginning of the buffer. Whatever follows the header is not touched, so pipelined
+	//! requests can stay in the buffer.
+	inline request_parse_result parse_request_header(Si::memory_range buffer)
+	{
+		request_parse_result result;
+		result.status = request_parse_status::incomplete;
+		result.length = 0;
+		char const *line_begin = buffer.begin();
+		bool is_first_line = true;
+		for (;;)
+		{
+			char const *const line_feed = std::find(line_begin, buffer.end(), '\n');
+			if (line_feed == buffer.end())
+			{
+				return result;
+			}
+			char const *line_end = line_feed;
+			// a bare line feed is accepted as recommended by RFC 7230
+			if ((line_end != line_begin) && (line_end[-1] == '\r'))
+			{
+				--line_end;
+			}
+			Si::memory_range const line = Si::make_memory_range(line_begin, line_end);
+			line_begin = line_feed + 1;
+			if (is_first_line)
+			{
+				if (line.empty())
+				{
+					// empty lines before the request line are allowed
+					continue;
+				}
+				if (!detail::parse_request_line(line, result.header))
+				{
+					result.status = request_parse_status::malformed;
+					return result;
+				}
+				is_first_line = false;
+				continue;
+			}
+			if (line.empty())
+			{
+				result.status = request_parse_status::complete;
+				result.length = static_cast<std::size_t>(line_begin - buffer.begin());
+				return result;
+			}
+			if (!detail::parse_header_field(line, result.header))
+			{
+				result.status = request_parse_status::malformed;
+				return result;
+			}
+		}
+	}
+
+	//! \return true if a comma separated header value like the one of Connection contains the token
+	inline bool has_list_token(Si::memory_range list, char const *lower_case_token)
+	{
+		char const *element_begin = list.begin();
+		for (;;)
+		{
+			char const *const element_end = std::find(element_begin, list.end(), ',');
+			if (detail::equals_ignoring_case(detail::trim_whitespace(Si::make_memory_range(element_begin, element_end)),
+			                                 lower_case_token))
+			{
+				return true;
+			}
+			if (element_end == list.end())
+			{
+				return false;
+			}
+			element_begin = element_end + 1;
+		}
+	}
+
+	inline bool is_persistent_connection(request_header const &header)
+	{
+		if ((header.content_length && !detail::equals_ignoring_case(*header.content_length, "0")) ||
+		    header.transfer_encoding)
+		{
+			// we do not read request bodies, so the next request would not start where we expect it
+			return false;
+		}
+		if (detail::equals_ignoring_case(header.http_version, "http/1.0"))
+		{
+			return header.connection && has_list_token(*header.connection, "keep-alive");
+		}
+		return !header.connection || !has_list_token(*header.connection, "close");
+	}
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef FILESERVER_REQUEST_TARGET_HPP
+#define FILESERVER_REQUEST_TARGET_HPP
+
+#include <server/digest.hpp>
+#include <silicium/memory_range.hpp>
+#include <silicium/variant.hpp>
+#include <boost/range/algorithm/equal.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace fileserver
+{
+	//! Content is referenced either by its digest or by a path of names. The path points into the request target and is
+	//! still percent-encoded.
+	typedef Si::variant<sha256_digest, Si::memory_range> any_reference;
+
+	struct get_request
+	{
+		any_reference what;
+	};
+
+	struct browse_request
+	{
+		any_reference what;
+	};
+
+	typedef Si::variant<browse_request, get_request> parsed_request;
+
+	namespace detail
+	{
+		inline bool is_path_segment(Si::memory_range segment, char const *expected)
+		{
+			return boost::range::equal(segment, boost::make_iterator_range(expected, expected + std::strlen(expected)));
+		}
+
+		//! Splits off the next segment of a path which starts after a slash.
+		inline Si::memory_range next_path_segment(char const *&position, char const *end)
+		{
+			char const *const segment_end = std::find(position, end, '/');
+			Si::memory_range const segment = Si::make_memory_range(position, segment_end);
+			position = (segment_end == end) ? end : (segment_end + 1);
+			return segment;
+		}
+
+		inline Si::optional<any_reference> parse_any_reference(char const *position, char const *end)
+		{
+			if (position == end)
+			{
+				return any_reference{Si::memory_range()};
+			}
+			Si::memory_range const kind = next_path_segment(position, end);
+			if (is_path_segment(kind, "name"))
+			{
+				// the rest of the target is the path to resolve
+				return any_reference{Si::make_memory_range(position, end)};
+			}
+			if (is_path_segment(kind, "hash"))
+			{
+				Si::optional<sha256_digest> const digest = parse_sha256_digest(next_path_segment(position, end));
+				if (!digest)
+				{
+					return Si::none;
+				}
+				return any_reference{*digest};
+			}
+			return Si::none;
+		}
+	}
+
+	//! Understands "/get/..." and "/browse/..." followed by "hash/<64 hex digits>", "name/<path>" or nothing. The query
+	//! is ignored. Nothing is allocated.
+	inline Si::optional<parsed_request> parse_request_target(Si::memory_range target)
+	{
+		char const *const end = std::find(target.begin(), target.end(), '?');
+		char const *position = target.begin();
+		if ((position == end) || (*position != '/'))
+		{
+			return Si::none;
+		}
+		++position;
+		Si::memory_range const verb = detail::next_path_segment(position, end);
+		bool const is_get = detail::is_path_segment(verb, "get");
+		if (!is_get && !detail::is_path_segment(verb, "browse"))
+		{
+			return Si::none;
+		}
+		Si::optional<any_reference> reference = detail::parse_any_reference(position, end);
+		if (!reference)
+		{
+			return Si::none;
+		}
+		if (is_get)
+		{
+			return parsed_request{get_request{std::move(*reference)}};
+		}
+		return parsed_request{browse_request{std::move(*reference)}};
+	}
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef FILESERVER_RESPONSE_HEADERS_HPP
+#define FILESERVER_RESPONSE_HEADERS_HPP
+
+#include <server/entity_tag.hpp>
+#include <silicium/memory_range.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace fileserver
+{
+	//! The parts of a response header that depend only on the content. They are serialized once per digest so that
+	//! answering a request for the complete content is only a matter of copying bytes.
+	struct cached_response_headers
+	{
+		std::string entity_tag;
+
+		//! The status line and the headers of a 200 response without Cache-Control, Connection and the final line.
+		std::string ok;
+	};
+
+	inline cached_response_headers make_cached_response_headers(unknown_digest const &content, boost::uint64_t size)
+	{
+		cached_response_headers result;
+		result.entity_tag = format_entity_tag(content);
+		result.ok = "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Length: ";
+		result.ok += boost::lexical_cast<std::string>(size);
+		result.ok += "\r\nETag: ";
+		result.ok += result.entity_tag;
+		result.ok += "\r\n";
+		return result;
+	}
+
+	inline char const *connection_header_value(bool keep_alive)
+	{
+		return keep_alive ? "keep-alive" : "close";
+	}
+
+	namespace detail
+	{
+		inline void append(std::vector<char> &out, char const *begin, std::size_t length)
+		{
+			out.insert(out.end(), begin, begin + length);
+		}
+
+		inline void append(std::vector<char> &out, char const *c_str)
+		{
+			append(out, c_str, std::strlen(c_str));
+		}
+
+		inline void append(std::vector<char> &out, std::string const &str)
+		{
+			append(out, str.data(), str.size());
+		}
+
+		inline void finish_response_header(std::vector<char> &out, bool is_immutable, bool keep_alive)
+		{
+			if (is_immutable)
+			{
+				append(out, "Cache-Control: ");
+				append(out, immutable_cache_control);
+				append(out, "\r\n");
+			}
+			append(out, "Connection: ");
+			append(out, connection_header_value(keep_alive));
+			append(out, "\r\n\r\n");
+		}
+	}
+
+	//! Replaces the content of out with a complete 200 header. out is meant to be reused for every request on a
+	//! connection so that its capacity is allocated only once.
+	inline void serialize_ok_header(std::vector<char> &out, cached_response_headers const &cached, bool is_immutable,
+	                                bool keep_alive)
+	{
+		out.clear();
+		detail::append(out, cached.ok);
+		detail::finish_response_header(out, is_immutable, keep_alive);
+	}
+
+	//! Replaces the content of out with a complete 304 header.
+	inline void serialize_not_modified_header(std::vector<char> &out, cached_response_headers const &cached,
+	                                          bool is_immutable, bool keep_alive)
+	{
+		out.clear();
+		detail::append(out, "HTTP/1.1 304 Not Modified\r\nETag: ");
+		detail::append(out, cached.entity_tag);
+		detail::append(out, "\r\n");
+		detail::finish_response_header(out, is_immutable, keep_alive);
+	}
+
+	inline Si::memory_range not_found_response(bool keep_alive)
+	{
+		static char const keep[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n";
+		static char const close[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		return keep_alive ? Si::make_memory_range(keep, keep + sizeof(keep) - 1)
+		                  : Si::make_memory_range(close, close + sizeof(close) - 1);
+	}
+
+	//! For a request that is understood, but not served yet.
+	inline Si::memory_range not_implemented_response(bool keep_alive)
+	{
+		static char const keep[] =
+		    "HTTP/1.1 501 Not Implemented\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n";
+		static char const close[] = "HTTP/1.1 501 Not Implemented\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		return keep_alive ? Si::make_memory_range(keep, keep + sizeof(keep) - 1)
+		                  : Si::make_memory_range(close, close + sizeof(close) - 1);
+	}
+
+	//! Tells the client to come back later when the server is over capacity.
+	inline Si::memory_range service_unavailable_response(bool keep_alive)
+	{
+		static char const keep[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\n"
+		                           "Connection: keep-alive\r\n\r\n";
+		static char const close[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\n"
+		                            "Connection: close\r\n\r\n";
+		return keep_alive ? Si::make_memory_range(keep, keep + sizeof(keep) - 1)
+		                  : Si::make_memory_range(close, close + sizeof(close) - 1);
+	}
+
+	//! The connection is closed after this response because the end of the request is unknown.
+	inline Si::memory_range bad_request_response()
+	{
+		static char const response[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		return Si::make_memory_range(response, response + sizeof(response) - 1);
+	}
+
+	//! The connection is closed after this response because the end of the request is unknown.
+	inline Si::memory_range header_too_large_response()
+	{
+		static char const response[] =
+		    "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		return Si::make_memory_range(response, response + sizeof(response) - 1);
+	}
+
+	//! For a request body without a Content-Length. The connection is closed because the end of the body is unknown.
+	inline Si::memory_range length_required_response()
+	{
+		static char const response[] = "HTTP/1.1 411 Length Required\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		return Si::make_memory_range(response, response + sizeof(response) - 1);
+	}
+
+	//! The connection is closed after this response because the body that is too large is not read.
+	inline Si::memory_range payload_too_large_response()
+	{
+		static char const response[] =
+		    "HTTP/1.1 413 Payload Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		return Si::make_memory_range(response, response + sizeof(response) - 1);
+	}
+}
+
+#endif
@@ -4,6 +4,9 @@
 #include <server/typed_reference.hpp>
 #include <server/file_repository.hpp>
 #include <server/directory_listing.hpp>
+#include <server/name_tree.hpp>
+#include <server/hash_cache.hpp>
+#include <server/sha256_engine.hpp>
 #include <silicium/error_or.hpp>
 #include <silicium/source/virtualized_source.hpp>
 #include <ventura/source/file_source.hpp>
@@ -12,91 +15,456 @@
 #include <ventura/open.hpp>
 #include <ventura/file_size.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
 
 namespace fileserver
 {
+	// only defined where the platform supports it
+	struct hash_cache;
+
 	namespace detail
 	{
-		inline Si::error_or<std::pair<typed_reference, location>> hash_file(ventura::absolute_path const &file)
+		inline sha256_digest hash_content(Si::native_file_descriptor file)
 		{
-			Si::error_or<Si::file_handle> opening = ventura::open_reading(ventura::safe_c_str(to_native_range(file)));
-			if (opening.is_error())
-			{
-				return opening.error();
-			}
-			Si::file_handle opened = opening.move_value();
-			Si::optional<boost::uintmax_t> const size = ventura::file_size(opened.handle).get();
-			if (!size)
-			{
-				// TODO: return a proper error_code for this problem
-				throw std::runtime_error("hash_file works only for regular files");
-			}
-			std::array<char, 8192> buffer;
-			auto content = Si::virtualize_source(ventura::make_file_source(
-			    opened.handle, Si::make_memory_range(buffer.data(), buffer.data() + buffer.size())));
+			// large reads keep a fast disk busy without many system calls
+			std::array<char, 64 * 1024> buffer;
+			auto content = Si::virtualize_source(
+			    ventura::make_file_source(file, Si::make_memory_range(buffer.data(), buffer.data() + buffer.size())));
 			auto hashable_content =
 			    Si::make_transforming_source(content, [&buffer](ventura::file_read_result piece)
 			                                 {
 				                                 assert(static_cast<size_t>(piece.get().size()) <= buffer.size());
 				                                 return piece.get(); // may throw
 				                             });
-			sha256_digest hashed = fileserver::sha256(hashable_content);
-			return std::make_pair(typed_reference{blob_content_type, digest{hashed}},
-			                      location{file_system_location{path(file), *size}});
+			return fileserver::sha256(hashable_content);
 		}
+
+		inline std::vector<char> read_content(Si::native_file_descriptor file)
+		{
+			std::vector<char> content;
+			std::array<char, 64 * 1024> buffer;
+			auto source =
+			    ventura::make_file_source(file, Si::make_memory_range(buffer.data(), buffer.data() + buffer.size()));
+			for (;;)
+			{
+				Si::optional<ventura::file_read_result> piece = Si::get(source);
+				if (!piece)
+				{
+					return content;
+				}
+				Si::memory_range const read = piece->get(); // may throw
+				content.insert(content.end(), read.begin(), read.end());
+			}
+		}
+
+		//! Files up to this size are read completely, so that many of them can be hashed at once in the lanes of a
+		//! SIMD register. Larger ones are hashed while they are read.
+		static boost::uintmax_t const multi_buffer_file_limit = 64 * 1024;
+
+		//! \param cache may be nullptr
+		inline std::vector<Si::error_or<std::pair<typed_reference, location>>>
+		hash_files_impl(std::vector<ventura::absolute_path> const &files, hash_cache *cache)
+		{
+			struct small_file
+			{
+				std::size_t result;
+				Si::file_handle opened;
+				std::vector<char> content;
+#ifndef _WIN32
+				Si::optional<file_identity> identity;
+#endif
+			};
+
+			std::vector<Si::error_or<std::pair<typed_reference, location>>> results;
+			results.reserve(files.size());
+			std::vector<small_file> small_files;
+#ifndef _WIN32
+			// every identity below is taken after this point
+			boost::int64_t const scan_start = current_time_ns();
+#endif
+			for (ventura::absolute_path const &file : files)
+			{
+				Si::error_or<Si::file_handle> opening =
+				    ventura::open_reading(ventura::safe_c_str(to_native_range(file)));
+				if (opening.is_error())
+				{
+					results.emplace_back(opening.error());
+					continue;
+				}
+				Si::file_handle opened = opening.move_value();
+				Si::optional<boost::uintmax_t> const size = ventura::file_size(opened.handle).get();
+				if (!size)
+				{
+					// TODO: return a proper error_code for this problem
+					throw std::runtime_error("hash_files works only for regular files");
+				}
+#ifndef _WIN32
+				// taken before the content is read, so a file that is written to while it is hashed does not match its
+				// location afterwards
+				Si::optional<file_identity> const identity = identify_file(opened.handle);
+#endif
+				auto const make_result = [&](sha256_digest const &hashed)
+				{
+#ifdef _WIN32
+					file_system_location on_disk{path(file), *size};
+#else
+					file_system_location on_disk{path(file), *size, identity};
+#endif
+					return std::make_pair(typed_reference{blob_content_type, digest{hashed}},
+					                      location{std::move(on_disk)});
+				};
+#ifndef _WIN32
+				if (cache && identity)
+				{
+					Si::optional<sha256_digest> const cached = cache->find(*identity);
+					if (cached)
+					{
+						results.emplace_back(make_result(*cached));
+						continue;
+					}
+				}
+#else
+				assert(!cache);
+#endif
+				if (*size <= multi_buffer_file_limit)
+				{
+					// the digest is filled in once all of the small files have been read
+					results.emplace_back(make_result(sha256_digest()));
+					std::vector<char> content = read_content(opened.handle);
+					small_files.emplace_back(small_file{results.size() - 1, std::move(opened), std::move(content)});
+#ifndef _WIN32
+					small_files.back().identity = identity;
+#endif
+					continue;
+				}
+				sha256_digest const hashed = hash_content(opened.handle);
+#ifndef _WIN32
+				// a file that has been written to while it was read may have been hashed half old and half new
+				if (cache && identity && (identify_file(opened.handle) == identity))
+				{
+					cache->insert(*identity, hashed, scan_start);
+				}
+#endif
+				results.emplace_back(make_result(hashed));
+			}
+
+			std::vector<Si::memory_range> contents;
+			for (small_file const &file : small_files)
+			{
+				contents.emplace_back(
+				    Si::make_memory_range(file.content.data(), file.content.data() + file.content.size()));
+			}
+			std::vector<sha256_digest> digests(small_files.size());
+			sha256_many(contents.data(), contents.size(), digests.data());
+			for (std::size_t i = 0; i < small_files.size(); ++i)
+			{
+				small_file const &file = small_files[i];
+				results[file.result].get().first.referenced = digest{digests[i]};
+#ifndef _WIN32
+				if (cache && file.identity && (identify_file(file.opened.handle) == file.identity))
+				{
+					cache->insert(*file.identity, digests[i], scan_start);
+				}
+#endif
+			}
+			return results;
+		}
+
+		//! Hashes every file on its own. A file that cannot be opened has an error instead of a result.
+		inline std::vector<Si::error_or<std::pair<typed_reference, location>>>
+		hash_files(std::vector<ventura::absolute_path> const &files)
+		{
+			return hash_files_impl(files, nullptr);
+		}
+
+#ifndef _WIN32
+		//! Like hash_files, but the digest of an unchanged file is taken from the cache instead of reading the file.
+		inline std::vector<Si::error_or<std::pair<typed_reference, location>>>
+		hash_files_with_cache(hash_cache &cache, std::vector<ventura::absolute_path> const &files)
+		{
+			return hash_files_impl(files, &cache);
+		}
+#endif
 	}
 
-	inline std::pair<file_repository, typed_reference> scan_directory(
-	    boost::filesystem::path const &root,
-	    std::function<std::pair<std::vector<char>, content_type>(directory_listing const &)> const &serialize_listing,
-	    std::function<Si::error_or<std::pair<typed_reference, location>>(ventura::absolute_path const &)> const
-	        &hash_file)
+	typedef std::function<std::pair<std::vector<char>, content_type>(directory_listing const &)> listing_serializer;
+
+	//! Hashes a batch of files. Every file has its result at the same index.
+	typedef std::function<std::vector<Si::error_or<std::pair<typed_reference, location>>>(
+	    std::vector<ventura::absolute_path> const &)> file_hasher;
+
+	namespace detail
 	{
-		file_repository repository;
-		directory_listing listing;
-		for (boost::filesystem::directory_iterator i(root); i != boost::filesystem::directory_iterator(); ++i)
+		//! Runs work right away on the calling thread, which makes a scan serial.
+		struct inline_executor
+		{
+			template <class Action>
+			void submit(Action &&work)
+			{
+				std::forward<Action>(work)();
+			}
+		};
+
+		//! A directory as it is found on the disk, before its listing can be made. The entries are sorted by name, so
+		//! the result does not depend on the order in which the directory iterator or the workers deliver things.
+		struct scanned_directory
 		{
-			auto const add_to_listing = [&listing, &i](typed_reference entry)
+			struct entry
 			{
-				listing.entries.emplace(std::make_pair(i->path().leaf().string(), std::move(entry)));
+				//! none for a directory or if the file could not be hashed
+				Si::optional<std::pair<typed_reference, location>> file;
+
+				std::unique_ptr<scanned_directory> directory;
+
+				//! the size of a file when the directory was listed, which decides how the file is hashed
+				boost::uintmax_t listed_size = 0;
 			};
-			switch (i->status().type())
+
+			std::map<std::string, entry> entries;
+		};
+
+		//! Counts the work of a scan that has not finished yet and remembers the first exception.
+		struct scan_progress
+		{
+			std::mutex mutex;
+			std::condition_variable finished;
+			std::size_t unfinished = 0;
+			std::exception_ptr error;
+
+			template <class Executor, class Action>
+			void submit(Executor &executor, Action &&work)
 			{
-			case boost::filesystem::regular_file:
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					++unfinished;
+				}
+				executor.submit([this, work]()
+				                {
+					                std::exception_ptr thrown;
+					                try
+					                {
+						                work();
+					                }
+					                catch (...)
+					                {
+						                thrown = std::current_exception();
+					                }
+					                std::unique_lock<std::mutex> lock(mutex);
+					                if (thrown && !error)
+					                {
+						                error = thrown;
+					                }
+					                --unfinished;
+					                if (unfinished == 0)
+					                {
+						                finished.notify_all();
+					                }
+					            });
+			}
+
+			void wait()
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				finished.wait(lock, [this]
+				              {
+					              return unfinished == 0;
+					          });
+				if (error)
+				{
+					std::rethrow_exception(error);
+				}
+			}
+		};
+
+		//! A batch of small files is hashed by one task, so that the files fill the lanes of sha256_many.
+		static std::size_t const hash_batch_max_files = 64;
+		static boost::uintmax_t const hash_batch_max_bytes = 1024 * 1024;
+
+		typedef std::pair<std::string const *, scanned_directory::entry *> hash_batch_entry;
+
+		//! Submits the hashing of some of the files of a directory as a single task.
+		template <class Executor>
+		void submit_hash_batch(Executor &executor, scan_progress &progress, boost::filesystem::path const &root,
+		                       std::vector<hash_batch_entry> batch, file_hasher const &hash_file)
+		{
+			progress.submit(executor, [root, batch, &hash_file]()
+			                {
+				                std::vector<ventura::absolute_path> files;
+				                for (auto const &file : batch)
+				                {
+					                files.emplace_back(*ventura::absolute_path::create(root / *file.first));
+				                }
+				                std::vector<Si::error_or<std::pair<typed_reference, location>>> hashed =
+				                    hash_file(files);
+				                assert(hashed.size() == batch.size());
+				                for (std::size_t i = 0; i < batch.size(); ++i)
+				                {
+					                if (hashed[i].is_error())
+					                {
+						                // ignore error for now
+						                continue;
+					                }
+					                batch[i].second->file = std::move(hashed[i].get());
+				                }
+				            });
+		}
+
+		//! Lists a directory and submits the hashing of its files and the listing of its subdirectories, so that all
+		//! of them run in parallel on the executor. Small files of similar size are hashed in batches.
+		template <class Executor>
+		void scan_directory_entries(Executor &executor, scan_progress &progress, boost::filesystem::path const &root,
+		                            scanned_directory &into, file_hasher const &hash_file)
+		{
+			for (boost::filesystem::directory_iterator i(root); i != boost::filesystem::directory_iterator(); ++i)
 			{
-				Si::error_or<std::pair<typed_reference, location>> hashed =
-				    hash_file(*ventura::absolute_path::create(i->path()));
-				if (hashed.is_error())
+				switch (i->status().type())
+				{
+				case boost::filesystem::regular_file:
 				{
-					// ignore error for now
+					boost::system::error_code ec;
+					boost::uintmax_t const size = boost::filesystem::file_size(i->path(), ec);
+					// a file that cannot be looked at is hashed on its own to find out what is wrong with it
+					into.entries[i->path().leaf().string()].listed_size = ec ? (multi_buffer_file_limit + 1) : size;
+					break;
+				}
+
+				case boost::filesystem::directory_file:
+					into.entries[i->path().leaf().string()].directory = Si::make_unique<scanned_directory>();
+					break;
+
+				default:
 					break;
 				}
-				repository.available[to_unknown_digest(hashed.get().first.referenced)].emplace_back(
-				    std::move(hashed.get().second));
-				add_to_listing(hashed.get().first);
-				break;
+			}
+			// every entry exists now, so the workers only write to their own entry and never to the map
+			std::vector<hash_batch_entry> small_files;
+			for (auto &entry : into.entries)
+			{
+				scanned_directory::entry *const destination = &entry.second;
+				if (destination->directory)
+				{
+					boost::filesystem::path const entry_path = root / entry.first;
+					progress.submit(executor, [&executor, &progress, entry_path, destination, &hash_file]()
+					                {
+						                scan_directory_entries(executor, progress, entry_path,
+						                                       *destination->directory, hash_file);
+						            });
+					continue;
+				}
+				if (destination->listed_size > multi_buffer_file_limit)
+				{
+					submit_hash_batch(executor, progress, root,
+					                  std::vector<hash_batch_entry>{hash_batch_entry(&entry.first, destination)},
+					                  hash_file);
+					continue;
+				}
+				small_files.emplace_back(&entry.first, destination);
 			}
 
-			case boost::filesystem::directory_file:
+			// one long file in a batch would be hashed alone while the lanes of the others are idle
+			std::stable_sort(small_files.begin(), small_files.end(),
+			                 [](hash_batch_entry const &left, hash_batch_entry const &right)
+			                 {
+				                 return left.second->listed_size < right.second->listed_size;
+				             });
+			std::vector<hash_batch_entry> batch;
+			boost::uintmax_t batch_bytes = 0;
+			for (hash_batch_entry const &file : small_files)
 			{
-				std::pair<file_repository, typed_reference> sub_dir =
-				    scan_directory(i->path(), serialize_listing, hash_file);
-				repository.merge(std::move(sub_dir.first));
-				add_to_listing(sub_dir.second);
-				break;
+				boost::uintmax_t const size = file.second->listed_size;
+				if (!batch.empty() &&
+				    ((batch.size() == hash_batch_max_files) || ((batch_bytes + size) > hash_batch_max_bytes)))
+				{
+					submit_hash_batch(executor, progress, root, std::move(batch), hash_file);
+					batch.clear();
+					batch_bytes = 0;
+				}
+				batch.emplace_back(file);
+				batch_bytes += size;
 			}
+			if (!batch.empty())
+			{
+				submit_hash_batch(executor, progress, root, std::move(batch), hash_file);
+			}
+		}
 
-			default:
-				break;
+		//! Serializes a listing, which is then served from memory.
+		inline std::pair<typed_reference, location> make_listing(directory_listing const &listing,
+		                                                         listing_serializer const &serialize_listing)
+		{
+			std::pair<std::vector<char>, content_type> typed_serialized_listing = serialize_listing(listing);
+			std::vector<char> &serialized_listing = typed_serialized_listing.first;
+			sha256_digest const listing_digest = sha256(Si::make_single_source(Si::make_iterator_range(
+			    serialized_listing.data(), serialized_listing.data() + serialized_listing.size())));
+			return std::make_pair(
+			    typed_reference(typed_serialized_listing.second, listing_digest),
+			    location{in_memory_location{std::make_shared<std::vector<char> const>(std::move(serialized_listing))}});
+		}
+
+		//! Makes the listings bottom-up once everything has been hashed.
+		inline name_tree assemble_directory(scanned_directory &scanned, file_repository &repository,
+		                                    listing_serializer const &serialize_listing)
+		{
+			directory_listing listing;
+			auto names = std::make_shared<name_directory>();
+			for (auto &entry : scanned.entries)
+			{
+				name_tree named;
+				if (entry.second.directory)
+				{
+					named = assemble_directory(*entry.second.directory, repository, serialize_listing);
+				}
+				else if (entry.second.file)
+				{
+					repository.add_entry(to_unknown_digest(entry.second.file->first.referenced))
+					    .locations.emplace_back(std::move(entry.second.file->second));
+					named = name_tree{entry.second.file->first, nullptr};
+				}
+				else
+				{
+					continue;
+				}
+				listing.entries.emplace(std::make_pair(entry.first, named.reference));
+				names->entries.emplace(std::make_pair(entry.first, std::move(named)));
 			}
+			std::pair<typed_reference, location> made = make_listing(listing, serialize_listing);
+			repository.add_entry(to_unknown_digest(made.first.referenced))
+			    .locations.emplace_back(std::move(made.second));
+			return name_tree{std::move(made.first), std::move(names)};
 		}
-		std::pair<std::vector<char>, content_type> typed_serialized_listing = serialize_listing(listing);
-		std::vector<char> &serialized_listing = typed_serialized_listing.first;
-		sha256_digest const listing_digest = sha256(Si::make_single_source(
-		    Si::make_iterator_range(serialized_listing.data(), serialized_listing.data() + serialized_listing.size())));
-		repository.available[to_unknown_digest(listing_digest)].emplace_back(
-		    location{in_memory_location{std::move(serialized_listing)}});
-		return std::make_pair(std::move(repository), typed_reference(typed_serialized_listing.second, listing_digest));
+	}
+
+	//! Hashes the files and lists the subdirectories on the executor (for example a pool_executor), so that a large
+	//! tree is scanned by every core and with many reads in flight. The result is the same as that of a serial scan.
+	//! \return the contents of the directory and the names of everything in it
+	template <class Executor>
+	std::pair<file_repository, name_tree> scan_directory(boost::filesystem::path const &root,
+	                                                     listing_serializer const &serialize_listing,
+	                                                     file_hasher const &hash_file, Executor &executor)
+	{
+		detail::scanned_directory scanned;
+		detail::scan_progress progress;
+		progress.submit(executor, [&executor, &progress, &root, &scanned, &hash_file]()
+		                {
+			                detail::scan_directory_entries(executor, progress, root, scanned, hash_file);
+			            });
+		progress.wait();
+		file_repository repository;
+		name_tree names = detail::assemble_directory(scanned, repository, serialize_listing);
+		return std::make_pair(std::move(repository), std::move(names));
+	}
+
+	//! \return the contents of the directory and the names of everything in it
+	inline std::pair<file_repository, name_tree> scan_directory(boost::filesystem::path const &root,
+	                                                            listing_serializer const &serialize_listing,
+	                                                            file_hasher const &hash_file)
+	{
+		detail::inline_executor executor;
+		return scan_directory(root, serialize_listing, hash_file, executor);
 	}
 }
 
@@ -0,0 +1,697 @@
+#ifndef FILESERVER_SHA256_ENGINE_HPP
+#define FILESERVER_SHA256_ENGINE_HPP
+
+#include <server/sha256.hpp>
+#include <silicium/config.hpp>
+#include <silicium/memory_range.hpp>
+#include <boost/cstdint.hpp>
+#include <array>
+#include <cassert>
+#include <cstring>
+
+// The SIMD implementations are selected at runtime, so they are compiled with target attributes instead of flags
+// that would let the compiler use the instructions everywhere.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define FILESERVER_HAS_X86_SHA256 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace fileserver
+{
+	enum class sha256_engine
+	{
+		//! every message on its own through OpenSSL
+		openssl,
+
+		//! every message on its own with the SHA extensions of x86
+		sha_ni,
+
+		//! eight messages at once in the lanes of AVX2 registers
+		avx2,
+
+		//! sixteen messages at once in the lanes of AVX-512 registers
+		avx512
+	};
+
+	inline char const *sha256_engine_name(sha256_engine engine)
+	{
+		switch (engine)
+		{
+		case sha256_engine::openssl:
+			return "openssl";
+		case sha256_engine::sha_ni:
+			return "sha_ni";
+		case sha256_engine::avx2:
+			return "avx2";
+		case sha256_engine::avx512:
+			return "avx512";
+		}
+		return "unknown";
+	}
+
+	namespace detail
+	{
+		static std::array<boost::uint32_t, 64> const sha256_round_constants = {
+		    {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		     0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		     0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		     0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		     0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		     0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		     0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		     0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2}};
+
+		static std::array<boost::uint32_t, 8> const sha256_initial_state = {
+		    {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}};
+
+		//! Processes whole blocks of 64 bytes.
+		typedef void sha256_compress_function(boost::uint32_t *state, byte const *blocks, std::size_t block_count);
+
+		inline boost::uint32_t load_big_endian_32(byte const *from)
+		{
+			return (static_cast<boost::uint32_t>(from[0]) << 24u) | (static_cast<boost::uint32_t>(from[1]) << 16u) |
+			       (static_cast<boost::uint32_t>(from[2]) << 8u) | static_cast<boost::uint32_t>(from[3]);
+		}
+
+		inline boost::uint32_t rotate_right(boost::uint32_t value, unsigned bits)
+		{
+			return (value >> bits) | (value << (32u - bits));
+		}
+
+		inline void sha256_compress_portable(boost::uint32_t *state, byte const *blocks, std::size_t block_count)
+		{
+			for (; block_count > 0; --block_count, blocks += 64)
+			{
+				std::array<boost::uint32_t, 64> schedule;
+				for (std::size_t i = 0; i < 16; ++i)
+				{
+					schedule[i] = load_big_endian_32(blocks + (i * 4));
+				}
+				for (std::size_t i = 16; i < 64; ++i)
+				{
+					boost::uint32_t const s0 = rotate_right(schedule[i - 15], 7) ^
+					                           rotate_right(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3u);
+					boost::uint32_t const s1 = rotate_right(schedule[i - 2], 17) ^ rotate_right(schedule[i - 2], 19) ^
+					                           (schedule[i - 2] >> 10u);
+					schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+				}
+				boost::uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5],
+				                g = state[6], h = state[7];
+				for (std::size_t i = 0; i < 64; ++i)
+				{
+					boost::uint32_t const t1 = h + (rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25)) +
+					                           ((e & f) ^ (~e & g)) + sha256_round_constants[i] + schedule[i];
+					boost::uint32_t const t2 = (rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22)) +
+					                           ((a & b) ^ (a & c) ^ (b & c));
+					h = g;
+					g = f;
+					f = e;
+					e = d + t1;
+					d = c;
+					c = b;
+					b = a;
+					a = t1 + t2;
+				}
+				state[0] += a;
+				state[1] += b;
+				state[2] += c;
+				state[3] += d;
+				state[4] += e;
+				state[5] += f;
+				state[6] += g;
+				state[7] += h;
+			}
+		}
+
+		//! Pads the end of a message as SHA-256 requires.
+		//! \return the number of blocks in tail, which is one or two
+		inline std::size_t make_sha256_tail(Si::memory_range message, std::array<byte, 128> &tail)
+		{
+			std::size_t const size = static_cast<std::size_t>(message.size());
+			std::size_t const remaining = size % 64;
+			tail.fill(0);
+			std::memcpy(tail.data(), message.end() - remaining, remaining);
+			tail[remaining] = 0x80;
+			std::size_t const blocks = ((remaining + 9) <= 64) ? 1 : 2;
+			boost::uint64_t const bits = static_cast<boost::uint64_t>(size) * 8;
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				tail[(blocks * 64) - 1 - i] = static_cast<byte>(bits >> (i * 8));
+			}
+			return blocks;
+		}
+
+		inline sha256_digest finish_sha256(boost::uint32_t const *state)
+		{
+			sha256_digest result;
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				for (std::size_t j = 0; j < 4; ++j)
+				{
+					result.bytes[(i * 4) + j] = static_cast<byte>(state[i] >> (24 - (j * 8)));
+				}
+			}
+			return result;
+		}
+
+		inline sha256_digest sha256_single(sha256_compress_function &compress, Si::memory_range message)
+		{
+			std::array<boost::uint32_t, 8> state = sha256_initial_state;
+			compress(state.data(), reinterpret_cast<byte const *>(message.begin()),
+			         static_cast<std::size_t>(message.size()) / 64);
+			std::array<byte, 128> tail;
+			std::size_t const tail_blocks = make_sha256_tail(message, tail);
+			compress(state.data(), tail.data(), tail_blocks);
+			return finish_sha256(state.data());
+		}
+
+#ifdef FILESERVER_HAS_X86_SHA256
+		struct x86_features
+		{
+			bool sha;
+			bool avx2;
+			bool avx512;
+		};
+
+		inline x86_features detect_x86_features()
+		{
+			x86_features result = {false, false, false};
+			unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+			if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+			{
+				return result;
+			}
+			bool const ssse3 = (ecx & (1u << 9)) != 0;
+			bool const sse41 = (ecx & (1u << 19)) != 0;
+			bool const os_saves_registers = (ecx & (1u << 27)) != 0;
+			bool const avx = (ecx & (1u << 28)) != 0;
+			if (__get_cpuid_max(0, nullptr) < 7)
+			{
+				return result;
+			}
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			result.sha = ((ebx & (1u << 29)) != 0) && ssse3 && sse41;
+			// the operating system has to save the wide registers on a context switch
+			unsigned saved = 0;
+			if (os_saves_registers)
+			{
+				unsigned high = 0;
+				__asm__("xgetbv" : "=a"(saved), "=d"(high) : "c"(0));
+			}
+			result.avx2 = avx && ((ebx & (1u << 5)) != 0) && ((saved & 0x06u) == 0x06u);
+			result.avx512 = ((ebx & (1u << 16)) != 0) && ((saved & 0xe6u) == 0xe6u);
+			return result;
+		}
+
+		inline x86_features const &get_x86_features()
+		{
+			static x86_features const detected = detect_x86_features();
+			return detected;
+		}
+
+		__attribute__((target("sha,sse4.1,ssse3"))) inline void
+		sha256_compress_sha_ni(boost::uint32_t *state, byte const *blocks, std::size_t block_count)
+		{
+			__m128i const byte_order = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+			// the instructions want the state as ABEF and CDGH
+			__m128i const dcba = _mm_loadu_si128(reinterpret_cast<__m128i const *>(state));
+			__m128i const hgfe = _mm_loadu_si128(reinterpret_cast<__m128i const *>(state + 4));
+			__m128i const cdab = _mm_shuffle_epi32(dcba, 0xB1);
+			__m128i const efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+			__m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+			__m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+			for (; block_count > 0; --block_count, blocks += 64)
+			{
+				__m128i const saved_abef = abef;
+				__m128i const saved_cdgh = cdgh;
+				__m128i schedule[4];
+				// unrolled, the schedule stays in registers
+#pragma GCC unroll 16
+				for (int group = 0; group < 16; ++group)
+				{
+					__m128i &words = schedule[group % 4];
+					if (group < 4)
+					{
+						words = _mm_shuffle_epi8(
+						    _mm_loadu_si128(reinterpret_cast<__m128i const *>(blocks + (group * 16))), byte_order);
+					}
+					else
+					{
+						__m128i const &previous = schedule[(group + 3) % 4];
+						__m128i const &before_previous = schedule[(group + 2) % 4];
+						words = _mm_sha256msg1_epu32(words, schedule[(group + 1) % 4]);
+						words = _mm_add_epi32(words, _mm_alignr_epi8(previous, before_previous, 4));
+						words = _mm_sha256msg2_epu32(words, previous);
+					}
+					__m128i message = _mm_add_epi32(
+					    words, _mm_loadu_si128(reinterpret_cast<__m128i const *>(&sha256_round_constants[group * 4])));
+					cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+					message = _mm_shuffle_epi32(message, 0x0E);
+					abef = _mm_sha256rnds2_epu32(abef, cdgh, message);
+				}
+				abef = _mm_add_epi32(abef, saved_abef);
+				cdgh = _mm_add_epi32(cdgh, saved_cdgh);
+			}
+			__m128i const feba = _mm_shuffle_epi32(abef, 0x1B);
+			__m128i const dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+		}
+
+		// The loads below transpose the blocks of all lanes in registers, so that word i of every block ends up in
+		// words[i]. Within every 128 bit part, the unpacks turn the rows of four lanes into columns. The remaining
+		// steps move these parts to where they belong.
+
+		__attribute__((target("avx2"))) inline void load_sha256_words_avx2(byte const *const *blocks, __m256i *words)
+		{
+			__m256i const byte_order = _mm256_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL,
+			                                             0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+			for (int half = 0; half < 2; ++half)
+			{
+				__m256i rows[8];
+				for (int lane = 0; lane < 8; ++lane)
+				{
+					rows[lane] = _mm256_shuffle_epi8(
+					    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(blocks[lane]) + half), byte_order);
+				}
+				__m256i pairs[8];
+				for (int i = 0; i < 4; ++i)
+				{
+					pairs[2 * i] = _mm256_unpacklo_epi32(rows[2 * i], rows[(2 * i) + 1]);
+					pairs[(2 * i) + 1] = _mm256_unpackhi_epi32(rows[2 * i], rows[(2 * i) + 1]);
+				}
+				// word 4 * k + j of lanes 4 * i to 4 * i + 3 is in part k of columns[4 * i + j]
+				__m256i columns[8];
+				for (int i = 0; i < 2; ++i)
+				{
+					columns[4 * i] = _mm256_unpacklo_epi64(pairs[4 * i], pairs[(4 * i) + 2]);
+					columns[(4 * i) + 1] = _mm256_unpackhi_epi64(pairs[4 * i], pairs[(4 * i) + 2]);
+					columns[(4 * i) + 2] = _mm256_unpacklo_epi64(pairs[(4 * i) + 1], pairs[(4 * i) + 3]);
+					columns[(4 * i) + 3] = _mm256_unpackhi_epi64(pairs[(4 * i) + 1], pairs[(4 * i) + 3]);
+				}
+				for (int j = 0; j < 4; ++j)
+				{
+					words[(half * 8) + j] = _mm256_permute2x128_si256(columns[j], columns[4 + j], 0x20);
+					words[(half * 8) + 4 + j] = _mm256_permute2x128_si256(columns[j], columns[4 + j], 0x31);
+				}
+			}
+		}
+
+// The AVX-512 intrinsics of GCC 12 pass an undefined vector as the unused source of a mask, which is reported as
+// uninitialized.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+		// the bit counts are template arguments, because the instructions only take immediates
+		template <int Bits>
+		__attribute__((target("avx512f"))) inline __m512i rotate_avx512(__m512i value)
+		{
+			return _mm512_ror_epi32(value, Bits);
+		}
+
+		template <unsigned Bits>
+		__attribute__((target("avx512f"))) inline __m512i shift_avx512(__m512i value)
+		{
+			return _mm512_srli_epi32(value, Bits);
+		}
+
+		__attribute__((target("avx512f"))) inline void load_sha256_words_avx512(byte const *const *blocks,
+		                                                                        __m512i *words)
+		{
+			// the byte swap only needs AVX-512F like this
+			__m512i const odd_bytes = _mm512_set1_epi32(static_cast<int>(0xff00ff00u));
+			__m512i rows[16];
+			for (int lane = 0; lane < 16; ++lane)
+			{
+				__m512i const row = _mm512_loadu_si512(blocks[lane]);
+				rows[lane] = _mm512_ternarylogic_epi32(odd_bytes, rotate_avx512<8>(row), rotate_avx512<24>(row), 0xCA);
+			}
+			__m512i pairs[16];
+			for (int i = 0; i < 8; ++i)
+			{
+				pairs[2 * i] = _mm512_unpacklo_epi32(rows[2 * i], rows[(2 * i) + 1]);
+				pairs[(2 * i) + 1] = _mm512_unpackhi_epi32(rows[2 * i], rows[(2 * i) + 1]);
+			}
+			// word 4 * k + j of lanes 4 * i to 4 * i + 3 is in part k of columns[4 * i + j]
+			__m512i columns[16];
+			for (int i = 0; i < 4; ++i)
+			{
+				columns[4 * i] = _mm512_unpacklo_epi64(pairs[4 * i], pairs[(4 * i) + 2]);
+				columns[(4 * i) + 1] = _mm512_unpackhi_epi64(pairs[4 * i], pairs[(4 * i) + 2]);
+				columns[(4 * i) + 2] = _mm512_unpacklo_epi64(pairs[(4 * i) + 1], pairs[(4 * i) + 3]);
+				columns[(4 * i) + 3] = _mm512_unpackhi_epi64(pairs[(4 * i) + 1], pairs[(4 * i) + 3]);
+			}
+			for (int j = 0; j < 4; ++j)
+			{
+				__m512i const low_01 = _mm512_shuffle_i32x4(columns[j], columns[4 + j], 0x44);
+				__m512i const low_23 = _mm512_shuffle_i32x4(columns[j], columns[4 + j], 0xEE);
+				__m512i const high_01 = _mm512_shuffle_i32x4(columns[8 + j], columns[12 + j], 0x44);
+				__m512i const high_23 = _mm512_shuffle_i32x4(columns[8 + j], columns[12 + j], 0xEE);
+				words[j] = _mm512_shuffle_i32x4(low_01, high_01, 0x88);
+				words[4 + j] = _mm512_shuffle_i32x4(low_01, high_01, 0xDD);
+				words[8 + j] = _mm512_shuffle_i32x4(low_23, high_23, 0x88);
+				words[12 + j] = _mm512_shuffle_i32x4(low_23, high_23, 0xDD);
+			}
+		}
+
+		__attribute__((target("avx2"))) inline __m256i rotate_avx2(__m256i value, int bits)
+		{
+			return _mm256_or_si256(_mm256_srli_epi32(value, bits), _mm256_slli_epi32(value, 32 - bits));
+		}
+
+		//! \param state word i of every lane is at state[i * 8]
+		__attribute__((target("avx2"))) inline void sha256_compress_lanes_avx2(boost::uint32_t *state,
+		                                                                       byte const *const *blocks)
+		{
+			auto &rotate = rotate_avx2;
+			__m256i v[8];
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				v[i] = _mm256_load_si256(reinterpret_cast<__m256i const *>(state + (i * 8)));
+			}
+			__m256i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+			__m256i schedule[16];
+			load_sha256_words_avx2(blocks, schedule);
+			for (std::size_t i = 0; i < 64; ++i)
+			{
+				__m256i word = schedule[i % 16];
+				if (i >= 16)
+				{
+					__m256i const w15 = schedule[(i - 15) % 16];
+					__m256i const w2 = schedule[(i - 2) % 16];
+					__m256i const s0 =
+					    _mm256_xor_si256(_mm256_xor_si256(rotate(w15, 7), rotate(w15, 18)), _mm256_srli_epi32(w15, 3));
+					__m256i const s1 =
+					    _mm256_xor_si256(_mm256_xor_si256(rotate(w2, 17), rotate(w2, 19)), _mm256_srli_epi32(w2, 10));
+					word = _mm256_add_epi32(_mm256_add_epi32(schedule[i % 16], s0),
+					                        _mm256_add_epi32(schedule[(i - 7) % 16], s1));
+				}
+				schedule[i % 16] = word;
+				__m256i const sigma1 = _mm256_xor_si256(_mm256_xor_si256(rotate(e, 6), rotate(e, 11)), rotate(e, 25));
+				__m256i const choice = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+				__m256i const t1 = _mm256_add_epi32(
+				    _mm256_add_epi32(h, sigma1),
+				    _mm256_add_epi32(choice, _mm256_add_epi32(word, _mm256_set1_epi32(static_cast<int>(
+				                                                        sha256_round_constants[i])))));
+				__m256i const sigma0 = _mm256_xor_si256(_mm256_xor_si256(rotate(a, 2), rotate(a, 13)), rotate(a, 22));
+				__m256i const majority =
+				    _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+				h = g;
+				g = f;
+				f = e;
+				e = _mm256_add_epi32(d, t1);
+				d = c;
+				c = b;
+				b = a;
+				a = _mm256_add_epi32(t1, _mm256_add_epi32(sigma0, majority));
+			}
+			__m256i const results[8] = {a, b, c, d, e, f, g, h};
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				_mm256_store_si256(reinterpret_cast<__m256i *>(state + (i * 8)), _mm256_add_epi32(v[i], results[i]));
+			}
+		}
+
+		//! \param state word i of every lane is at state[i * 16]
+		__attribute__((target("avx512f"))) inline void sha256_compress_lanes_avx512(boost::uint32_t *state,
+		                                                                            byte const *const *blocks)
+		{
+			__m512i v[8];
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				v[i] = _mm512_load_si512(state + (i * 16));
+			}
+			__m512i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+			__m512i schedule[16];
+			load_sha256_words_avx512(blocks, schedule);
+			// 0x96 is the truth table of x ^ y ^ z, 0xCA that of x ? y : z and 0xE8 that of the majority
+			for (std::size_t i = 0; i < 64; ++i)
+			{
+				__m512i word = schedule[i % 16];
+				if (i >= 16)
+				{
+					__m512i const w15 = schedule[(i - 15) % 16];
+					__m512i const w2 = schedule[(i - 2) % 16];
+					__m512i const s0 = _mm512_ternarylogic_epi32(rotate_avx512<7>(w15), rotate_avx512<18>(w15),
+					                                             shift_avx512<3>(w15), 0x96);
+					__m512i const s1 = _mm512_ternarylogic_epi32(rotate_avx512<17>(w2), rotate_avx512<19>(w2),
+					                                             shift_avx512<10>(w2), 0x96);
+					word = _mm512_add_epi32(_mm512_add_epi32(schedule[i % 16], s0),
+					                        _mm512_add_epi32(schedule[(i - 7) % 16], s1));
+				}
+				schedule[i % 16] = word;
+				__m512i const sigma1 = _mm512_ternarylogic_epi32(rotate_avx512<6>(e), rotate_avx512<11>(e),
+				                                                 rotate_avx512<25>(e), 0x96);
+				__m512i const t1 = _mm512_add_epi32(
+				    _mm512_add_epi32(h, sigma1),
+				    _mm512_add_epi32(_mm512_ternarylogic_epi32(e, f, g, 0xCA),
+				                     _mm512_add_epi32(word, _mm512_set1_epi32(static_cast<int>(
+				                                                sha256_round_constants[i])))));
+				__m512i const sigma0 = _mm512_ternarylogic_epi32(rotate_avx512<2>(a), rotate_avx512<13>(a),
+				                                                 rotate_avx512<22>(a), 0x96);
+				h = g;
+				g = f;
+				f = e;
+				e = _mm512_add_epi32(d, t1);
+				d = c;
+				c = b;
+				b = a;
+				a = _mm512_add_epi32(t1, _mm512_add_epi32(sigma0, _mm512_ternarylogic_epi32(a, c, d, 0xE8)));
+			}
+			__m512i const results[8] = {a, b, c, d, e, f, g, h};
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				_mm512_store_si512(state + (i * 16), _mm512_add_epi32(v[i], results[i]));
+			}
+		}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+		//! The fastest way to hash a single message from a given state.
+		inline sha256_compress_function &get_sha256_compress()
+		{
+#ifdef FILESERVER_HAS_X86_SHA256
+			if (get_x86_features().sha)
+			{
+				return sha256_compress_sha_ni;
+			}
+#endif
+			return sha256_compress_portable;
+		}
+
+		//! Hashes a different message in every lane of a vector register. A lane whose message is complete takes the
+		//! next one, so messages of different sizes do not leave lanes idle. Once there are too few messages left to
+		//! fill half of the lanes, the rest is finished one message at a time. This works best if the messages have
+		//! similar sizes, because a single long message is finished alone.
+		template <std::size_t Lanes>
+		void sha256_multi_buffer(void (&compress_lanes)(boost::uint32_t *, byte const *const *),
+		                         Si::memory_range const *messages, std::size_t count, sha256_digest *digests)
+		{
+			struct lane_job
+			{
+				std::size_t message;
+				byte const *next_block;
+				std::size_t full_blocks_left;
+				std::array<byte, 128> tail;
+				std::size_t tail_blocks;
+				std::size_t tail_blocks_done;
+			};
+
+			alignas(64) std::array<boost::uint32_t, 8 * Lanes> state;
+			std::array<lane_job, Lanes> jobs;
+			std::array<bool, Lanes> is_busy;
+			std::size_t busy_count = 0;
+			std::size_t next_message = 0;
+			auto const start = [&](std::size_t lane)
+			{
+				lane_job &job = jobs[lane];
+				job.message = next_message++;
+				Si::memory_range const message = messages[job.message];
+				job.next_block = reinterpret_cast<byte const *>(message.begin());
+				job.full_blocks_left = static_cast<std::size_t>(message.size()) / 64;
+				job.tail_blocks = make_sha256_tail(message, job.tail);
+				job.tail_blocks_done = 0;
+				for (std::size_t i = 0; i < 8; ++i)
+				{
+					state[(i * Lanes) + lane] = sha256_initial_state[i];
+				}
+			};
+			auto const lane_state = [&state](std::size_t lane)
+			{
+				std::array<boost::uint32_t, 8> single;
+				for (std::size_t i = 0; i < 8; ++i)
+				{
+					single[i] = state[(i * Lanes) + lane];
+				}
+				return single;
+			};
+			for (std::size_t lane = 0; lane < Lanes; ++lane)
+			{
+				is_busy[lane] = (next_message < count);
+				if (is_busy[lane])
+				{
+					start(lane);
+					++busy_count;
+				}
+			}
+
+			static std::array<byte, 64> const idle_block = {{}};
+			while ((next_message < count) || (busy_count >= (Lanes / 2)))
+			{
+				std::array<byte const *, Lanes> blocks;
+				for (std::size_t lane = 0; lane < Lanes; ++lane)
+				{
+					lane_job const &job = jobs[lane];
+					blocks[lane] = !is_busy[lane] ? idle_block.data()
+					                              : (job.full_blocks_left > 0)
+					                                    ? job.next_block
+					                                    : (job.tail.data() + (job.tail_blocks_done * 64));
+				}
+				compress_lanes(state.data(), blocks.data());
+				for (std::size_t lane = 0; lane < Lanes; ++lane)
+				{
+					if (!is_busy[lane])
+					{
+						continue;
+					}
+					lane_job &job = jobs[lane];
+					if (job.full_blocks_left > 0)
+					{
+						--job.full_blocks_left;
+						job.next_block += 64;
+						continue;
+					}
+					++job.tail_blocks_done;
+					if (job.tail_blocks_done < job.tail_blocks)
+					{
+						continue;
+					}
+					digests[job.message] = finish_sha256(lane_state(lane).data());
+					if (next_message < count)
+					{
+						start(lane);
+					}
+					else
+					{
+						is_busy[lane] = false;
+						--busy_count;
+					}
+				}
+			}
+
+			sha256_compress_function &compress = get_sha256_compress();
+			for (std::size_t lane = 0; lane < Lanes; ++lane)
+			{
+				if (!is_busy[lane])
+				{
+					continue;
+				}
+				lane_job const &job = jobs[lane];
+				std::array<boost::uint32_t, 8> single = lane_state(lane);
+				compress(single.data(), job.next_block, job.full_blocks_left);
+				compress(single.data(), job.tail.data() + (job.tail_blocks_done * 64),
+				         job.tail_blocks - job.tail_blocks_done);
+				digests[job.message] = finish_sha256(single.data());
+			}
+		}
+	}
+
+	inline bool is_supported(sha256_engine engine)
+	{
+		switch (engine)
+		{
+		case sha256_engine::openssl:
+			return true;
+#ifdef FILESERVER_HAS_X86_SHA256
+		case sha256_engine::sha_ni:
+			return detail::get_x86_features().sha;
+		case sha256_engine::avx2:
+			return detail::get_x86_features().avx2;
+		case sha256_engine::avx512:
+			return detail::get_x86_features().avx512;
+#else
+		case sha256_engine::sha_ni:
+		case sha256_engine::avx2:
+		case sha256_engine::avx512:
+			return false;
+#endif
+		}
+		return false;
+	}
+
+	//! The engine that hashes many small messages the fastest on this CPU.
+	inline sha256_engine best_sha256_engine()
+	{
+		if (is_supported(sha256_engine::avx512))
+		{
+			return sha256_engine::avx512;
+		}
+		// Eight lanes are not faster than the SHA extensions, which OpenSSL also uses if they are there.
+		if (is_supported(sha256_engine::sha_ni))
+		{
+			return sha256_engine::sha_ni;
+		}
+		if (is_supported(sha256_engine::avx2))
+		{
+			return sha256_engine::avx2;
+		}
+		return sha256_engine::openssl;
+	}
+
+	//! Hashes independent messages, for example the contents of small files. A multi-buffer engine is only faster
+	//! than hashing every message on its own if there are at least as many messages as it has lanes.
+	//! \param engine has to be supported on this CPU
+	inline void sha256_many(sha256_engine engine, Si::memory_range const *messages, std::size_t count,
+	                        sha256_digest *digests)
+	{
+		assert(is_supported(engine));
+		switch (engine)
+		{
+		case sha256_engine::openssl:
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				SHA256(reinterpret_cast<unsigned char const *>(messages[i].begin()),
+				       static_cast<std::size_t>(messages[i].size()), digests[i].bytes.data());
+			}
+			return;
+
+#ifdef FILESERVER_HAS_X86_SHA256
+		case sha256_engine::sha_ni:
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				digests[i] = detail::sha256_single(detail::sha256_compress_sha_ni, messages[i]);
+			}
+			return;
+
+		case sha256_engine::avx2:
+			detail::sha256_multi_buffer<8>(detail::sha256_compress_lanes_avx2, messages, count, digests);
+			return;
+
+		case sha256_engine::avx512:
+			detail::sha256_multi_buffer<16>(detail::sha256_compress_lanes_avx512, messages, count, digests);
+			return;
+#else
+		case sha256_engine::sha_ni:
+		case sha256_engine::avx2:
+		case sha256_engine::avx512:
+			break;
+#endif
+		}
+		SILICIUM_UNREACHABLE();
+	}
+
+	inline void sha256_many(Si::memory_range const *messages, std::size_t count, sha256_digest *digests)
+	{
+		static sha256_engine const engine = best_sha256_engine();
+		sha256_many(engine, messages, count, digests);
+	}
+}
+
+#endif
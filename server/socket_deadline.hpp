@@ -0,0 +1,133 @@
+#ifndef FILESERVER_SOCKET_DEADLINE_HPP
+#define FILESERVER_SOCKET_DEADLINE_HPP
+
+#include <silicium/config.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cassert>
+#include <memory>
+
+namespace fileserver
+{
+	//! Closes a socket when a deadline passes. Every operation pending on the socket at that time fails, so a
+	//! coroutine waiting for the socket wakes up and can give up on the client.
+	//! Must be used on the thread that runs the io_service of the socket.
+	template <class Socket>
+	struct socket_deadline
+	{
+		typedef std::chrono::steady_clock::duration duration;
+
+		explicit socket_deadline(std::shared_ptr<Socket> socket)
+		    : m_state(std::make_shared<state>(std::move(socket)))
+		{
+		}
+
+		~socket_deadline()
+		{
+			cancel();
+		}
+
+		SILICIUM_DELETED_FUNCTION(socket_deadline(socket_deadline const &))
+		SILICIUM_DELETED_FUNCTION(socket_deadline &operator=(socket_deadline const &))
+
+		void expires_from_now(duration timeout)
+		{
+			std::shared_ptr<state> const armed = m_state;
+			armed->timer.expires_from_now(timeout);
+			std::size_t const generation = ++armed->generation;
+			armed->expired = false;
+			armed->timer.async_wait([armed, generation](boost::system::error_code ec)
+			                        {
+				                        // a handler that was already queued when the deadline was moved is outdated
+				                        if (ec || (generation != armed->generation))
+				                        {
+					                        return;
+				                        }
+				                        armed->expired = true;
+				                        boost::system::error_code ignored;
+				                        armed->socket->shutdown(Socket::shutdown_both, ignored);
+				                        armed->socket->close(ignored);
+				                    });
+		}
+
+		void cancel()
+		{
+			++m_state->generation;
+			boost::system::error_code ignored;
+			m_state->timer.cancel(ignored);
+		}
+
+		bool has_expired() const
+		{
+			return m_state->expired;
+		}
+
+	private:
+		struct state
+		{
+			std::shared_ptr<Socket> socket;
+			boost::asio::steady_timer timer;
+			std::size_t generation;
+			bool expired;
+
+			explicit state(std::shared_ptr<Socket> socket)
+			    : socket(std::move(socket))
+			    , timer(this->socket->get_io_service())
+			    , generation(0)
+			    , expired(false)
+			{
+			}
+		};
+
+		// shared with the pending timer handler which may run after the deadline object has been destroyed
+		std::shared_ptr<state> m_state;
+	};
+
+	//! \return how long a transfer may take at the minimum rate plus the grace period
+	inline std::chrono::steady_clock::duration transfer_time_limit(boost::uint64_t bytes,
+	                                                               boost::uint64_t min_bytes_per_second,
+	                                                               std::chrono::steady_clock::duration grace)
+	{
+		assert(min_bytes_per_second > 0);
+		// a limit of a few centuries would overflow the clock
+		boost::uint64_t const max_seconds = 365ull * 24 * 60 * 60;
+		boost::uint64_t const seconds = std::min(bytes / min_bytes_per_second, max_seconds);
+		boost::uint64_t const rest_milliseconds = (bytes % min_bytes_per_second) * 1000 / min_bytes_per_second;
+		return grace + std::chrono::seconds(static_cast<std::chrono::seconds::rep>(seconds)) +
+		       std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(rest_milliseconds));
+	}
+
+	//! Gives every part of a response its own time limit instead of one for the whole response. A client that stops
+	//! reading is dropped once the part in flight is overdue, so how long it can hold on to a session does not depend
+	//! on the size of the response.
+	template <class Deadline>
+	struct send_pacer
+	{
+		//! \param min_bytes_per_second 0 means that sending may take forever
+		send_pacer(Deadline &deadline, boost::uint64_t min_bytes_per_second, std::chrono::steady_clock::duration grace)
+		    : m_deadline(deadline)
+		    , m_min_bytes_per_second(min_bytes_per_second)
+		    , m_grace(grace)
+		{
+		}
+
+		//! Has to be called before the socket is given the next part.
+		void expect(boost::uint64_t bytes) const
+		{
+			if (m_min_bytes_per_second == 0)
+			{
+				m_deadline.cancel();
+				return;
+			}
+			m_deadline.expires_from_now(transfer_time_limit(bytes, m_min_bytes_per_second, m_grace));
+		}
+
+	private:
+		Deadline &m_deadline;
+		boost::uint64_t m_min_bytes_per_second;
+		std::chrono::steady_clock::duration m_grace;
+	};
+}
+
+#endif
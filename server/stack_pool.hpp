@@ -0,0 +1,161 @@
+#ifndef FILESERVER_STACK_POOL_HPP
+#define FILESERVER_STACK_POOL_HPP
+
+#include <silicium/config.hpp>
+#include <boost/coroutine/stack_context.hpp>
+#include <cassert>
+#include <new>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace fileserver
+{
+	//! Coroutine stacks with a guard page below each of them. A stack that is given back is kept for the next
+	//! coroutine, so a busy server neither maps new memory nor faults in fresh pages for every connection.
+	//! Must only be used on one thread.
+	struct stack_pool
+	{
+		//! \param stack_size the usable size of each stack, rounded up to whole pages
+		//! \param max_idle how many unused stacks are kept, the rest is returned to the operating system
+		stack_pool(std::size_t stack_size, std::size_t max_idle)
+		    : m_page_size(get_page_size())
+		    , m_mapping_size(((stack_size + m_page_size - 1) / m_page_size + 1) * m_page_size)
+		    , m_max_idle(max_idle)
+		    , m_in_use(0)
+		{
+		}
+
+		//! Stacks that are still in use belong to coroutines that can never be resumed and are not freed.
+		~stack_pool()
+		{
+			for (char *mapping : m_idle)
+			{
+				unmap(mapping);
+			}
+		}
+
+		SILICIUM_DELETED_FUNCTION(stack_pool(stack_pool const &))
+		SILICIUM_DELETED_FUNCTION(stack_pool &operator=(stack_pool const &))
+
+		//! \return the lowest address of the mapping, which is the guard page
+		char *acquire()
+		{
+			char *mapping;
+			if (m_idle.empty())
+			{
+				mapping = map();
+			}
+			else
+			{
+				mapping = m_idle.back();
+				m_idle.pop_back();
+			}
+			++m_in_use;
+			return mapping;
+		}
+
+		void release(char *mapping)
+		{
+			assert(m_in_use > 0);
+			--m_in_use;
+			if (m_idle.size() < m_max_idle)
+			{
+				m_idle.emplace_back(mapping);
+				return;
+			}
+			unmap(mapping);
+		}
+
+		//! the size of each stack including its guard page
+		std::size_t mapping_size() const
+		{
+			return m_mapping_size;
+		}
+
+		std::size_t in_use() const
+		{
+			return m_in_use;
+		}
+
+		std::size_t idle() const
+		{
+			return m_idle.size();
+		}
+
+	private:
+		std::size_t m_page_size;
+		std::size_t m_mapping_size;
+		std::size_t m_max_idle;
+		std::size_t m_in_use;
+		std::vector<char *> m_idle;
+
+		static std::size_t get_page_size()
+		{
+#ifdef _WIN32
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			return info.dwPageSize;
+#else
+			return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+		}
+
+		char *map()
+		{
+#ifdef _WIN32
+			void *const mapping = VirtualAlloc(nullptr, m_mapping_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (!mapping)
+			{
+				throw std::bad_alloc();
+			}
+			DWORD previous_protection;
+			VirtualProtect(mapping, m_page_size, PAGE_NOACCESS, &previous_protection);
+#else
+			// the pages are only backed by memory once the coroutine touches them
+			void *const mapping = ::mmap(nullptr, m_mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			                             -1, 0);
+			if (mapping == MAP_FAILED)
+			{
+				throw std::bad_alloc();
+			}
+			// the stack grows downwards, so an overflow hits the guard page and crashes instead of corrupting memory
+			::mprotect(mapping, m_page_size, PROT_NONE);
+#endif
+			return static_cast<char *>(mapping);
+		}
+
+		void unmap(char *mapping)
+		{
+#ifdef _WIN32
+			VirtualFree(mapping, 0, MEM_RELEASE);
+#else
+			::munmap(mapping, m_mapping_size);
+#endif
+		}
+	};
+
+	//! A StackAllocator for Boost.Coroutine that takes the stacks from a stack_pool.
+	struct pooled_stack_allocator
+	{
+		stack_pool *pool;
+
+		void allocate(boost::coroutines::stack_context &context, std::size_t)
+		{
+			char *const mapping = pool->acquire();
+			context.size = pool->mapping_size();
+			context.sp = mapping + context.size;
+		}
+
+		void deallocate(boost::coroutines::stack_context &context)
+		{
+			pool->release(static_cast<char *>(context.sp) - context.size);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef FILESERVER_UPDATE_DIRECTORY_HPP
+#define FILESERVER_UPDATE_DIRECTORY_HPP
+
+#include <server/scan_directory.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace fileserver
+{
+	//! What an update does to the repository. The changes are collected while the new tree is made, so that nothing of
+	//! the repository of the old tree has to be copied unless something has changed.
+	struct repository_update
+	{
+		//! one location to remove for every entry, which is the file with that path or one copy of a listing
+		std::vector<std::pair<unknown_digest, Si::optional<path>>> removed;
+
+		std::vector<std::pair<unknown_digest, location>> added;
+
+		bool empty() const
+		{
+			return removed.empty() && added.empty();
+		}
+
+		void apply_to(file_repository &repository) const
+		{
+			for (auto const &removal : removed)
+			{
+				repository_entry *const entry = repository.find_entry_to_change(removal.first);
+				if (!entry)
+				{
+					continue;
+				}
+				std::vector<location> &locations = entry->locations;
+				Si::optional<path> const &file = removal.second;
+				auto const is_removed = [&file](location const &candidate)
+				{
+					if (!file)
+					{
+						// every occurrence of a listing has an equal copy
+						return Si::try_get_ptr<in_memory_location>(candidate) != nullptr;
+					}
+					file_system_location const *const on_disk = Si::try_get_ptr<file_system_location>(candidate);
+					return on_disk && (on_disk->where == *file);
+				};
+				auto const found = std::find_if(locations.begin(), locations.end(), is_removed);
+				if (found != locations.end())
+				{
+					locations.erase(found);
+				}
+				if (locations.empty())
+				{
+					repository.erase(removal.first);
+				}
+			}
+			for (auto const &addition : added)
+			{
+				repository_entry &entry = repository.add_entry(addition.first);
+				if (entry.locations.empty())
+				{
+					// every location of an entry has the same content, so known entries keep their headers
+					entry.headers = make_cached_response_headers(addition.first, location_file_size(addition.second));
+				}
+				entry.locations.emplace_back(addition.second);
+			}
+		}
+	};
+
+	namespace detail
+	{
+		//! The changed paths arranged like the tree, so that every directory is visited once no matter how many of
+		//! its entries have changed.
+		struct changed_entries
+		{
+			//! whether the entry itself may have changed and not only something below it
+			bool is_changed = false;
+
+			std::map<std::string, changed_entries> children;
+		};
+
+		inline void forget_locations(name_tree const &forgotten, boost::filesystem::path const &where,
+		                             repository_update &update)
+		{
+			unknown_digest const key = to_unknown_digest(forgotten.reference.referenced);
+			if (!forgotten.directory)
+			{
+				update.removed.emplace_back(key, *ventura::absolute_path::create(where));
+				return;
+			}
+			update.removed.emplace_back(key, Si::none);
+			for (auto const &entry : forgotten.directory->entries)
+			{
+				forget_locations(entry.second, where / entry.first, update);
+			}
+		}
+
+		//! Hashes a file or scans a directory that has appeared where there was nothing or something else before.
+		//! \return none if there is nothing to serve at that location
+		template <class Executor>
+		Si::optional<name_tree> replace_entry(name_tree const *old, boost::filesystem::path const &where,
+		                                      boost::filesystem::file_type type, repository_update &update,
+		                                      listing_serializer const &serialize_listing,
+		                                      file_hasher const &hash_file, Executor &executor)
+		{
+			switch (type)
+			{
+			case boost::filesystem::regular_file:
+			{
+				std::vector<Si::error_or<std::pair<typed_reference, location>>> hashed_files =
+				    hash_file(std::vector<ventura::absolute_path>{*ventura::absolute_path::create(where)});
+				assert(hashed_files.size() == 1);
+				Si::error_or<std::pair<typed_reference, location>> &hashed = hashed_files.front();
+				if (!hashed.is_error() && old && !old->directory && (old->reference == hashed.get().first))
+				{
+					// the same content again, for example after the file has only been touched
+					return *old;
+				}
+				if (old)
+				{
+					forget_locations(*old, where, update);
+				}
+				if (hashed.is_error())
+				{
+					// the scan ignores such a file, too
+					return Si::none;
+				}
+				update.added.emplace_back(to_unknown_digest(hashed.get().first.referenced),
+				                          std::move(hashed.get().second));
+				return name_tree{std::move(hashed.get().first), nullptr};
+			}
+
+			case boost::filesystem::directory_file:
+			{
+				if (old)
+				{
+					forget_locations(*old, where, update);
+				}
+				std::pair<file_repository, name_tree> scanned =
+				    scan_directory(where, serialize_listing, hash_file, executor);
+				scanned.first.for_each_entry([&update](unknown_digest const &digest, repository_entry const &entry)
+				                             {
+					                             for (location const &found : entry.locations)
+					                             {
+						                             update.added.emplace_back(digest, found);
+					                             }
+					                         });
+				return std::move(scanned.second);
+			}
+
+			default:
+				if (old)
+				{
+					forget_locations(*old, where, update);
+				}
+				return Si::none;
+			}
+		}
+
+		template <class Executor>
+		Si::optional<name_tree> update_entry(name_tree const *old, boost::filesystem::path const &where,
+		                                     changed_entries const &changes, repository_update &update,
+		                                     listing_serializer const &serialize_listing,
+		                                     file_hasher const &hash_file, Executor &executor)
+		{
+			if (!old || !old->directory || changes.is_changed)
+			{
+				boost::system::error_code ec;
+				boost::filesystem::file_type const type = boost::filesystem::status(where, ec).type();
+				// A directory that is still there keeps its entries, because every change below it has a
+				// notification of its own.
+				if (!old || !old->directory || (type != boost::filesystem::directory_file))
+				{
+					return replace_entry(old, where, type, update, serialize_listing, hash_file, executor);
+				}
+			}
+
+			std::vector<std::pair<std::string const *, Si::optional<name_tree>>> replaced;
+			for (auto const &change : changes.children)
+			{
+				name_tree const *const old_child = old->directory->find(
+				    Si::make_memory_range(change.first.data(), change.first.data() + change.first.size()));
+				Si::optional<name_tree> new_child = update_entry(old_child, where / change.first, change.second, update,
+				                                                 serialize_listing, hash_file, executor);
+				bool const is_same = new_child ? (old_child && (old_child->reference == new_child->reference) &&
+				                                  (old_child->directory == new_child->directory))
+				                               : !old_child;
+				if (!is_same)
+				{
+					replaced.emplace_back(&change.first, std::move(new_child));
+				}
+			}
+			if (replaced.empty())
+			{
+				// nothing is copied, so an unchanged directory is still shared with every snapshot that has it
+				return *old;
+			}
+
+			auto directory = std::make_shared<name_directory>(*old->directory);
+			for (auto &replacement : replaced)
+			{
+				if (replacement.second)
+				{
+					directory->entries[*replacement.first] = std::move(*replacement.second);
+				}
+				else
+				{
+					directory->entries.erase(*replacement.first);
+				}
+			}
+			directory_listing listing;
+			for (auto const &entry : directory->entries)
+			{
+				listing.entries.emplace(std::make_pair(entry.first, entry.second.reference));
+			}
+			std::pair<typed_reference, location> made = make_listing(listing, serialize_listing);
+			update.removed.emplace_back(to_unknown_digest(old->reference.referenced), Si::none);
+			update.added.emplace_back(to_unknown_digest(made.first.referenced), std::move(made.second));
+			return name_tree{std::move(made.first), std::move(directory)};
+		}
+	}
+
+	//! Applies changes on the disk to a scanned tree. Only the changed files are hashed again and only the listings
+	//! of the directories on the paths from the changes to the root are made again. Everything else is shared with
+	//! the old tree, which stays valid. A directory that has appeared is scanned on the executor.
+	//! \param changed absolute paths below root of things that may have been added, changed or removed
+	//! \param update receives what has to be done to the repository of the old tree to get that of the new one
+	//! \return the new tree
+	template <class Executor>
+	name_tree update_directory(boost::filesystem::path const &root, name_tree const &old,
+	                           std::vector<boost::filesystem::path> const &changed, repository_update &update,
+	                           listing_serializer const &serialize_listing, file_hasher const &hash_file,
+	                           Executor &executor)
+	{
+		detail::changed_entries changes;
+		for (boost::filesystem::path const &changed_path : changed)
+		{
+			auto root_segment = root.begin();
+			auto segment = changed_path.begin();
+			while ((root_segment != root.end()) && (segment != changed_path.end()) && (*root_segment == *segment))
+			{
+				++root_segment;
+				++segment;
+			}
+			if (root_segment != root.end())
+			{
+				// not below the root
+				continue;
+			}
+			detail::changed_entries *entry = &changes;
+			for (; segment != changed_path.end(); ++segment)
+			{
+				if (*segment != ".")
+				{
+					entry = &entry->children[segment->string()];
+				}
+			}
+			entry->is_changed = true;
+		}
+		Si::optional<name_tree> updated =
+		    detail::update_entry(&old, root, changes, update, serialize_listing, hash_file, executor);
+		if (!updated || !updated->directory)
+		{
+			throw std::runtime_error("The root of the tree is no longer a directory");
+		}
+		return std::move(*updated);
+	}
+
+	inline name_tree update_directory(boost::filesystem::path const &root, name_tree const &old,
+	                                  std::vector<boost::filesystem::path> const &changed, repository_update &update,
+	                                  listing_serializer const &serialize_listing, file_hasher const &hash_file)
+	{
+		detail::inline_executor executor;
+		return update_directory(root, old, changed, update, serialize_listing, hash_file, executor);
+	}
+}
+
+#endif
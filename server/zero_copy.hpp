@@ -0,0 +1,93 @@
+#ifndef FILESERVER_ZERO_COPY_HPP
+#define FILESERVER_ZERO_COPY_HPP
+
+#include <server/positional_read.hpp>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <signal.h>
+#endif
+
+namespace fileserver
+{
+#ifdef __linux__
+	//! Unlike send, sendfile has no MSG_NOSIGNAL. Without this, a client that closes its connection while a file is
+	//! being sent to it would kill the server with SIGPIPE. Has to be called before the first send_file_to_socket.
+	inline void ignore_broken_pipes()
+	{
+		::signal(SIGPIPE, SIG_IGN);
+	}
+
+	//! Lets the kernel send up to size bytes of a file directly from the page cache to a socket, so that the bytes
+	//! never have to be copied into user space.
+	//! \return the number of bytes sent which is 0 if the file ends at the position, or EPIPE if the peer has gone
+	//! away and ignore_broken_pipes has been called
+	inline Si::error_or<std::size_t> send_file_to_socket(int socket, int file, boost::uint64_t position,
+	                                                     std::size_t size)
+	{
+		off_t offset = static_cast<off_t>(position);
+		for (;;)
+		{
+			ssize_t const rc = ::sendfile(socket, file, &offset, size);
+			if (rc < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return boost::system::error_code(errno, boost::system::native_ecat);
+			}
+			return static_cast<std::size_t>(rc);
+		}
+	}
+
+	//! \return true if the socket or the file system cannot do send_file_to_socket, so the bytes have to be copied
+	//! through user space instead
+	inline bool is_zero_copy_unsupported(boost::system::error_code const &error)
+	{
+		return (error == boost::system::errc::invalid_argument) ||
+		       (error == boost::system::errc::function_not_supported) ||
+		       (error == boost::system::errc::operation_not_supported);
+	}
+
+	//! Reads a part of a file into the page cache. Blocks until that is done, so that a following
+	//! send_file_to_socket of the same part does not have to wait for the disk.
+	inline void prefetch_file(int file, boost::uint64_t position, std::size_t size)
+	{
+		// only a hint, so errors are ignored
+		::readahead(file, static_cast<off64_t>(position), size);
+	}
+#endif
+
+#ifndef _WIN32
+	//! The conventional alternative to send_file_to_socket: read a part of the file into a buffer and write the
+	//! buffer to a blocking socket.
+	inline Si::error_or<std::size_t> copy_file_to_socket(int socket, int file, boost::uint64_t position,
+	                                                     char *buffer, std::size_t buffer_size)
+	{
+		Si::error_or<std::size_t> const read = read_at(file, position, buffer, buffer_size);
+		if (read.is_error())
+		{
+			return read.error();
+		}
+		std::size_t total_sent = 0;
+		while (total_sent < read.get())
+		{
+			ssize_t const rc = ::send(socket, buffer + total_sent, read.get() - total_sent, MSG_NOSIGNAL);
+			if (rc < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return boost::system::error_code(errno, boost::system::native_ecat);
+			}
+			total_sent += static_cast<std::size_t>(rc);
+		}
+		return total_sent;
+	}
+#endif
+}
+
+#endif
@@ -1,4 +1,6 @@
 #include "http_storage_reader.hpp"
+#include <server/batch_format.hpp>
+#include <server/pack_format.hpp>
 #include <silicium/observable/coroutine_generator.hpp>
 #include <silicium/asio/connecting_observable.hpp>
 #include <silicium/asio/writing_observable.hpp>
@@ -11,6 +13,112 @@
 
 namespace fileserver
 {
+	namespace
+	{
+		//! The part of a batch response that has been received, but not consumed yet. It is shared by the files of the
+		//! batch, which are read one after another from the same connection.
+		struct batch_stream
+		{
+			std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+			std::array<char, 8192> buffer;
+			Si::memory_range buffered;
+
+			//! what is left of the content of the current file
+			file_offset unread_content = 0;
+		};
+
+		//! \return the buffered bytes which are only empty at the end of the response
+		template <class YieldContext>
+		Si::error_or<Si::memory_range> receive_more(YieldContext &yield, batch_stream &stream)
+		{
+			if (stream.buffered.empty())
+			{
+				auto receiving = Si::asio::make_reading_observable(
+				    *stream.socket,
+				    Si::make_iterator_range(stream.buffer.data(), stream.buffer.data() + stream.buffer.size()));
+				Si::optional<Si::error_or<Si::memory_range>> const piece = yield.get_one(receiving);
+				if (!piece)
+				{
+					return Si::memory_range();
+				}
+				if (piece->is_error())
+				{
+					return piece->error();
+				}
+				stream.buffered = piece->get();
+			}
+			return stream.buffered;
+		}
+
+		//! \return the next piece of the content of the current file
+		template <class YieldContext>
+		Si::error_or<Si::memory_range> receive_content(YieldContext &yield, batch_stream &stream)
+		{
+			Si::error_or<Si::memory_range> const received = receive_more(yield, stream);
+			if (received.is_error())
+			{
+				return received.error();
+			}
+			Si::memory_range const available = received.get();
+			if (available.empty())
+			{
+				return boost::system::error_code(service_error::malformed_response);
+			}
+			std::size_t const taken =
+			    static_cast<std::size_t>(std::min(static_cast<file_offset>(available.size()), stream.unread_content));
+			Si::memory_range const piece = Si::make_memory_range(available.begin(), available.begin() + taken);
+			stream.buffered = Si::make_memory_range(piece.end(), available.end());
+			stream.unread_content -= taken;
+			return piece;
+		}
+
+		template <class YieldContext>
+		Si::error_or<batch_item_header> receive_item_header(YieldContext &yield, batch_stream &stream)
+		{
+			// the rest of a file that has not been read completely is skipped
+			while (stream.unread_content > 0)
+			{
+				Si::error_or<Si::memory_range> const skipped = receive_content(yield, stream);
+				if (skipped.is_error())
+				{
+					return skipped.error();
+				}
+			}
+			std::string line;
+			for (;;)
+			{
+				Si::error_or<Si::memory_range> const received = receive_more(yield, stream);
+				if (received.is_error())
+				{
+					return received.error();
+				}
+				if (received.get().empty())
+				{
+					return boost::system::error_code(service_error::malformed_response);
+				}
+				char const *const line_end = std::find(received.get().begin(), received.get().end(), '\n');
+				line.append(received.get().begin(), line_end);
+				if (line_end != received.get().end())
+				{
+					stream.buffered = Si::make_memory_range(line_end + 1, received.get().end());
+					break;
+				}
+				stream.buffered = Si::memory_range();
+				if (line.size() > 256)
+				{
+					return boost::system::error_code(service_error::malformed_response);
+				}
+			}
+			Si::optional<batch_item_header> parsed =
+			    parse_batch_item_header(Si::make_memory_range(line.data(), line.data() + line.size()));
+			if (!parsed)
+			{
+				return boost::system::error_code(service_error::malformed_response);
+			}
+			return std::move(*parsed);
+		}
+	}
+
 	http_storage_reader::http_storage_reader(boost::asio::io_service &io, boost::asio::ip::tcp::endpoint server,
 	                                         Si::noexcept_string relative_path)
 	    : io(&io)
@@ -22,7 +130,7 @@ namespace fileserver
 	Si::unique_observable<Si::error_or<linear_file>> http_storage_reader::open(unknown_digest const &name)
 	{
 		return Si::erase_unique(Si::make_coroutine_generator<Si::error_or<linear_file>>(
-		    std::bind(&http_storage_reader::open_impl, this, std::placeholders::_1, name)));
+		    std::bind(&http_storage_reader::open_impl, this, std::placeholders::_1, relative_path, name)));
 	}
 
 	Si::unique_observable<Si::error_or<file_offset>> http_storage_reader::size(unknown_digest const &name)
@@ -31,6 +139,19 @@ namespace fileserver
 		    std::bind(&http_storage_reader::size_impl, this, std::placeholders::_1, name)));
 	}
 
+	Si::unique_observable<Si::error_or<linear_file>> http_storage_reader::open_batch(std::vector<unknown_digest> names)
+	{
+		return Si::erase_unique(Si::make_coroutine_generator<Si::error_or<linear_file>>(
+		    std::bind(&http_storage_reader::open_batch_impl, this, std::placeholders::_1, std::move(names))));
+	}
+
+	Si::unique_observable<Si::error_or<linear_file>> http_storage_reader::open_pack(unknown_digest const &directory)
+	{
+		return Si::erase_unique(Si::make_coroutine_generator<Si::error_or<linear_file>>(
+		    std::bind(&http_storage_reader::open_impl, this, std::placeholders::_1,
+		              Si::noexcept_string(pack_request_prefix), directory)));
+	}
+
 	Si::error_or<std::shared_ptr<boost::asio::ip::tcp::socket>> http_storage_reader::connect(Si::yield_context yield)
 	{
 		auto socket = std::make_shared<boost::asio::ip::tcp::socket>(*io);
@@ -46,14 +167,14 @@ namespace fileserver
 		return socket;
 	}
 
-	std::vector<char> http_storage_reader::serialize_request(Si::noexcept_string method,
+	std::vector<char> http_storage_reader::serialize_request(Si::noexcept_string method, Si::noexcept_string path,
 	                                                         unknown_digest const &requested)
 	{
 		std::vector<char> request_buffer;
 		Si::http::request request;
 		request.http_version = "HTTP/1.0";
 		request.method = std::move(method);
-		request.path = relative_path;
+		request.path = std::move(path);
 		encode_ascii_hex_digits(requested.begin(), requested.end(), std::back_inserter(request.path));
 		request.arguments["Host"] = server.address().to_string().c_str();
 		auto request_sink = Si::make_container_sink(request_buffer);
@@ -61,6 +182,27 @@ namespace fileserver
 		return request_buffer;
 	}
 
+	std::vector<char> http_storage_reader::serialize_batch_request(std::vector<unknown_digest> const &requested)
+	{
+		std::vector<char> body;
+		for (unknown_digest const &digest : requested)
+		{
+			encode_ascii_hex_digits(digest.begin(), digest.end(), std::back_inserter(body));
+			body.push_back('\n');
+		}
+		std::vector<char> request_buffer;
+		Si::http::request request;
+		request.http_version = "HTTP/1.0";
+		request.method = "POST";
+		request.path = batch_request_target;
+		request.arguments["Host"] = server.address().to_string().c_str();
+		request.arguments["Content-Length"] = boost::lexical_cast<Si::noexcept_string>(body.size());
+		auto request_sink = Si::make_container_sink(request_buffer);
+		Si::http::generate_request(request_sink, request);
+		request_buffer.insert(request_buffer.end(), body.begin(), body.end());
+		return request_buffer;
+	}
+
 	Si::error_or<Si::nothing> http_storage_reader::send_all(Si::yield_context yield,
 	                                                        boost::asio::ip::tcp::socket &socket,
 	                                                        std::vector<char> const &buffer)
@@ -76,7 +218,7 @@ namespace fileserver
 		return Si::nothing();
 	}
 
-	Si::error_or<std::pair<Si::http::response, std::size_t>>
+	Si::error_or<std::pair<Si::http::response, Si::memory_range>>
 	http_storage_reader::receive_response_header(Si::yield_context yield, boost::asio::ip::tcp::socket &socket,
 	                                             std::array<char, 8192> &buffer)
 	{
@@ -89,7 +231,8 @@ namespace fileserver
 		{
 			throw std::logic_error("todo 1");
 		}
-		return std::make_pair(std::move(*response_header), response_source.buffered().size());
+		// the beginning of the body may have been received together with the header
+		return std::make_pair(std::move(*response_header), response_source.buffered());
 	}
 
 	void http_storage_reader::size_impl(Si::push_context<Si::error_or<file_offset>> yield,
@@ -102,7 +245,7 @@ namespace fileserver
 		}
 		auto const socket = maybe_socket.get();
 		{
-			auto const request_buffer = serialize_request("HEAD", requested_name);
+			auto const request_buffer = serialize_request("HEAD", relative_path, requested_name);
 			auto const sent = send_all(yield, *socket, request_buffer);
 			if (sent.is_error())
 			{
@@ -132,7 +275,7 @@ namespace fileserver
 	}
 
 	void http_storage_reader::open_impl(Si::push_context<Si::error_or<linear_file>> yield,
-	                                    unknown_digest const &requested_name)
+	                                    Si::noexcept_string const &path, unknown_digest const &requested_name)
 	{
 		auto const maybe_socket = connect(yield);
 		if (maybe_socket.is_error())
@@ -141,7 +284,7 @@ namespace fileserver
 		}
 		auto const socket = maybe_socket.get();
 		{
-			auto const request_buffer = serialize_request("GET", requested_name);
+			auto const request_buffer = serialize_request("GET", path, requested_name);
 			auto const sent = send_all(yield, *socket, request_buffer);
 			if (sent.is_error())
 			{
@@ -155,7 +298,7 @@ namespace fileserver
 			return yield(received_header.error());
 		}
 		auto const &response_header = received_header.get().first;
-		std::size_t const buffered_content = received_header.get().second;
+		Si::memory_range const buffered_content = received_header.get().second;
 
 		if (response_header.status != 200)
 		{
@@ -168,7 +311,7 @@ namespace fileserver
 			throw std::logic_error("todo 2");
 		}
 
-		std::vector<byte> first_part(buffer.begin(), buffer.begin() + buffered_content);
+		std::vector<byte> first_part(buffered_content.begin(), buffered_content.end());
 		file_offset const file_size = boost::lexical_cast<file_offset>(content_length_header->second);
 		linear_file file{file_size,
 		                 Si::erase_unique(Si::make_coroutine_generator<Si::error_or<Si::memory_range>>(
@@ -200,4 +343,74 @@ namespace fileserver
 			                 }))};
 		yield(std::move(file));
 	}
+
+	void http_storage_reader::open_batch_impl(Si::push_context<Si::error_or<linear_file>> yield,
+	                                          std::vector<unknown_digest> const &requested_names)
+	{
+		auto const maybe_socket = connect(yield);
+		if (maybe_socket.is_error())
+		{
+			return yield(maybe_socket.error());
+		}
+		auto const socket = maybe_socket.get();
+		{
+			auto const request_buffer = serialize_batch_request(requested_names);
+			auto const sent = send_all(yield, *socket, request_buffer);
+			if (sent.is_error())
+			{
+				return yield(sent.error());
+			}
+		}
+		auto const stream = std::make_shared<batch_stream>();
+		stream->socket = socket;
+		{
+			std::array<char, 8192> header_buffer;
+			auto const received_header = receive_response_header(yield, *socket, header_buffer);
+			if (received_header.is_error())
+			{
+				return yield(received_header.error());
+			}
+			if (received_header.get().first.status != 200)
+			{
+				return yield(boost::system::error_code(service_error::file_not_found));
+			}
+			Si::memory_range const first_part = received_header.get().second;
+			char *const first_part_end = std::copy(first_part.begin(), first_part.end(), stream->buffer.begin());
+			stream->buffered = Si::make_memory_range(stream->buffer.data(), first_part_end);
+		}
+
+		for (unknown_digest const &requested_name : requested_names)
+		{
+			Si::error_or<batch_item_header> const item = receive_item_header(yield, *stream);
+			if (item.is_error())
+			{
+				return yield(item.error());
+			}
+			if (item.get().digest != requested_name)
+			{
+				return yield(boost::system::error_code(service_error::malformed_response));
+			}
+			if (!item.get().size)
+			{
+				yield(boost::system::error_code(service_error::file_not_found));
+				continue;
+			}
+			file_offset const file_size = static_cast<file_offset>(*item.get().size);
+			stream->unread_content = file_size;
+			yield(linear_file{file_size,
+			                  Si::erase_unique(Si::make_coroutine_generator<Si::error_or<Si::memory_range>>(
+			                      [stream](Si::push_context<Si::error_or<Si::memory_range>> yield)
+			                      {
+				                      while (stream->unread_content > 0)
+				                      {
+					                      Si::error_or<Si::memory_range> const piece = receive_content(yield, *stream);
+					                      yield(piece);
+					                      if (piece.is_error())
+					                      {
+						                      break;
+					                      }
+				                      }
+				                  }))});
+		}
+	}
 }
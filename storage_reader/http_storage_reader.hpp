@@ -15,20 +15,33 @@ namespace fileserver
 		virtual Si::unique_observable<Si::error_or<linear_file>> open(unknown_digest const &name) SILICIUM_OVERRIDE;
 		virtual Si::unique_observable<Si::error_or<file_offset>> size(unknown_digest const &name) SILICIUM_OVERRIDE;
 
+		//! Fetches all of the files with a single POST to /batch.
+		virtual Si::unique_observable<Si::error_or<linear_file>>
+		open_batch(std::vector<unknown_digest> names) SILICIUM_OVERRIDE;
+
+		//! Requests the pack with a GET of /pack/<digest>.
+		virtual Si::unique_observable<Si::error_or<linear_file>>
+		open_pack(unknown_digest const &directory) SILICIUM_OVERRIDE;
+
 	private:
 		boost::asio::io_service *io = nullptr;
 		boost::asio::ip::tcp::endpoint server;
 		Si::noexcept_string relative_path;
 
 		Si::error_or<std::shared_ptr<boost::asio::ip::tcp::socket>> connect(Si::yield_context yield);
-		std::vector<char> serialize_request(Si::noexcept_string method, unknown_digest const &requested);
+		std::vector<char> serialize_request(Si::noexcept_string method, Si::noexcept_string path,
+		                                    unknown_digest const &requested);
+		std::vector<char> serialize_batch_request(std::vector<unknown_digest> const &requested);
 		Si::error_or<Si::nothing> send_all(Si::yield_context yield, boost::asio::ip::tcp::socket &socket,
 		                                   std::vector<char> const &buffer);
-		Si::error_or<std::pair<Si::http::response, std::size_t>>
+		Si::error_or<std::pair<Si::http::response, Si::memory_range>>
 		receive_response_header(Si::yield_context yield, boost::asio::ip::tcp::socket &socket,
 		                        std::array<char, 8192> &buffer);
 		void size_impl(Si::push_context<Si::error_or<file_offset>> yield, unknown_digest const &requested_name);
-		void open_impl(Si::push_context<Si::error_or<linear_file>> yield, unknown_digest const &requested_name);
+		void open_impl(Si::push_context<Si::error_or<linear_file>> yield, Si::noexcept_string const &path,
+		               unknown_digest const &requested_name);
+		void open_batch_impl(Si::push_context<Si::error_or<linear_file>> yield,
+		                     std::vector<unknown_digest> const &requested_names);
 	};
 }
 
@@ -15,6 +15,12 @@ namespace fileserver
 		{
 		case static_cast<int>(service_error::file_not_found):
 			return "file not found";
+
+		case static_cast<int>(service_error::malformed_response):
+			return "malformed response";
+
+		case static_cast<int>(service_error::unknown_entry_type):
+			return "unknown directory entry type";
 		}
 		SILICIUM_UNREACHABLE();
 	}
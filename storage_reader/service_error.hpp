@@ -8,7 +8,11 @@ namespace fileserver
 {
 	enum class service_error
 	{
-		file_not_found
+		file_not_found,
+		malformed_response,
+
+		//! a listing refers to something that is neither a file nor a directory, maybe from a newer server
+		unknown_entry_type
 	};
 
 	struct service_error_category : boost::system::error_category
@@ -1,8 +1,35 @@
 #include "storage_reader.hpp"
+#include <silicium/observable/coroutine_generator.hpp>
+#include <silicium/observable/ready_future.hpp>
 
 namespace fileserver
 {
 	storage_reader::~storage_reader()
 	{
 	}
+
+	Si::unique_observable<Si::error_or<linear_file>> storage_reader::open_batch(std::vector<unknown_digest> names)
+	{
+		return Si::erase_unique(Si::make_coroutine_generator<Si::error_or<linear_file>>(
+		    [this, names](Si::push_context<Si::error_or<linear_file>> yield)
+		    {
+			    for (unknown_digest const &name : names)
+			    {
+				    auto opening = open(name);
+				    Si::optional<Si::error_or<linear_file>> opened = yield.get_one(opening);
+				    if (!opened)
+				    {
+					    return;
+				    }
+				    yield(std::move(*opened));
+			    }
+			}));
+	}
+
+	Si::unique_observable<Si::error_or<linear_file>> storage_reader::open_pack(unknown_digest const &directory)
+	{
+		boost::ignore_unused_variable_warning(directory);
+		return Si::erase_unique(Si::make_ready_future_observable(Si::error_or<linear_file>(
+		    boost::system::errc::make_error_code(boost::system::errc::not_supported))));
+	}
 }
@@ -3,6 +3,7 @@
 
 #include "linear_file.hpp"
 #include <server/digest.hpp>
+#include <vector>
 
 namespace fileserver
 {
@@ -11,6 +12,15 @@ namespace fileserver
 		virtual ~storage_reader();
 		virtual Si::unique_observable<Si::error_or<linear_file>> open(unknown_digest const &name) = 0;
 		virtual Si::unique_observable<Si::error_or<file_offset>> size(unknown_digest const &name) = 0;
+
+		//! Opens many files with as few round trips as the storage allows. The observable produces one element for
+		//! each name in the same order. The content of a file has to be read before the next one is requested
+		//! because the files may arrive through the same connection. The default opens one file after another.
+		virtual Si::unique_observable<Si::error_or<linear_file>> open_batch(std::vector<unknown_digest> names);
+
+		//! Opens a directory with everything below it as a single pack (see server/pack_format.hpp). The default
+		//! fails with errc::not_supported.
+		virtual Si::unique_observable<Si::error_or<linear_file>> open_pack(unknown_digest const &directory);
 	};
 }
 
@@ -0,0 +1,37 @@
+#include <server/admission_control.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_CASE(admission_control_session_limit)
+{
+	fileserver::admission_control admission(2, 0);
+	BOOST_CHECK(admission.try_start_session());
+	BOOST_CHECK(admission.try_start_session());
+	BOOST_CHECK(!admission.try_start_session());
+	BOOST_CHECK_EQUAL(2u, admission.sessions());
+	BOOST_CHECK_EQUAL(1u, admission.rejected_sessions());
+	admission.finish_session();
+	BOOST_CHECK(admission.try_start_session());
+	BOOST_CHECK_EQUAL(2u, admission.sessions());
+}
+
+BOOST_AUTO_TEST_CASE(admission_control_disk_limit)
+{
+	fileserver::admission_control admission(0, 4);
+	BOOST_CHECK(!admission.is_disk_queue_full(3));
+	BOOST_CHECK(admission.is_disk_queue_full(4));
+	BOOST_CHECK_EQUAL(0u, admission.rejected_disk_reads());
+	admission.count_rejected_disk_read();
+	BOOST_CHECK_EQUAL(1u, admission.rejected_disk_reads());
+}
+
+BOOST_AUTO_TEST_CASE(admission_control_unlimited)
+{
+	fileserver::admission_control admission(0, 0);
+	for (int i = 0; i < 1000; ++i)
+	{
+		BOOST_CHECK(admission.try_start_session());
+	}
+	BOOST_CHECK(!admission.is_disk_queue_full(1000000));
+	BOOST_CHECK_EQUAL(0u, admission.rejected_sessions());
+	BOOST_CHECK_EQUAL(0u, admission.rejected_disk_reads());
+}
@@ -0,0 +1,73 @@
+#include <server/batch_format.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+	Si::memory_range as_range(std::string const &text)
+	{
+		return Si::make_memory_range(text.data(), text.data() + text.size());
+	}
+
+	fileserver::sha256_digest make_digest(fileserver::byte first)
+	{
+		fileserver::sha256_digest digest;
+		digest.bytes[0] = first;
+		return digest;
+	}
+
+	std::string const a = "aa00000000000000000000000000000000000000000000000000000000000000";
+	std::string const b = "bb00000000000000000000000000000000000000000000000000000000000000";
+}
+
+BOOST_AUTO_TEST_CASE(batch_request_parse)
+{
+	std::vector<fileserver::sha256_digest> digests;
+	BOOST_REQUIRE(fileserver::parse_batch_request(as_range(a + "\n" + b + "\r\n\n"), digests));
+	BOOST_REQUIRE_EQUAL(2u, digests.size());
+	BOOST_CHECK(make_digest(0xaa) == digests[0]);
+	BOOST_CHECK(make_digest(0xbb) == digests[1]);
+
+	digests.clear();
+	BOOST_CHECK(fileserver::parse_batch_request(as_range(""), digests));
+	BOOST_CHECK(digests.empty());
+	BOOST_CHECK(fileserver::parse_batch_request(as_range(" " + a + " " + a), digests));
+	BOOST_CHECK_EQUAL(2u, digests.size());
+}
+
+BOOST_AUTO_TEST_CASE(batch_request_parse_malformed)
+{
+	std::vector<fileserver::sha256_digest> digests;
+	BOOST_CHECK(!fileserver::parse_batch_request(as_range(a + b), digests));
+	BOOST_CHECK(!fileserver::parse_batch_request(as_range(a.substr(1)), digests));
+	BOOST_CHECK(!fileserver::parse_batch_request(as_range(a + ",\n"), digests));
+}
+
+BOOST_AUTO_TEST_CASE(batch_item_header_round_trip)
+{
+	std::string const found = fileserver::format_batch_item_header(make_digest(0xaa), boost::uint64_t(1234));
+	BOOST_CHECK_EQUAL(a + " 1234\n", found);
+	Si::optional<fileserver::batch_item_header> const parsed_found =
+	    fileserver::parse_batch_item_header(as_range(found.substr(0, found.size() - 1)));
+	BOOST_REQUIRE(parsed_found);
+	BOOST_CHECK(fileserver::to_unknown_digest(make_digest(0xaa)) == parsed_found->digest);
+	BOOST_REQUIRE(parsed_found->size);
+	BOOST_CHECK_EQUAL(1234u, *parsed_found->size);
+
+	std::string const missing = fileserver::format_batch_item_header(make_digest(0xbb), Si::none);
+	BOOST_CHECK_EQUAL(b + " -\n", missing);
+	Si::optional<fileserver::batch_item_header> const parsed_missing =
+	    fileserver::parse_batch_item_header(as_range(missing.substr(0, missing.size() - 1)));
+	BOOST_REQUIRE(parsed_missing);
+	BOOST_CHECK(!parsed_missing->size);
+}
+
+BOOST_AUTO_TEST_CASE(batch_item_header_parse_malformed)
+{
+	BOOST_CHECK(!fileserver::parse_batch_item_header(as_range(a)));
+	BOOST_CHECK(!fileserver::parse_batch_item_header(as_range(a + " ")));
+	BOOST_CHECK(!fileserver::parse_batch_item_header(as_range(a + " -1")));
+	BOOST_CHECK(!fileserver::parse_batch_item_header(as_range(a + " 12x")));
+	BOOST_CHECK(!fileserver::parse_batch_item_header(as_range(a + " 99999999999999999999999")));
+	BOOST_CHECK(!fileserver::parse_batch_item_header(as_range("xyz 12")));
+	BOOST_CHECK(!fileserver::parse_batch_item_header(as_range(" 12")));
+}
@@ -0,0 +1,117 @@
+#include <server/blob_cache.hpp>
+#include <boost/test/unit_test.hpp>
+#include <string>
+
+namespace
+{
+	typedef fileserver::blob_cache<std::string> string_cache;
+
+	string_cache::content_ptr make_blob(std::size_t size)
+	{
+		return std::make_shared<std::vector<char> const>(size, 'a');
+	}
+
+	//! requests a blob like a session does and reads it "from the disk" on a miss
+	bool request(string_cache &cache, std::string const &key, std::size_t size)
+	{
+		if (cache.find(key))
+		{
+			return true;
+		}
+		cache.insert(key, make_blob(size));
+		return false;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(blob_cache_hit_and_miss)
+{
+	string_cache cache(1000, 100);
+	BOOST_CHECK(!request(cache, "a", 10));
+	BOOST_CHECK(request(cache, "a", 10));
+	BOOST_CHECK_EQUAL(1u, cache.hits());
+	BOOST_CHECK_EQUAL(1u, cache.misses());
+	BOOST_CHECK_EQUAL(1u, cache.size());
+	BOOST_CHECK_EQUAL(10u, cache.bytes());
+}
+
+BOOST_AUTO_TEST_CASE(blob_cache_rejects_large_blobs)
+{
+	string_cache cache(1000, 100);
+	BOOST_CHECK(cache.admits(100));
+	BOOST_CHECK(!cache.admits(101));
+	cache.insert("a", make_blob(101));
+	BOOST_CHECK(!cache.find("a"));
+	BOOST_CHECK_EQUAL(0u, cache.size());
+}
+
+BOOST_AUTO_TEST_CASE(blob_cache_disabled)
+{
+	string_cache cache(0, 100);
+	BOOST_CHECK(!cache.admits(0));
+	BOOST_CHECK(!request(cache, "a", 0));
+	BOOST_CHECK(!request(cache, "a", 0));
+}
+
+BOOST_AUTO_TEST_CASE(blob_cache_stays_within_budget)
+{
+	string_cache cache(1000, 100);
+	for (std::size_t i = 0; i < 100; ++i)
+	{
+		std::string const key = std::to_string(i % 30);
+		request(cache, key, 100);
+		request(cache, key, 100);
+		BOOST_CHECK_LE(cache.bytes(), 1000u);
+	}
+	BOOST_CHECK_EQUAL(10u, cache.size());
+}
+
+BOOST_AUTO_TEST_CASE(blob_cache_resists_scans)
+{
+	string_cache cache(1000, 100);
+	// hot blobs are requested twice
+	for (std::size_t i = 0; i < 5; ++i)
+	{
+		std::string const key = "hot" + std::to_string(i);
+		request(cache, key, 100);
+		BOOST_CHECK(request(cache, key, 100));
+	}
+	// a clone requests many other blobs once
+	for (std::size_t i = 0; i < 1000; ++i)
+	{
+		BOOST_CHECK(!request(cache, "cold" + std::to_string(i), 100));
+	}
+	for (std::size_t i = 0; i < 5; ++i)
+	{
+		BOOST_CHECK(cache.find("hot" + std::to_string(i)));
+	}
+	BOOST_CHECK_LE(cache.bytes(), 1000u);
+}
+
+BOOST_AUTO_TEST_CASE(blob_cache_remembers_recently_forgotten_blobs)
+{
+	string_cache cache(1000, 100);
+	// only two blobs of this size fit into the probation queue
+	BOOST_CHECK(!request(cache, "a", 100));
+	BOOST_CHECK(!request(cache, "b", 100));
+	BOOST_CHECK(!request(cache, "c", 100));
+	BOOST_CHECK(!request(cache, "d", 100));
+	// a has left the cache, but the next miss makes it hot
+	BOOST_CHECK(!request(cache, "a", 100));
+	for (std::size_t i = 0; i < 10; ++i)
+	{
+		request(cache, "cold" + std::to_string(i), 100);
+	}
+	BOOST_CHECK(cache.find("a"));
+}
+
+BOOST_AUTO_TEST_CASE(blob_cache_clear)
+{
+	string_cache cache(1000, 100);
+	request(cache, "a", 10);
+	request(cache, "a", 10);
+	request(cache, "b", 10);
+	cache.clear();
+	BOOST_CHECK_EQUAL(0u, cache.size());
+	BOOST_CHECK_EQUAL(0u, cache.bytes());
+	BOOST_CHECK(!request(cache, "a", 10));
+}
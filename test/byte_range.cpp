@@ -0,0 +1,78 @@
+#include <server/byte_range.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+namespace
+{
+	Si::optional<std::vector<fileserver::byte_range>> parse(char const *header, boost::uint64_t size)
+	{
+		return fileserver::parse_range_header(boost::make_iterator_range(header, header + std::strlen(header)), size);
+	}
+
+	std::vector<fileserver::byte_range> ranges(std::initializer_list<fileserver::byte_range> elements)
+	{
+		return std::vector<fileserver::byte_range>(elements);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(byte_range_single)
+{
+	BOOST_CHECK(ranges({{0, 500}}) == parse("bytes=0-499", 1000));
+	BOOST_CHECK(ranges({{500, 500}}) == parse("bytes=500-999", 1000));
+	BOOST_CHECK(ranges({{500, 500}}) == parse("bytes=500-", 1000));
+	BOOST_CHECK(ranges({{900, 100}}) == parse("bytes=-100", 1000));
+	BOOST_CHECK(ranges({{0, 1000}}) == parse("BYTES = 0-", 1000));
+}
+
+BOOST_AUTO_TEST_CASE(byte_range_clamped_to_size)
+{
+	BOOST_CHECK(ranges({{500, 500}}) == parse("bytes=500-5000", 1000));
+	BOOST_CHECK(ranges({{0, 1000}}) == parse("bytes=-5000", 1000));
+}
+
+BOOST_AUTO_TEST_CASE(byte_range_multiple_are_sorted_and_merged)
+{
+	BOOST_CHECK(ranges({{0, 1}, {998, 2}}) == parse("bytes=-2, 0-0", 1000));
+	BOOST_CHECK(ranges({{0, 200}}) == parse("bytes=0-99,100-199", 1000));
+	BOOST_CHECK(ranges({{0, 1000}}) == parse("bytes=0-,0-,0-,500-600", 1000));
+	BOOST_CHECK(ranges({{10, 11}, {50, 1}}) == parse("bytes=,10-20, ,50-50,", 1000));
+}
+
+BOOST_AUTO_TEST_CASE(byte_range_unsatisfiable)
+{
+	BOOST_CHECK(ranges({}) == parse("bytes=1000-", 1000));
+	BOOST_CHECK(ranges({}) == parse("bytes=-0", 1000));
+	BOOST_CHECK(ranges({}) == parse("bytes=0-", 0));
+	BOOST_CHECK(ranges({{0, 1}}) == parse("bytes=2000-3000,0-0", 1000));
+}
+
+BOOST_AUTO_TEST_CASE(byte_range_malformed_is_ignored)
+{
+	BOOST_CHECK(!parse("", 1000));
+	BOOST_CHECK(!parse("bytes=", 1000));
+	BOOST_CHECK(!parse("items=0-1", 1000));
+	BOOST_CHECK(!parse("bytes=1-0", 1000));
+	BOOST_CHECK(!parse("bytes=a-b", 1000));
+	BOOST_CHECK(!parse("bytes=0-1;", 1000));
+	BOOST_CHECK(!parse("bytes=-", 1000));
+	BOOST_CHECK(!parse("bytes=99999999999999999999-", 1000));
+}
+
+BOOST_AUTO_TEST_CASE(byte_range_too_many_ranges_are_ignored)
+{
+	std::string header = "bytes=0-0";
+	for (std::size_t i = 1; i < fileserver::max_byte_ranges_per_request; ++i)
+	{
+		header += ",0-0";
+	}
+	BOOST_CHECK(ranges({{0, 1}}) == fileserver::parse_range_header(header, 1000));
+	header += ",0-0";
+	BOOST_CHECK(!fileserver::parse_range_header(header, 1000));
+}
+
+BOOST_AUTO_TEST_CASE(byte_range_content_range)
+{
+	BOOST_CHECK_EQUAL("bytes 0-499/1000", fileserver::format_content_range(fileserver::byte_range{0, 500}, 1000));
+	BOOST_CHECK_EQUAL("bytes */1000", fileserver::format_unsatisfied_content_range(1000));
+}
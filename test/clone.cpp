@@ -1,11 +1,22 @@
 #include <client/clone.hpp>
+#include <storage_reader/http_storage_reader.hpp>
+#include <server/batch_format.hpp>
+#include <server/directory_listing.hpp>
+#include <server/pack_format.hpp>
 #include <silicium/observable/for_each.hpp>
 #include <silicium/observable/coroutine_generator.hpp>
 #include <silicium/observable/function.hpp>
 #include <silicium/observable/take.hpp>
 #include <silicium/observable/ready_future.hpp>
+#include <silicium/source/single_source.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/unordered_map.hpp>
+#include <chrono>
+#include <map>
+#include <set>
+#include <thread>
 
 namespace Si
 {
@@ -95,10 +106,123 @@ namespace
 		boost::filesystem::path location;
 	};
 
+	//! The directories and files that a clone has created, by their paths relative to the destination. The path of
+	//! a directory ends with a slash.
+	struct memory_file_system
+	{
+		std::set<std::string> directories;
+		std::map<std::string, std::string> files;
+	};
+
+	struct memory_writeable_file : fileserver::writeable_file
+	{
+		explicit memory_writeable_file(std::string &content)
+		    : content(content)
+		{
+		}
+
+		virtual boost::system::error_code seek(fileserver::file_offset destination) SILICIUM_OVERRIDE
+		{
+			boost::ignore_unused_variable_warning(destination);
+			BOOST_FAIL("unexpected seek");
+			return boost::system::error_code();
+		}
+
+		virtual boost::system::error_code write(Si::memory_range const &written) SILICIUM_OVERRIDE
+		{
+			content.append(written.begin(), written.end());
+			return boost::system::error_code();
+		}
+
+	private:
+		std::string &content;
+	};
+
+	struct memory_readable_file : fileserver::readable_file
+	{
+		explicit memory_readable_file(std::string const &content)
+		    : content(content)
+		{
+		}
+
+		virtual Si::error_or<std::unique_ptr<Si::source<Si::error_or<Si::memory_range>>>>
+		read(fileserver::file_offset begin) SILICIUM_OVERRIDE
+		{
+			Si::memory_range const rest = Si::make_memory_range(content.data() + static_cast<std::size_t>(begin),
+			                                                    content.data() + content.size());
+			return Si::error_or<std::unique_ptr<Si::source<Si::error_or<Si::memory_range>>>>(
+			    Si::to_unique(Si::Source<Si::error_or<Si::memory_range>>::erase(
+			        Si::make_single_source(Si::error_or<Si::memory_range>(rest)))));
+		}
+
+	private:
+		std::string const &content;
+	};
+
+	struct memory_directory_manipulator : fileserver::directory_manipulator
+	{
+		memory_directory_manipulator(memory_file_system &written, std::string path)
+		    : written(written)
+		    , path(std::move(path))
+		{
+		}
+
+		virtual boost::system::error_code require_exists() SILICIUM_OVERRIDE
+		{
+			written.directories.insert(path);
+			return {};
+		}
+
+		virtual std::unique_ptr<fileserver::directory_manipulator>
+		edit_subdirectory(std::string const &name) SILICIUM_OVERRIDE
+		{
+			return Si::make_unique<memory_directory_manipulator>(written, path + name + "/");
+		}
+
+		virtual Si::error_or<std::unique_ptr<fileserver::writeable_file>>
+		create_regular_file(std::string const &name) SILICIUM_OVERRIDE
+		{
+			BOOST_CHECK_MESSAGE(written.directories.count(path), "a file is created before its directory: " + name);
+			std::string &content = written.files[path + name];
+			content.clear();
+			return Si::make_unique<memory_writeable_file>(content);
+		}
+
+		virtual Si::error_or<fileserver::read_write_file>
+		read_write_regular_file(std::string const &name) SILICIUM_OVERRIDE
+		{
+			auto const found = written.files.find(path + name);
+			if (found == written.files.end())
+			{
+				return boost::system::error_code(ENOENT, boost::system::system_category());
+			}
+			fileserver::read_write_file opened{Si::make_unique<memory_readable_file>(found->second),
+			                                   Si::make_unique<memory_writeable_file>(found->second)};
+			return std::move(opened);
+		}
+
+	private:
+		memory_file_system &written;
+		std::string path;
+	};
+
 	struct memory_storage_reader : fileserver::storage_reader
 	{
 		boost::unordered_map<fileserver::unknown_digest, std::shared_ptr<std::vector<char> const>> files;
 
+		//! the names of every open_batch call
+		std::vector<std::vector<fileserver::unknown_digest>> batches;
+
+		//! the content of a pack by the digest of its directory
+		boost::unordered_map<fileserver::unknown_digest, std::string> packs;
+
+		//! a pack arrives in pieces of this size, so that lines and contents are split
+		std::size_t pack_piece_size = 7;
+
+		//! the content of a pack ends after this many bytes as if the connection was lost, although the whole size
+		//! is announced
+		std::size_t pack_cut = std::string::npos;
+
 		virtual Si::unique_observable<Si::error_or<fileserver::linear_file>>
 		open(fileserver::unknown_digest const &name) SILICIUM_OVERRIDE
 		{
@@ -133,7 +257,264 @@ namespace
 			return Si::erase_unique(
 			    Si::make_ready_future_observable(Si::error_or<fileserver::file_offset>(it->second->size())));
 		}
+
+		virtual Si::unique_observable<Si::error_or<fileserver::linear_file>>
+		open_batch(std::vector<fileserver::unknown_digest> names) SILICIUM_OVERRIDE
+		{
+			batches.emplace_back(names);
+			return fileserver::storage_reader::open_batch(std::move(names));
+		}
+
+		virtual Si::unique_observable<Si::error_or<fileserver::linear_file>>
+		open_pack(fileserver::unknown_digest const &directory) SILICIUM_OVERRIDE
+		{
+			auto const found = packs.find(directory);
+			if (found == packs.end())
+			{
+				return Si::erase_unique(Si::make_ready_future_observable(Si::error_or<fileserver::linear_file>(
+				    boost::system::error_code(fileserver::service_error::file_not_found))));
+			}
+			auto const content = std::make_shared<std::string const>(found->second.substr(0, pack_cut));
+			std::size_t const piece_size = pack_piece_size;
+			return Si::erase_unique(
+			    Si::make_ready_future_observable(Si::error_or<fileserver::linear_file>(fileserver::linear_file{
+			        static_cast<fileserver::file_offset>(found->second.size()),
+			        Si::erase_unique(Si::make_coroutine_generator<Si::error_or<Si::memory_range>>(
+			            [content, piece_size](Si::push_context<Si::error_or<Si::memory_range>> yield)
+			            {
+				            for (std::size_t i = 0; i < content->size(); i += piece_size)
+				            {
+					            char const *const begin = content->data() + i;
+					            yield(Si::make_memory_range(begin, begin + std::min(piece_size, content->size() - i)));
+				            }
+				        }))})));
+		}
+	};
+
+	fileserver::sha256_digest make_digest(fileserver::byte first)
+	{
+		fileserver::sha256_digest digest;
+		digest.bytes[0] = first;
+		return digest;
+	}
+
+	void add_blob(memory_storage_reader &service, fileserver::sha256_digest const &digest, std::string const &content)
+	{
+		service.files[fileserver::to_unknown_digest(digest)] =
+		    Si::to_shared(std::vector<char>(content.begin(), content.end()));
+	}
+
+	void add_listing(memory_storage_reader &service, fileserver::sha256_digest const &digest,
+	                 fileserver::directory_listing const &listing)
+	{
+		service.files[fileserver::to_unknown_digest(digest)] =
+		    Si::to_shared(fileserver::directory_listing_to_json_bytes(listing).first);
+	}
+
+	fileserver::typed_reference blob_reference(fileserver::sha256_digest const &digest)
+	{
+		return fileserver::typed_reference(fileserver::blob_content_type, digest);
+	}
+
+	fileserver::typed_reference listing_reference(fileserver::sha256_digest const &digest)
+	{
+		return fileserver::typed_reference(fileserver::json_listing_content_type, digest);
+	}
+
+	std::string pack_blob(fileserver::sha256_digest const &digest, std::string const &content)
+	{
+		return fileserver::format_pack_object_header(blob_reference(digest), content.size()) + content;
+	}
+
+	std::string pack_listing(fileserver::sha256_digest const &digest, fileserver::directory_listing const &listing)
+	{
+		std::vector<char> const serialized = fileserver::directory_listing_to_json_bytes(listing).first;
+		return fileserver::format_pack_object_header(listing_reference(digest), serialized.size()) +
+		       std::string(serialized.begin(), serialized.end());
+	}
+
+	//! root/           (listing 1)
+	//!     a           (blob 10)
+	//!     sub/        (listing 2)
+	//!         b       (blob 11)
+	//!         deeper/ (listing 3)
+	//!             c   (blob 12)
+	//!         empty/  (listing 4)
+	std::string make_nested_pack()
+	{
+		fileserver::directory_listing deeper;
+		deeper.entries["c"] = blob_reference(make_digest(12));
+		fileserver::directory_listing sub;
+		sub.entries["b"] = blob_reference(make_digest(11));
+		sub.entries["deeper"] = listing_reference(make_digest(3));
+		sub.entries["empty"] = listing_reference(make_digest(4));
+		fileserver::directory_listing root;
+		root.entries["a"] = blob_reference(make_digest(10));
+		root.entries["sub"] = listing_reference(make_digest(2));
+		return pack_listing(make_digest(1), root) + pack_listing(make_digest(2), sub) +
+		       pack_listing(make_digest(3), deeper) + pack_listing(make_digest(4), fileserver::directory_listing()) +
+		       pack_blob(make_digest(10), "alpha") + pack_blob(make_digest(11), "beta") +
+		       pack_blob(make_digest(12), "gamma");
+	}
+
+	boost::system::error_code wait_for_result(Si::unique_observable<boost::system::error_code> operation,
+	                                          boost::asio::io_service &io)
+	{
+		Si::optional<boost::system::error_code> result;
+		auto all = Si::for_each(std::move(operation), [&result](boost::system::error_code ec)
+		                        {
+			                        BOOST_CHECK(!result);
+			                        result = ec;
+			                    });
+		all.start();
+		io.run();
+		BOOST_REQUIRE(result);
+		return *result;
+	}
+
+	//! Answers a single HTTP request with a canned response. Every piece of the response is written on its own
+	//! after a short pause, so that the client usually receives them separately.
+	struct canned_http_server
+	{
+		explicit canned_http_server(std::vector<std::string> response_pieces)
+		    : acceptor(io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+		{
+			serving = std::thread([this, response_pieces]()
+			                      {
+				                      serve(response_pieces);
+				                  });
+		}
+
+		~canned_http_server()
+		{
+			if (serving.joinable())
+			{
+				serving.join();
+			}
+		}
+
+		boost::asio::ip::tcp::endpoint endpoint() const
+		{
+			return acceptor.local_endpoint();
+		}
+
+		//! \return the complete request after the response has been sent
+		std::string wait_for_request()
+		{
+			serving.join();
+			return request;
+		}
+
+	private:
+		boost::asio::io_service io;
+		boost::asio::ip::tcp::acceptor acceptor;
+		std::string request;
+		std::thread serving;
+
+		void serve(std::vector<std::string> const &response_pieces)
+		{
+			boost::asio::ip::tcp::socket client(io);
+			acceptor.accept(client);
+			client.set_option(boost::asio::ip::tcp::no_delay(true));
+			receive_request(client);
+			for (std::string const &piece : response_pieces)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+				boost::asio::write(client, boost::asio::buffer(piece));
+			}
+			client.shutdown(boost::asio::ip::tcp::socket::shutdown_send);
+		}
+
+		void receive_request(boost::asio::ip::tcp::socket &client)
+		{
+			std::size_t expected_size = std::string::npos;
+			while (request.size() < expected_size)
+			{
+				char buffer[4096];
+				boost::system::error_code ec;
+				std::size_t const received = client.read_some(boost::asio::buffer(buffer), ec);
+				if (ec)
+				{
+					return;
+				}
+				request.append(buffer, received);
+				std::size_t const header_end = request.find("\r\n\r\n");
+				if ((expected_size == std::string::npos) && (header_end != std::string::npos))
+				{
+					std::string const length_field = "Content-Length: ";
+					std::size_t const length = request.find(length_field);
+					expected_size = header_end + 4;
+					if ((length != std::string::npos) && (length < header_end))
+					{
+						expected_size += boost::lexical_cast<std::size_t>(request.substr(
+						    length + length_field.size(), request.find('\r', length) - length - length_field.size()));
+					}
+				}
+			}
+		}
 	};
+
+	struct received_file
+	{
+		boost::system::error_code error;
+		std::string content;
+	};
+
+	//! Reads every file of a batch completely before the next one is requested.
+	std::vector<received_file> receive_batch(fileserver::storage_reader &service, boost::asio::io_service &io,
+	                                         std::vector<fileserver::unknown_digest> const &names)
+	{
+		std::vector<received_file> received;
+		wait_for_result(
+		    Si::erase_unique(Si::make_coroutine_generator<boost::system::error_code>(
+		        [&service, &names, &received](Si::push_context<boost::system::error_code> yield)
+		        {
+			        auto files = service.open_batch(names);
+			        for (std::size_t i = 0; i < names.size(); ++i)
+			        {
+				        boost::optional<Si::error_or<fileserver::linear_file>> file = yield.get_one(files);
+				        if (!file)
+				        {
+					        break;
+				        }
+				        received.emplace_back();
+				        if (file->is_error())
+				        {
+					        received.back().error = file->error();
+					        continue;
+				        }
+				        fileserver::linear_file &opened = file->get();
+				        while (static_cast<fileserver::file_offset>(received.back().content.size()) < opened.size)
+				        {
+					        boost::optional<Si::error_or<Si::memory_range>> const piece = yield.get_one(opened.content);
+					        if (!piece)
+					        {
+						        received.back().error = fileserver::service_error::malformed_response;
+						        break;
+					        }
+					        if (piece->is_error())
+					        {
+						        received.back().error = piece->error();
+						        break;
+					        }
+					        received.back().content.append(piece->get().begin(), piece->get().end());
+				        }
+			        }
+			        yield(boost::system::error_code());
+			    })),
+		    io);
+		return received;
+	}
+
+	std::string format_item(fileserver::sha256_digest const &digest, Si::optional<std::string> const &content)
+	{
+		if (!content)
+		{
+			return fileserver::format_batch_item_header(digest, Si::none);
+		}
+		return fileserver::format_batch_item_header(digest, static_cast<boost::uint64_t>(content->size())) +
+		       *content;
+	}
 }
 
 BOOST_AUTO_TEST_CASE(client_clone_empty)
@@ -154,3 +535,225 @@ BOOST_AUTO_TEST_CASE(client_clone_empty)
 	io.run();
 	BOOST_CHECK(has_finished);
 }
+
+BOOST_AUTO_TEST_CASE(client_clone_fetches_one_batch_per_directory)
+{
+	// root/        (listing 1)
+	//     a        (blob 10)
+	//     b        (blob 11)
+	//     sub/     (listing 2)
+	//         c    (blob 12)
+	memory_storage_reader service;
+	add_blob(service, make_digest(10), "first");
+	add_blob(service, make_digest(11), "second");
+	add_blob(service, make_digest(12), "third");
+	fileserver::directory_listing sub;
+	sub.entries["c"] = blob_reference(make_digest(12));
+	add_listing(service, make_digest(2), sub);
+	fileserver::directory_listing root;
+	root.entries["a"] = blob_reference(make_digest(10));
+	root.entries["b"] = blob_reference(make_digest(11));
+	root.entries["sub"] = listing_reference(make_digest(2));
+	add_listing(service, make_digest(1), root);
+
+	memory_file_system written;
+	memory_directory_manipulator destination(written, "");
+	boost::asio::io_service io;
+	BOOST_CHECK_EQUAL(boost::system::error_code(),
+	                  wait_for_result(fileserver::clone_directory(fileserver::to_unknown_digest(make_digest(1)),
+	                                                              destination, service, io),
+	                                  io));
+
+	BOOST_REQUIRE_EQUAL(2u, service.batches.size());
+	BOOST_CHECK((std::vector<fileserver::unknown_digest>{fileserver::to_unknown_digest(make_digest(10)),
+	                                                     fileserver::to_unknown_digest(make_digest(11))}) ==
+	            service.batches[0]);
+	BOOST_CHECK((std::vector<fileserver::unknown_digest>{fileserver::to_unknown_digest(make_digest(12))}) ==
+	            service.batches[1]);
+	BOOST_CHECK((std::set<std::string>{"", "sub/"}) == written.directories);
+	BOOST_CHECK((std::map<std::string, std::string>{{"a", "first"}, {"b", "second"}, {"sub/c", "third"}}) ==
+	            written.files);
+}
+
+BOOST_AUTO_TEST_CASE(client_clone_batch_of_missing_file)
+{
+	memory_storage_reader service;
+	add_blob(service, make_digest(10), "first");
+	fileserver::directory_listing root;
+	root.entries["a"] = blob_reference(make_digest(10));
+	root.entries["b"] = blob_reference(make_digest(11));
+	add_listing(service, make_digest(1), root);
+
+	memory_file_system written;
+	memory_directory_manipulator destination(written, "");
+	boost::asio::io_service io;
+	BOOST_CHECK_EQUAL(boost::system::error_code(fileserver::service_error::file_not_found),
+	                  wait_for_result(fileserver::clone_directory(fileserver::to_unknown_digest(make_digest(1)),
+	                                                              destination, service, io),
+	                                  io));
+}
+
+BOOST_AUTO_TEST_CASE(http_storage_reader_batch_split_stream)
+{
+	std::string const items = format_item(make_digest(10), std::string("hello")) +
+	                          format_item(make_digest(11), Si::none) +
+	                          format_item(make_digest(12), std::string(10000, 'x'));
+	std::string const header = "HTTP/1.0 200 OK\r\nContent-Length: " + boost::lexical_cast<std::string>(items.size()) +
+	                           "\r\n\r\n";
+	// The first piece ends inside the first line of the body, which receive_response_header has to hand over
+	// together with the header. The others split a line and a content.
+	std::size_t const first_split = 20;
+	std::size_t const second_split = items.find('-') - 5;
+	std::size_t const third_split = items.size() - 100;
+	canned_http_server server(std::vector<std::string>{
+	    header + items.substr(0, first_split), items.substr(first_split, second_split - first_split),
+	    items.substr(second_split, third_split - second_split), items.substr(third_split)});
+
+	boost::asio::io_service io;
+	fileserver::http_storage_reader service(io, server.endpoint(), "/");
+	std::vector<fileserver::unknown_digest> const names{fileserver::to_unknown_digest(make_digest(10)),
+	                                                    fileserver::to_unknown_digest(make_digest(11)),
+	                                                    fileserver::to_unknown_digest(make_digest(12))};
+	std::vector<received_file> const received = receive_batch(service, io, names);
+
+	BOOST_REQUIRE_EQUAL(3u, received.size());
+	BOOST_CHECK_EQUAL(boost::system::error_code(), received[0].error);
+	BOOST_CHECK_EQUAL("hello", received[0].content);
+	BOOST_CHECK_EQUAL(boost::system::error_code(fileserver::service_error::file_not_found), received[1].error);
+	BOOST_CHECK_EQUAL(boost::system::error_code(), received[2].error);
+	BOOST_CHECK(std::string(10000, 'x') == received[2].content);
+
+	std::string const request = server.wait_for_request();
+	BOOST_CHECK(boost::algorithm::starts_with(request, "POST /batch "));
+	std::string expected_body;
+	for (fileserver::unknown_digest const &name : names)
+	{
+		fileserver::encode_ascii_hex_digits(name.begin(), name.end(), std::back_inserter(expected_body));
+		expected_body += '\n';
+	}
+	BOOST_CHECK(boost::algorithm::ends_with(request, "\r\n\r\n" + expected_body));
+}
+
+BOOST_AUTO_TEST_CASE(http_storage_reader_batch_error_status)
+{
+	canned_http_server server(
+	    std::vector<std::string>{"HTTP/1.0 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n"});
+	boost::asio::io_service io;
+	fileserver::http_storage_reader service(io, server.endpoint(), "/");
+	std::vector<received_file> const received =
+	    receive_batch(service, io, std::vector<fileserver::unknown_digest>{
+	                                   fileserver::to_unknown_digest(make_digest(10)),
+	                                   fileserver::to_unknown_digest(make_digest(11))});
+	// the whole batch fails with the first file
+	BOOST_REQUIRE_EQUAL(1u, received.size());
+	BOOST_CHECK_EQUAL(boost::system::error_code(fileserver::service_error::file_not_found), received[0].error);
+}
+
+BOOST_AUTO_TEST_CASE(http_storage_reader_batch_short_stream)
+{
+	// the connection ends in the middle of the content of the first file
+	canned_http_server server(std::vector<std::string>{"HTTP/1.0 200 OK\r\n\r\n",
+	                                                   fileserver::format_batch_item_header(make_digest(10), 10) +
+	                                                       "abcd"});
+	boost::asio::io_service io;
+	fileserver::http_storage_reader service(io, server.endpoint(), "/");
+	std::vector<received_file> const received =
+	    receive_batch(service, io, std::vector<fileserver::unknown_digest>{
+	                                   fileserver::to_unknown_digest(make_digest(10)),
+	                                   fileserver::to_unknown_digest(make_digest(11))});
+	BOOST_REQUIRE(!received.empty());
+	BOOST_CHECK(received[0].error);
+	BOOST_CHECK_EQUAL("abcd", received[0].content);
+	if (received.size() > 1)
+	{
+		BOOST_CHECK(received[1].error);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(client_clone_pack_nested)
+{
+	fileserver::unknown_digest const root = fileserver::to_unknown_digest(make_digest(1));
+	memory_storage_reader service;
+	service.packs[root] = make_nested_pack();
+	memory_file_system written;
+	memory_directory_manipulator destination(written, "");
+	boost::asio::io_service io;
+	BOOST_CHECK_EQUAL(boost::system::error_code(),
+	                  wait_for_result(fileserver::clone_directory_from_pack(root, destination, service), io));
+	BOOST_CHECK((std::set<std::string>{"", "sub/", "sub/deeper/", "sub/empty/"}) == written.directories);
+	BOOST_CHECK((std::map<std::string, std::string>{{"a", "alpha"}, {"sub/b", "beta"}, {"sub/deeper/c", "gamma"}}) ==
+	            written.files);
+}
+
+BOOST_AUTO_TEST_CASE(client_clone_pack_repeated_objects)
+{
+	// root/     (listing 1)
+	//     x     (blob 10)
+	//     d1/   (listing 2)
+	//         y (blob 10)
+	//     d2/   (listing 2)
+	//         y (blob 10)
+	fileserver::directory_listing same;
+	same.entries["y"] = blob_reference(make_digest(10));
+	fileserver::directory_listing root_listing;
+	root_listing.entries["x"] = blob_reference(make_digest(10));
+	root_listing.entries["d1"] = listing_reference(make_digest(2));
+	root_listing.entries["d2"] = listing_reference(make_digest(2));
+
+	fileserver::unknown_digest const root = fileserver::to_unknown_digest(make_digest(1));
+	memory_storage_reader service;
+	// every object is in the pack only once
+	service.packs[root] = pack_listing(make_digest(1), root_listing) + pack_listing(make_digest(2), same) +
+	                      pack_blob(make_digest(10), "same content");
+	memory_file_system written;
+	memory_directory_manipulator destination(written, "");
+	boost::asio::io_service io;
+	BOOST_CHECK_EQUAL(boost::system::error_code(),
+	                  wait_for_result(fileserver::clone_directory_from_pack(root, destination, service), io));
+	BOOST_CHECK((std::set<std::string>{"", "d1/", "d2/"}) == written.directories);
+	BOOST_CHECK((std::map<std::string, std::string>{
+	                {"x", "same content"}, {"d1/y", "same content"}, {"d2/y", "same content"}}) == written.files);
+}
+
+BOOST_AUTO_TEST_CASE(client_clone_pack_truncated)
+{
+	fileserver::unknown_digest const root = fileserver::to_unknown_digest(make_digest(1));
+	std::string const complete = make_nested_pack();
+	// in the first header, in the first listing, in a blob header and in the last blob
+	for (std::size_t cut : {std::size_t(10), std::size_t(80), complete.find(" blob ") - 3, complete.size() - 2})
+	{
+		memory_storage_reader service;
+		service.packs[root] = complete;
+		service.pack_cut = cut;
+		memory_file_system written;
+		memory_directory_manipulator destination(written, "");
+		boost::asio::io_service io;
+		BOOST_CHECK_EQUAL(boost::system::error_code(fileserver::service_error::malformed_response),
+		                  wait_for_result(fileserver::clone_directory_from_pack(root, destination, service), io));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(client_clone_unknown_entry_type)
+{
+	fileserver::directory_listing listing;
+	listing.entries["link"] = fileserver::typed_reference(fileserver::content_type("symlink"), make_digest(10));
+	fileserver::unknown_digest const root = fileserver::to_unknown_digest(make_digest(1));
+	memory_storage_reader service;
+	add_listing(service, make_digest(1), listing);
+	service.packs[root] = pack_listing(make_digest(1), listing);
+
+	{
+		memory_file_system written;
+		memory_directory_manipulator destination(written, "");
+		boost::asio::io_service io;
+		BOOST_CHECK_EQUAL(boost::system::error_code(fileserver::service_error::unknown_entry_type),
+		                  wait_for_result(fileserver::clone_directory(root, destination, service, io), io));
+	}
+	{
+		memory_file_system written;
+		memory_directory_manipulator destination(written, "");
+		boost::asio::io_service io;
+		BOOST_CHECK_EQUAL(boost::system::error_code(fileserver::service_error::unknown_entry_type),
+		                  wait_for_result(fileserver::clone_directory_from_pack(root, destination, service), io));
+	}
+}
@@ -0,0 +1,46 @@
+#include <server/entity_tag.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+	bool weakly_listed(std::string const &header, std::string const &tag)
+	{
+		return fileserver::is_entity_tag_listed(header, tag, fileserver::entity_tag_comparison::weak);
+	}
+
+	bool strongly_listed(std::string const &header, std::string const &tag)
+	{
+		return fileserver::is_entity_tag_listed(header, tag, fileserver::entity_tag_comparison::strong);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(entity_tag_format)
+{
+	fileserver::unknown_digest const digest{0x01, 0xab, 0xff};
+	BOOST_CHECK_EQUAL("\"01abff\"", fileserver::format_entity_tag(digest));
+}
+
+BOOST_AUTO_TEST_CASE(entity_tag_weak_comparison)
+{
+	BOOST_CHECK(weakly_listed("\"abc\"", "\"abc\""));
+	BOOST_CHECK(weakly_listed("W/\"abc\"", "\"abc\""));
+	BOOST_CHECK(weakly_listed("\"x\", \"abc\"", "\"abc\""));
+	BOOST_CHECK(weakly_listed("*", "\"abc\""));
+	BOOST_CHECK(!weakly_listed("\"abcd\"", "\"abc\""));
+	BOOST_CHECK(!weakly_listed("", "\"abc\""));
+}
+
+BOOST_AUTO_TEST_CASE(entity_tag_strong_comparison)
+{
+	BOOST_CHECK(strongly_listed("\"abc\"", "\"abc\""));
+	BOOST_CHECK(!strongly_listed("W/\"abc\"", "\"abc\""));
+	BOOST_CHECK(!strongly_listed("*", "\"abc\""));
+}
+
+BOOST_AUTO_TEST_CASE(entity_tag_malformed_never_matches)
+{
+	BOOST_CHECK(!weakly_listed("abc", "\"abc\""));
+	BOOST_CHECK(!weakly_listed("\"abc", "\"abc\""));
+	BOOST_CHECK(!weakly_listed("W\"abc\"", "\"abc\""));
+	BOOST_CHECK(!weakly_listed("x, \"abc\"", "\"abc\""));
+}
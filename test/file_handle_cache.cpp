@@ -0,0 +1,140 @@
+#include <server/file_handle_cache.hpp>
+#include <boost/test/unit_test.hpp>
+#include <string>
+
+namespace
+{
+	typedef fileserver::file_handle_cache<std::string, int> int_cache;
+
+	void open(int_cache &cache, std::string const &key, int value)
+	{
+		int_cache::lookup const found = cache.find(key);
+		BOOST_REQUIRE(!found.handle);
+		cache.insert(key, std::make_shared<int>(value), found.generation);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(file_handle_cache_hit_and_miss)
+{
+	int_cache cache(2);
+	open(cache, "a", 1);
+	int_cache::lookup const found = cache.find("a");
+	BOOST_REQUIRE(found.handle);
+	BOOST_CHECK_EQUAL(1, *found.handle);
+	BOOST_CHECK_EQUAL(1u, cache.hits());
+	BOOST_CHECK_EQUAL(1u, cache.misses());
+}
+
+BOOST_AUTO_TEST_CASE(file_handle_cache_evicts_least_recently_used)
+{
+	int_cache cache(2);
+	open(cache, "a", 1);
+	open(cache, "b", 2);
+	// a is now used more recently than b
+	BOOST_CHECK(cache.find("a").handle);
+	open(cache, "c", 3);
+	BOOST_CHECK_EQUAL(2u, cache.size());
+	BOOST_CHECK(cache.find("a").handle);
+	BOOST_CHECK(!cache.find("b").handle);
+	BOOST_CHECK(cache.find("c").handle);
+}
+
+BOOST_AUTO_TEST_CASE(file_handle_cache_evicted_handle_stays_valid)
+{
+	int_cache cache(1);
+	open(cache, "a", 1);
+	std::shared_ptr<int> const in_use = cache.find("a").handle;
+	open(cache, "b", 2);
+	BOOST_REQUIRE(in_use);
+	BOOST_CHECK_EQUAL(1, *in_use);
+}
+
+BOOST_AUTO_TEST_CASE(file_handle_cache_invalidate)
+{
+	int_cache cache(4);
+	open(cache, "a", 1);
+	open(cache, "b", 2);
+	cache.invalidate("a");
+	BOOST_CHECK(!cache.find("a").handle);
+	BOOST_CHECK(cache.find("b").handle);
+	cache.clear();
+	BOOST_CHECK(!cache.find("b").handle);
+	BOOST_CHECK_EQUAL(0u, cache.size());
+}
+
+BOOST_AUTO_TEST_CASE(file_handle_cache_ignores_outdated_open)
+{
+	int_cache cache(4);
+	int_cache::lookup const missed = cache.find("a");
+	// the file changes while it is being opened
+	cache.invalidate("a");
+	cache.insert("a", std::make_shared<int>(1), missed.generation);
+	BOOST_CHECK(!cache.find("a").handle);
+}
+
+BOOST_AUTO_TEST_CASE(file_handle_cache_keeps_first_of_concurrent_opens)
+{
+	int_cache cache(4);
+	// two threads miss the same file and both open it
+	int_cache::lookup const first = cache.find("a");
+	int_cache::lookup const second = cache.find("a");
+	cache.insert("a", std::make_shared<int>(1), first.generation, 2);
+	cache.insert("a", std::make_shared<int>(2), second.generation, 2);
+	int_cache::lookup const found = cache.find("a");
+	BOOST_REQUIRE(found.handle);
+	BOOST_CHECK_EQUAL(1, *found.handle);
+	BOOST_CHECK_EQUAL(1u, cache.size());
+	BOOST_CHECK_EQUAL(2u, cache.weight());
+}
+
+BOOST_AUTO_TEST_CASE(file_handle_cache_disabled)
+{
+	int_cache cache(0);
+	open(cache, "a", 1);
+	BOOST_CHECK(!cache.find("a").handle);
+	BOOST_CHECK_EQUAL(0u, cache.size());
+}
+
+BOOST_AUTO_TEST_CASE(file_handle_cache_bounds_total_weight)
+{
+	int_cache cache(10);
+	int_cache::lookup found = cache.find("a");
+	cache.insert("a", std::make_shared<int>(1), found.generation, 4);
+	found = cache.find("b");
+	cache.insert("b", std::make_shared<int>(2), found.generation, 4);
+	BOOST_CHECK_EQUAL(8u, cache.weight());
+	found = cache.find("c");
+	cache.insert("c", std::make_shared<int>(3), found.generation, 4);
+	BOOST_CHECK_EQUAL(2u, cache.size());
+	BOOST_CHECK_EQUAL(8u, cache.weight());
+	BOOST_CHECK(!cache.find("a").handle);
+
+	// a handle heavier than the whole cache is not remembered
+	found = cache.find("d");
+	cache.insert("d", std::make_shared<int>(4), found.generation, 11);
+	BOOST_CHECK(!cache.find("d").handle);
+	BOOST_CHECK_EQUAL(2u, cache.size());
+
+	cache.invalidate("b");
+	BOOST_CHECK_EQUAL(4u, cache.weight());
+}
+
+BOOST_AUTO_TEST_CASE(file_handle_cache_make_room)
+{
+	int_cache cache(10);
+	int_cache::lookup found = cache.find("a");
+	cache.insert("a", std::make_shared<int>(1), found.generation, 4);
+	found = cache.find("b");
+	cache.insert("b", std::make_shared<int>(2), found.generation, 4);
+	BOOST_CHECK(cache.find("a").handle);
+	cache.make_room(2);
+	BOOST_CHECK_EQUAL(2u, cache.size());
+	// b has been used less recently than a
+	cache.make_room(5);
+	BOOST_CHECK_EQUAL(1u, cache.size());
+	BOOST_CHECK(!cache.find("b").handle);
+	BOOST_CHECK(cache.find("a").handle);
+	cache.make_room(100);
+	BOOST_CHECK_EQUAL(0u, cache.size());
+	BOOST_CHECK_EQUAL(0u, cache.weight());
+}
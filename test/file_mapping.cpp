@@ -0,0 +1,111 @@
+#include <server/file_mapping.hpp>
+#include <boost/test/unit_test.hpp>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+namespace
+{
+	struct temporary_file
+	{
+		int descriptor;
+
+		explicit temporary_file(std::size_t size)
+		{
+			char name[] = "/tmp/fileserver_mapping_XXXXXX";
+			descriptor = ::mkstemp(name);
+			BOOST_REQUIRE_GE(descriptor, 0);
+			::unlink(name);
+			std::vector<char> const content(size, 'x');
+			BOOST_REQUIRE_EQUAL(static_cast<ssize_t>(size), ::write(descriptor, content.data(), content.size()));
+		}
+
+		~temporary_file()
+		{
+			::close(descriptor);
+		}
+	};
+
+	struct socket_pair
+	{
+		int sockets[2];
+
+		socket_pair()
+		{
+			BOOST_REQUIRE_EQUAL(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+		}
+
+		~socket_pair()
+		{
+			::close(sockets[0]);
+			::close(sockets[1]);
+		}
+	};
+}
+
+BOOST_AUTO_TEST_CASE(file_mapping_sends_content)
+{
+	temporary_file file(1000);
+	std::unique_ptr<fileserver::file_mapping> const mapping = fileserver::file_mapping::create(file.descriptor, 1000);
+	BOOST_REQUIRE(mapping);
+	BOOST_CHECK_EQUAL(1000u, mapping->size());
+	socket_pair connection;
+	BOOST_REQUIRE_EQUAL(1000, ::send(connection.sockets[0], mapping->data(), mapping->size(), 0));
+	std::vector<char> received(1000);
+	BOOST_REQUIRE_EQUAL(1000, ::recv(connection.sockets[1], received.data(), received.size(), MSG_WAITALL));
+	BOOST_CHECK(std::vector<char>(1000, 'x') == received);
+}
+
+BOOST_AUTO_TEST_CASE(file_mapping_empty_file)
+{
+	temporary_file file(0);
+	BOOST_CHECK(!fileserver::file_mapping::create(file.descriptor, 0));
+}
+
+BOOST_AUTO_TEST_CASE(file_mapping_survives_truncation)
+{
+	std::size_t const size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)) * 4;
+	temporary_file file(size);
+	std::unique_ptr<fileserver::file_mapping> const mapping = fileserver::file_mapping::create(file.descriptor, size);
+	BOOST_REQUIRE(mapping);
+	BOOST_REQUIRE_EQUAL(0, ::ftruncate(file.descriptor, 0));
+	socket_pair connection;
+	// the process would be killed by SIGBUS if the pages were touched in user space
+	ssize_t const sent = ::send(connection.sockets[0], mapping->data(), mapping->size(), MSG_DONTWAIT);
+	BOOST_CHECK_EQUAL(-1, sent);
+	BOOST_CHECK_EQUAL(EFAULT, errno);
+}
+
+BOOST_AUTO_TEST_CASE(file_mapping_prefetch_survives_truncation)
+{
+	std::size_t const size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)) * 4;
+	temporary_file file(size);
+	std::unique_ptr<fileserver::file_mapping> const mapping = fileserver::file_mapping::create(file.descriptor, size);
+	BOOST_REQUIRE(mapping);
+	mapping->prefetch(100, 1000);
+	BOOST_REQUIRE_EQUAL(0, ::ftruncate(file.descriptor, 0));
+	mapping->prefetch(0, size);
+}
+
+BOOST_AUTO_TEST_CASE(file_mapping_budget_counts_evicted_mappings)
+{
+	temporary_file file(1000);
+	fileserver::mapping_budget budget(1500);
+	std::shared_ptr<fileserver::file_mapping> first =
+	    fileserver::create_counted_mapping(budget, file.descriptor, 1000);
+	BOOST_REQUIRE(first);
+	BOOST_CHECK_EQUAL(1000u, budget.used());
+	// a cache may have forgotten the first mapping, but it still exists while somebody sends from it
+	BOOST_CHECK(!fileserver::create_counted_mapping(budget, file.descriptor, 1000));
+	BOOST_CHECK_EQUAL(1000u, budget.used());
+	first.reset();
+	BOOST_CHECK_EQUAL(0u, budget.used());
+	BOOST_CHECK(fileserver::create_counted_mapping(budget, file.descriptor, 1000));
+	BOOST_CHECK_EQUAL(0u, budget.used());
+}
+#endif
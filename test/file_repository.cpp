@@ -0,0 +1,57 @@
+#include <server/file_repository.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+	fileserver::unknown_digest make_digest(fileserver::byte last)
+	{
+		fileserver::sha256_digest digest;
+		digest.bytes.back() = last;
+		return fileserver::to_unknown_digest(digest);
+	}
+
+	void add_copy(fileserver::file_repository &repository, fileserver::unknown_digest const &digest)
+	{
+		repository.add_entry(digest).locations.emplace_back(
+		    fileserver::in_memory_location{std::make_shared<std::vector<char> const>()});
+	}
+}
+
+BOOST_AUTO_TEST_CASE(file_repository_copy_shares_unchanged_entries)
+{
+	fileserver::file_repository original;
+	add_copy(original, make_digest(1));
+	add_copy(original, make_digest(2));
+	BOOST_CHECK_EQUAL(2u, original.size());
+
+	fileserver::file_repository changed = original;
+	add_copy(changed, make_digest(1));
+	changed.erase(make_digest(3));
+
+	// the untouched entry is the same object in both
+	BOOST_CHECK_EQUAL(original.find_entry(make_digest(2)), changed.find_entry(make_digest(2)));
+	BOOST_CHECK_NE(original.find_entry(make_digest(1)), changed.find_entry(make_digest(1)));
+	BOOST_REQUIRE(original.find_location(make_digest(1)));
+	BOOST_CHECK_EQUAL(1u, original.find_location(make_digest(1))->size());
+	BOOST_REQUIRE(changed.find_location(make_digest(1)));
+	BOOST_CHECK_EQUAL(2u, changed.find_location(make_digest(1))->size());
+
+	changed.erase(make_digest(2));
+	BOOST_CHECK(!changed.find_entry(make_digest(2)));
+	BOOST_CHECK(original.find_entry(make_digest(2)));
+	BOOST_CHECK_EQUAL(1u, changed.size());
+}
+
+BOOST_AUTO_TEST_CASE(file_repository_finds_sha256_digest)
+{
+	fileserver::file_repository repository;
+	fileserver::sha256_digest digest;
+	digest.bytes[0] = 7;
+	digest.bytes[30] = 1;
+	digest.bytes[31] = 2;
+	add_copy(repository, fileserver::to_unknown_digest(digest));
+	BOOST_CHECK_EQUAL(repository.find_entry(fileserver::to_unknown_digest(digest)), repository.find_entry(digest));
+	BOOST_CHECK(repository.find_entry(digest));
+	// too short to be any digest in the repository
+	BOOST_CHECK(!repository.find_entry(fileserver::unknown_digest()));
+}
@@ -0,0 +1,197 @@
+#include <server/hash_cache.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/test/unit_test.hpp>
+
+#ifndef _WIN32
+namespace
+{
+	struct temporary_location
+	{
+		boost::filesystem::path file;
+
+		temporary_location()
+		    : file(boost::filesystem::temp_directory_path() /
+		           boost::filesystem::unique_path("fileserver_hash_cache_%%%%-%%%%-%%%%-%%%%"))
+		{
+		}
+
+		~temporary_location()
+		{
+			boost::system::error_code ignored;
+			boost::filesystem::remove(file, ignored);
+		}
+	};
+
+	//! long after the times of make_identity
+	boost::int64_t const scanned = 1000000000000;
+
+	fileserver::file_identity make_identity(boost::uint64_t inode)
+	{
+		return fileserver::file_identity{1, inode, 100, 1000, 2000};
+	}
+
+	fileserver::sha256_digest make_digest(fileserver::byte first)
+	{
+		fileserver::sha256_digest digest;
+		digest.bytes[0] = first;
+		return digest;
+	}
+
+	std::unique_ptr<fileserver::hash_cache> open_cache(boost::filesystem::path const &file)
+	{
+		Si::error_or<std::unique_ptr<fileserver::hash_cache>> opened = fileserver::hash_cache::open(file);
+		BOOST_REQUIRE(!opened.is_error());
+		return std::move(opened.get());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(hash_cache_survives_reopening)
+{
+	temporary_location const location;
+	{
+		std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+		BOOST_CHECK(!cache->find(make_identity(1)));
+		cache->insert(make_identity(1), make_digest(1), scanned);
+		cache->insert(make_identity(2), make_digest(2), scanned);
+		cache->insert(make_identity(1), make_digest(3), scanned);
+	}
+	std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+	BOOST_CHECK_EQUAL(2u, cache->size());
+	Si::optional<fileserver::sha256_digest> const first = cache->find(make_identity(1));
+	BOOST_REQUIRE(first);
+	// the later record wins
+	BOOST_CHECK(make_digest(3) == *first);
+	BOOST_CHECK(cache->find(make_identity(2)));
+	fileserver::file_identity changed = make_identity(2);
+	changed.changed_ns += 1;
+	BOOST_CHECK(!cache->find(changed));
+	BOOST_CHECK_EQUAL(2u, cache->hits());
+	BOOST_CHECK_EQUAL(1u, cache->misses());
+}
+
+BOOST_AUTO_TEST_CASE(hash_cache_keeps_latest_version_of_a_file)
+{
+	std::unique_ptr<fileserver::hash_cache> const cache = fileserver::hash_cache::create_in_memory();
+	cache->insert(make_identity(1), make_digest(1), scanned);
+	fileserver::file_identity rewritten = make_identity(1);
+	rewritten.modified_ns += 1;
+	rewritten.changed_ns += 1;
+	cache->insert(rewritten, make_digest(2), scanned);
+	BOOST_CHECK_EQUAL(1u, cache->size());
+	BOOST_CHECK(!cache->find(make_identity(1)));
+	Si::optional<fileserver::sha256_digest> const found = cache->find(rewritten);
+	BOOST_REQUIRE(found);
+	BOOST_CHECK(make_digest(2) == *found);
+	BOOST_CHECK(!cache->flush());
+	BOOST_CHECK(!cache->compact());
+}
+
+BOOST_AUTO_TEST_CASE(hash_cache_ignores_racily_clean_files)
+{
+	std::unique_ptr<fileserver::hash_cache> const cache = fileserver::hash_cache::create_in_memory();
+	fileserver::file_identity just_written = make_identity(1);
+	just_written.changed_ns = scanned - 1;
+	BOOST_CHECK(!cache->insert(just_written, make_digest(1), scanned));
+	BOOST_CHECK(!cache->find(just_written));
+	fileserver::file_identity touched = make_identity(2);
+	touched.modified_ns = scanned;
+	BOOST_CHECK(!cache->insert(touched, make_digest(2), scanned));
+	BOOST_CHECK_EQUAL(0u, cache->size());
+	// the same file is trusted by a later scan
+	BOOST_CHECK(cache->insert(just_written, make_digest(1), scanned + fileserver::file_time_granularity_ns));
+	BOOST_CHECK(cache->find(just_written));
+}
+
+BOOST_AUTO_TEST_CASE(hash_cache_ignores_torn_record)
+{
+	temporary_location const location;
+	{
+		std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+		cache->insert(make_identity(1), make_digest(1), scanned);
+		cache->insert(make_identity(2), make_digest(2), scanned);
+	}
+	// a crash in the middle of an append
+	boost::filesystem::resize_file(location.file, boost::filesystem::file_size(location.file) - 10);
+	{
+		std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+		BOOST_CHECK(cache->find(make_identity(1)));
+		BOOST_CHECK(!cache->find(make_identity(2)));
+		cache->insert(make_identity(3), make_digest(3), scanned);
+	}
+	std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+	BOOST_CHECK_EQUAL(2u, cache->size());
+	BOOST_CHECK(cache->find(make_identity(3)));
+}
+
+BOOST_AUTO_TEST_CASE(hash_cache_refuses_unknown_format)
+{
+	temporary_location const location;
+	std::string const unrelated = "not a hash cache";
+	{
+		boost::filesystem::ofstream file(location.file, std::ios::binary);
+		file << unrelated;
+	}
+	BOOST_CHECK(fileserver::hash_cache::open(location.file).is_error());
+	// the file has not been touched
+	BOOST_CHECK_EQUAL(unrelated.size(), boost::filesystem::file_size(location.file));
+}
+
+BOOST_AUTO_TEST_CASE(hash_cache_uses_empty_file)
+{
+	temporary_location const location;
+	{
+		boost::filesystem::ofstream empty(location.file, std::ios::binary);
+	}
+	{
+		std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+		BOOST_CHECK_EQUAL(0u, cache->size());
+		cache->insert(make_identity(1), make_digest(1), scanned);
+	}
+	BOOST_CHECK(open_cache(location.file)->find(make_identity(1)));
+}
+
+BOOST_AUTO_TEST_CASE(hash_cache_compact_forgets_unused_entries)
+{
+	temporary_location const location;
+	{
+		std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+		for (boost::uint64_t i = 0; i < 2000; ++i)
+		{
+			cache->insert(make_identity(i), make_digest(1), scanned);
+		}
+	}
+	boost::uintmax_t const full_size = boost::filesystem::file_size(location.file);
+	{
+		std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+		BOOST_CHECK(cache->find(make_identity(7)));
+		BOOST_CHECK(!cache->compact());
+		BOOST_CHECK_EQUAL(1u, cache->size());
+		cache->insert(make_identity(5000), make_digest(2), scanned);
+	}
+	BOOST_CHECK_LT(boost::filesystem::file_size(location.file), full_size / 100);
+	std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+	BOOST_CHECK_EQUAL(2u, cache->size());
+	BOOST_CHECK(cache->find(make_identity(7)));
+	BOOST_CHECK(cache->find(make_identity(5000)));
+	BOOST_CHECK(!cache->find(make_identity(8)));
+}
+BOOST_AUTO_TEST_CASE(hash_cache_drops_outdated_records_while_running)
+{
+	temporary_location const location;
+	std::unique_ptr<fileserver::hash_cache> const cache = open_cache(location.file);
+	cache->insert(make_identity(1), make_digest(1), scanned);
+	fileserver::file_identity changing = make_identity(2);
+	for (int i = 0; i < 10000; ++i)
+	{
+		changing.changed_ns += 1;
+		cache->insert(changing, make_digest(2), scanned);
+	}
+	BOOST_CHECK(!cache->flush());
+	BOOST_CHECK_LT(boost::filesystem::file_size(location.file), 2000u * 80u);
+	std::unique_ptr<fileserver::hash_cache> const reopened = open_cache(location.file);
+	BOOST_CHECK_EQUAL(2u, reopened->size());
+	BOOST_CHECK(reopened->find(make_identity(1)));
+	BOOST_CHECK(reopened->find(changing));
+}
+#endif
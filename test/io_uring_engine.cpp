@@ -0,0 +1,182 @@
+#include <server/linux/io_uring_engine.hpp>
+#include <boost/test/unit_test.hpp>
+#ifdef FILESERVER_HAS_IO_URING
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+	int create_temporary_file(std::vector<char> const &content)
+	{
+		char name[] = "/tmp/fileserver_io_uring_XXXXXX";
+		int const file = ::mkstemp(name);
+		BOOST_REQUIRE_GE(file, 0);
+		::unlink(name);
+		BOOST_REQUIRE_EQUAL(static_cast<ssize_t>(content.size()), ::write(file, content.data(), content.size()));
+		return file;
+	}
+
+	std::vector<char> receive_until_closed(int socket)
+	{
+		std::vector<char> received;
+		char buffer[4096];
+		for (;;)
+		{
+			ssize_t const read = ::read(socket, buffer, sizeof(buffer));
+			if (read <= 0)
+			{
+				return received;
+			}
+			received.insert(received.end(), buffer, buffer + read);
+		}
+	}
+
+	//! \return the error that the chain completed with
+	boost::system::error_code run_until_completed(boost::asio::io_service &io, fileserver::io_uring_engine &engine,
+	                                              fileserver::io_uring_engine::chain const &operations,
+	                                              std::shared_ptr<void> resources)
+	{
+		Si::optional<boost::system::error_code> completed;
+		engine.start(operations, std::move(resources), [&completed](boost::system::error_code ec)
+		             {
+			             completed = ec;
+			         });
+		// the engine always waits for the next completion, so the io_service would never run out of work
+		while (!completed)
+		{
+			io.run_one();
+		}
+		return *completed;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(io_uring_engine_sends_file_through_socket)
+{
+	boost::asio::io_service io;
+	std::unique_ptr<fileserver::io_uring_engine> const engine = fileserver::io_uring_engine::create(io, 2);
+	if (!engine)
+	{
+		BOOST_TEST_MESSAGE("io_uring is not supported by this kernel");
+		return;
+	}
+
+	std::vector<char> content(fileserver::io_uring_engine::buffer_size + 1000);
+	for (std::size_t i = 0; i < content.size(); ++i)
+	{
+		content[i] = static_cast<char>(i % 251);
+	}
+	int const file = create_temporary_file(content);
+	int sockets[2];
+	BOOST_REQUIRE_EQUAL(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+	std::vector<char> received;
+	std::thread client([&received, &sockets]()
+	                   {
+		                   received = receive_until_closed(sockets[1]);
+		               });
+
+	std::string const prefix = "header";
+	auto const buffers = std::make_shared<fileserver::io_uring_buffers>(*engine, 2);
+	BOOST_REQUIRE_EQUAL(2u, buffers->indices().size());
+	fileserver::io_uring_engine::chain operations;
+	operations.send(sockets[0], Si::make_memory_range(prefix.data(), prefix.data() + prefix.size()));
+	std::size_t position = 0;
+	for (unsigned buffer : buffers->indices())
+	{
+		std::size_t const size =
+		    std::min<std::size_t>(std::size_t(fileserver::io_uring_engine::buffer_size), content.size() - position);
+		operations.read(file, position, buffer, size);
+		operations.send(sockets[0],
+		                Si::make_memory_range(engine->get_buffer(buffer), engine->get_buffer(buffer) + size));
+		position += size;
+	}
+	BOOST_CHECK(!run_until_completed(io, *engine, operations, buffers));
+
+	::close(sockets[0]);
+	client.join();
+	std::vector<char> expected(prefix.begin(), prefix.end());
+	expected.insert(expected.end(), content.begin(), content.end());
+	BOOST_CHECK(expected == received);
+
+	::close(sockets[1]);
+	::close(file);
+}
+
+BOOST_AUTO_TEST_CASE(io_uring_engine_fails_chain_when_file_is_shorter)
+{
+	boost::asio::io_service io;
+	std::unique_ptr<fileserver::io_uring_engine> const engine = fileserver::io_uring_engine::create(io, 1);
+	if (!engine)
+	{
+		BOOST_TEST_MESSAGE("io_uring is not supported by this kernel");
+		return;
+	}
+
+	int const file = create_temporary_file(std::vector<char>(100, 'a'));
+	int sockets[2];
+	BOOST_REQUIRE_EQUAL(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+	auto const buffers = std::make_shared<fileserver::io_uring_buffers>(*engine, 1);
+	BOOST_REQUIRE_EQUAL(1u, buffers->indices().size());
+	unsigned const buffer = buffers->indices()[0];
+	fileserver::io_uring_engine::chain operations;
+	operations.read(file, 0, buffer, 1000);
+	operations.send(sockets[0], Si::make_memory_range(engine->get_buffer(buffer), engine->get_buffer(buffer) + 1000));
+	BOOST_CHECK_EQUAL(boost::asio::error::eof, run_until_completed(io, *engine, operations, buffers));
+
+	// the send was cancelled, so the client must not get anything
+	::close(sockets[0]);
+	BOOST_CHECK(receive_until_closed(sockets[1]).empty());
+
+	::close(sockets[1]);
+	::close(file);
+}
+
+BOOST_AUTO_TEST_CASE(io_uring_engine_keeps_resources_of_abandoned_chain)
+{
+	boost::asio::io_service io;
+	std::unique_ptr<fileserver::io_uring_engine> engine = fileserver::io_uring_engine::create(io, 1);
+	if (!engine)
+	{
+		BOOST_TEST_MESSAGE("io_uring is not supported by this kernel");
+		return;
+	}
+
+	int sockets[2];
+	BOOST_REQUIRE_EQUAL(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+	std::weak_ptr<fileserver::io_uring_buffers> observed;
+	{
+		auto const buffers = std::make_shared<fileserver::io_uring_buffers>(*engine, 1);
+		BOOST_REQUIRE_EQUAL(1u, buffers->indices().size());
+		observed = buffers;
+		unsigned const buffer = buffers->indices()[0];
+		fileserver::io_uring_engine::chain operations;
+		// the client never reads, so this send cannot complete
+		for (int i = 0; i < 100; ++i)
+		{
+			operations.send(sockets[0], Si::make_memory_range(engine->get_buffer(buffer),
+			                                                  engine->get_buffer(buffer) +
+			                                                      fileserver::io_uring_engine::buffer_size));
+		}
+		engine->start(operations, buffers, [](boost::system::error_code)
+		              {
+			              BOOST_FAIL("the chain cannot complete");
+			          });
+		// the session gives up on the transfer
+	}
+	io.poll();
+
+	// the kernel may still write into the buffer, so nobody else must get it
+	BOOST_CHECK(!observed.expired());
+	BOOST_CHECK(!engine->acquire_buffer());
+
+	engine.reset();
+	BOOST_CHECK(observed.expired());
+
+	::close(sockets[0]);
+	::close(sockets[1]);
+}
+#endif
@@ -0,0 +1,87 @@
+#include <server/name_tree.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+namespace
+{
+	Si::memory_range as_range(char const *text)
+	{
+		return Si::make_memory_range(text, text + std::strlen(text));
+	}
+
+	fileserver::typed_reference make_reference(fileserver::byte first)
+	{
+		fileserver::sha256_digest digest;
+		digest.bytes[0] = first;
+		return fileserver::typed_reference(fileserver::blob_content_type, digest);
+	}
+
+	//! root/
+	//!     a/
+	//!         b.txt
+	//!         with space
+	//!     c
+	fileserver::name_tree make_tree()
+	{
+		auto a = std::make_shared<fileserver::name_directory>();
+		a->entries["b.txt"] = fileserver::name_tree{make_reference(1), nullptr};
+		a->entries["with space"] = fileserver::name_tree{make_reference(2), nullptr};
+		auto root = std::make_shared<fileserver::name_directory>();
+		root->entries["a"] = fileserver::name_tree{make_reference(3), a};
+		root->entries["c"] = fileserver::name_tree{make_reference(4), nullptr};
+		return fileserver::name_tree{make_reference(5), root};
+	}
+
+	int resolve(fileserver::name_tree const &root, char const *path)
+	{
+		fileserver::name_tree const *const resolved = fileserver::resolve_name(root, as_range(path));
+		if (!resolved)
+		{
+			return -1;
+		}
+		return Si::visit<int>(resolved->reference.referenced, [](fileserver::sha256_digest const &digest)
+		                      {
+			                      return digest.bytes[0];
+			                  });
+	}
+}
+
+BOOST_AUTO_TEST_CASE(name_tree_resolve)
+{
+	fileserver::name_tree const root = make_tree();
+	BOOST_CHECK_EQUAL(5, resolve(root, ""));
+	BOOST_CHECK_EQUAL(5, resolve(root, "/"));
+	BOOST_CHECK_EQUAL(3, resolve(root, "a"));
+	BOOST_CHECK_EQUAL(3, resolve(root, "a/"));
+	BOOST_CHECK_EQUAL(1, resolve(root, "a/b.txt"));
+	BOOST_CHECK_EQUAL(1, resolve(root, "a//b.txt"));
+	BOOST_CHECK_EQUAL(4, resolve(root, "c"));
+}
+
+BOOST_AUTO_TEST_CASE(name_tree_resolve_missing)
+{
+	fileserver::name_tree const root = make_tree();
+	BOOST_CHECK_EQUAL(-1, resolve(root, "b.txt"));
+	BOOST_CHECK_EQUAL(-1, resolve(root, "a/c"));
+	// a file has no entries
+	BOOST_CHECK_EQUAL(-1, resolve(root, "c/d"));
+	BOOST_CHECK_EQUAL(-1, resolve(root, "A"));
+}
+
+BOOST_AUTO_TEST_CASE(name_tree_resolve_percent_encoded)
+{
+	fileserver::name_tree const root = make_tree();
+	BOOST_CHECK_EQUAL(2, resolve(root, "a/with%20space"));
+	BOOST_CHECK_EQUAL(1, resolve(root, "%61/b%2Etxt"));
+	BOOST_CHECK_EQUAL(-1, resolve(root, "a/with%2"));
+	BOOST_CHECK_EQUAL(-1, resolve(root, "a/with%zzspace"));
+	// an encoded slash is part of a name, not a separator
+	BOOST_CHECK_EQUAL(-1, resolve(root, "a%2Fb.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(name_tree_resolve_long_segment)
+{
+	fileserver::name_tree const root = make_tree();
+	std::string const long_name(1000, 'a');
+	BOOST_CHECK_EQUAL(-1, resolve(root, long_name.c_str()));
+}
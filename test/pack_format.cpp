@@ -0,0 +1,147 @@
+#include <server/pack_format.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+	Si::memory_range as_range(std::string const &text)
+	{
+		return Si::make_memory_range(text.data(), text.data() + text.size());
+	}
+
+	fileserver::sha256_digest make_digest(fileserver::byte first)
+	{
+		fileserver::sha256_digest digest;
+		digest.bytes[0] = first;
+		return digest;
+	}
+
+	fileserver::name_tree make_file(fileserver::byte first)
+	{
+		return fileserver::name_tree{fileserver::typed_reference(fileserver::blob_content_type, make_digest(first)),
+		                             nullptr};
+	}
+
+	fileserver::content_type const listing_type = "json_v1";
+
+	fileserver::name_tree make_directory(fileserver::byte first, std::shared_ptr<fileserver::name_directory> entries)
+	{
+		return fileserver::name_tree{fileserver::typed_reference(listing_type, make_digest(first)), std::move(entries)};
+	}
+
+	int first_byte(fileserver::typed_reference const &reference)
+	{
+		return fileserver::detail::get_sha256_digest(reference).bytes[0];
+	}
+
+	std::string const a = "aa00000000000000000000000000000000000000000000000000000000000000";
+}
+
+BOOST_AUTO_TEST_CASE(pack_target_parse)
+{
+	Si::optional<fileserver::sha256_digest> const parsed = fileserver::parse_pack_target(as_range("/pack/" + a));
+	BOOST_REQUIRE(parsed);
+	BOOST_CHECK(make_digest(0xaa) == *parsed);
+	BOOST_CHECK(!fileserver::parse_pack_target(as_range("/pack/")));
+	BOOST_CHECK(!fileserver::parse_pack_target(as_range("/pack")));
+	BOOST_CHECK(!fileserver::parse_pack_target(as_range("/" + a)));
+	BOOST_CHECK(!fileserver::parse_pack_target(as_range("/pack/" + a + "/")));
+}
+
+BOOST_AUTO_TEST_CASE(pack_object_header_round_trip)
+{
+	std::string const formatted = fileserver::format_pack_object_header(
+	    fileserver::typed_reference(listing_type, make_digest(0xaa)), 42);
+	BOOST_CHECK_EQUAL(a + " json_v1 42\n", formatted);
+	Si::optional<fileserver::pack_object_header> const parsed =
+	    fileserver::parse_pack_object_header(as_range(formatted.substr(0, formatted.size() - 1)));
+	BOOST_REQUIRE(parsed);
+	BOOST_CHECK(fileserver::to_unknown_digest(make_digest(0xaa)) == parsed->digest);
+	BOOST_CHECK_EQUAL("json_v1", parsed->type);
+	BOOST_CHECK_EQUAL(42u, parsed->size);
+}
+
+BOOST_AUTO_TEST_CASE(pack_object_header_parse_malformed)
+{
+	BOOST_CHECK(!fileserver::parse_pack_object_header(as_range(a + " blob")));
+	BOOST_CHECK(!fileserver::parse_pack_object_header(as_range(a + "  12")));
+	BOOST_CHECK(!fileserver::parse_pack_object_header(as_range(a + " blob -")));
+	BOOST_CHECK(!fileserver::parse_pack_object_header(as_range(a + " blob 1 2")));
+	BOOST_CHECK(!fileserver::parse_pack_object_header(as_range("xyz blob 12")));
+}
+
+BOOST_AUTO_TEST_CASE(pack_plan_order)
+{
+	// root/
+	//     x/      (listing 2)
+	//         f   (blob 10)
+	//     y/      (listing 2 again)
+	//         f
+	//     z/      (listing 3)
+	//         g   (blob 10 again)
+	//         h   (blob 11)
+	auto same = std::make_shared<fileserver::name_directory>();
+	same->entries["f"] = make_file(10);
+	auto other = std::make_shared<fileserver::name_directory>();
+	other->entries["g"] = make_file(10);
+	other->entries["h"] = make_file(11);
+	auto root_entries = std::make_shared<fileserver::name_directory>();
+	root_entries->entries["x"] = make_directory(2, same);
+	root_entries->entries["y"] = make_directory(2, same);
+	root_entries->entries["z"] = make_directory(3, other);
+	fileserver::name_tree const root = make_directory(1, root_entries);
+
+	std::vector<fileserver::typed_reference const *> const plan = fileserver::plan_pack(root);
+	BOOST_REQUIRE_EQUAL(5u, plan.size());
+	BOOST_CHECK_EQUAL(1, first_byte(*plan[0]));
+	std::vector<int> listings{first_byte(*plan[1]), first_byte(*plan[2])};
+	std::sort(listings.begin(), listings.end());
+	BOOST_CHECK((std::vector<int>{2, 3}) == listings);
+	std::vector<int> blobs{first_byte(*plan[3]), first_byte(*plan[4])};
+	std::sort(blobs.begin(), blobs.end());
+	BOOST_CHECK((std::vector<int>{10, 11}) == blobs);
+	for (std::size_t i = 0; i < plan.size(); ++i)
+	{
+		BOOST_CHECK_EQUAL(i < 3, plan[i]->type == listing_type);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(pack_find_directory)
+{
+	auto sub_entries = std::make_shared<fileserver::name_directory>();
+	sub_entries->entries["f"] = make_file(10);
+	auto root_entries = std::make_shared<fileserver::name_directory>();
+	root_entries->entries["sub"] = make_directory(2, sub_entries);
+	root_entries->entries["f"] = make_file(11);
+	fileserver::name_tree const root = make_directory(1, root_entries);
+	fileserver::directory_index const index = fileserver::index_directories(root);
+	BOOST_CHECK_EQUAL(2u, index.size());
+	BOOST_CHECK_EQUAL(&root, fileserver::find_directory(index, make_digest(1)));
+	fileserver::name_tree const *const sub = fileserver::find_directory(index, make_digest(2));
+	BOOST_REQUIRE(sub);
+	BOOST_CHECK(sub->directory == sub_entries);
+	// files are not packed
+	BOOST_CHECK(!fileserver::find_directory(index, make_digest(10)));
+	BOOST_CHECK(!fileserver::find_directory(index, make_digest(99)));
+}
+
+BOOST_AUTO_TEST_CASE(pack_index_repeated_directory)
+{
+	// root/
+	//     x/          (listing 2)
+	//         deep/   (listing 3)
+	//     y/          (listing 2 again)
+	//         deep/
+	auto deep_entries = std::make_shared<fileserver::name_directory>();
+	deep_entries->entries["f"] = make_file(10);
+	auto same = std::make_shared<fileserver::name_directory>();
+	same->entries["deep"] = make_directory(3, deep_entries);
+	auto root_entries = std::make_shared<fileserver::name_directory>();
+	root_entries->entries["x"] = make_directory(2, same);
+	root_entries->entries["y"] = make_directory(2, same);
+	fileserver::name_tree const root = make_directory(1, root_entries);
+	fileserver::directory_index const index = fileserver::index_directories(root);
+	BOOST_CHECK_EQUAL(3u, index.size());
+	fileserver::name_tree const *const deep = fileserver::find_directory(index, make_digest(3));
+	BOOST_REQUIRE(deep);
+	BOOST_CHECK(deep->directory == deep_entries);
+}
@@ -0,0 +1,65 @@
+#include <server/pool_executor.hpp>
+#include <silicium/std_threading.hpp>
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+BOOST_AUTO_TEST_CASE(pool_executor_finishes_queued_work_on_destruction)
+{
+	std::atomic<int> executed(0);
+	{
+		fileserver::pool_executor<Si::std_threading> pool(2);
+		BOOST_CHECK_EQUAL(2u, pool.thread_count());
+		for (int i = 0; i < 100; ++i)
+		{
+			pool.submit([&executed]
+			            {
+				            ++executed;
+				        });
+		}
+	}
+	BOOST_CHECK_EQUAL(100, executed.load());
+}
+
+BOOST_AUTO_TEST_CASE(pool_executor_queue_depth)
+{
+	fileserver::pool_executor<Si::std_threading> pool(1);
+	BOOST_CHECK_EQUAL(0u, pool.queue_depth());
+	std::promise<void> release;
+	std::shared_future<void> const released = release.get_future().share();
+	for (int i = 0; i < 3; ++i)
+	{
+		pool.submit([released]
+		            {
+			            released.wait();
+			        });
+	}
+	// the running action counts as well as the queued ones
+	BOOST_CHECK_EQUAL(3u, pool.queue_depth());
+	release.set_value();
+}
+
+BOOST_AUTO_TEST_CASE(pool_executor_survives_throwing_work)
+{
+	fileserver::pool_executor<Si::std_threading> pool(1);
+	pool.submit([]
+	            {
+		            throw std::runtime_error("failed");
+		        });
+	std::promise<void> done;
+	pool.submit([&done]
+	            {
+		            done.set_value();
+		        });
+	// the same thread runs the second action after the first one has thrown
+	done.get_future().wait();
+	// the second action is counted as finished right after it has returned
+	auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while ((pool.queue_depth() != 0) && (std::chrono::steady_clock::now() < deadline))
+	{
+		std::this_thread::yield();
+	}
+	BOOST_CHECK_EQUAL(0u, pool.queue_depth());
+}
@@ -0,0 +1,66 @@
+#include <server/pooled_coroutine.hpp>
+#include <server/pending_result.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_CASE(stack_pool_reuses_stacks)
+{
+	fileserver::stack_pool stacks(64 * 1024, 1);
+	BOOST_CHECK_GE(stacks.mapping_size(), 64u * 1024u);
+	// void pointers because Boost.Test would print a char pointer as a string
+	void *const first = stacks.acquire();
+	void *const second = stacks.acquire();
+	BOOST_CHECK_NE(first, second);
+	BOOST_CHECK_EQUAL(2u, stacks.in_use());
+	stacks.release(static_cast<char *>(first));
+	stacks.release(static_cast<char *>(second));
+	BOOST_CHECK_EQUAL(0u, stacks.in_use());
+	// only one idle stack is kept
+	BOOST_CHECK_EQUAL(1u, stacks.idle());
+	char *const reused = stacks.acquire();
+	BOOST_CHECK_EQUAL(first, static_cast<void *>(reused));
+	stacks.release(reused);
+}
+
+BOOST_AUTO_TEST_CASE(pooled_coroutine_waits_for_result)
+{
+	fileserver::stack_pool stacks(64 * 1024, 4);
+	fileserver::pending_result<int> first;
+	fileserver::pending_result<int> second;
+	std::vector<int> received;
+	fileserver::spawn_pooled_coroutine(stacks, [&](fileserver::pooled_coroutine_context &yield)
+	                                   {
+		                                   received.emplace_back(*yield.get_one(first));
+		                                   received.emplace_back(*yield.get_one(second));
+		                               });
+	BOOST_CHECK(received.empty());
+	BOOST_CHECK_EQUAL(1u, stacks.in_use());
+
+	// a result that is already there does not suspend the coroutine
+	second.completion()(2);
+	first.completion()(1);
+	BOOST_REQUIRE_EQUAL(2u, received.size());
+	BOOST_CHECK_EQUAL(1, received[0]);
+	BOOST_CHECK_EQUAL(2, received[1]);
+
+	// the stack of the finished coroutine is kept for the next one
+	BOOST_CHECK_EQUAL(0u, stacks.in_use());
+	BOOST_CHECK_EQUAL(1u, stacks.idle());
+}
+
+BOOST_AUTO_TEST_CASE(pooled_coroutine_runs_many_times)
+{
+	fileserver::stack_pool stacks(64 * 1024, 4);
+	std::size_t finished = 0;
+	for (std::size_t i = 0; i < 100; ++i)
+	{
+		fileserver::pending_result<std::size_t> result;
+		fileserver::spawn_pooled_coroutine(stacks, [&result, &finished](fileserver::pooled_coroutine_context &yield)
+		                                   {
+			                                   finished += *yield.get_one(result);
+			                               });
+		result.completion()(1);
+	}
+	BOOST_CHECK_EQUAL(100u, finished);
+	BOOST_CHECK_EQUAL(0u, stacks.in_use());
+	BOOST_CHECK_EQUAL(1u, stacks.idle());
+}
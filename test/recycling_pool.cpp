@@ -0,0 +1,26 @@
+#include <server/recycling_pool.hpp>
+#include <silicium/utility.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_CASE(recycling_pool_reuses_released_objects)
+{
+	fileserver::recycling_pool<int> pool(1);
+	std::size_t created = 0;
+	auto const create = [&created]
+	{
+		++created;
+		return Si::make_unique<int>(0);
+	};
+	std::unique_ptr<int> first = pool.acquire(create);
+	std::unique_ptr<int> second = pool.acquire(create);
+	BOOST_CHECK_EQUAL(2u, created);
+	int *const first_address = first.get();
+	pool.release(std::move(first));
+	pool.release(std::move(second));
+	// only one unused object is kept
+	BOOST_CHECK_EQUAL(1u, pool.idle());
+	std::unique_ptr<int> reused = pool.acquire(create);
+	BOOST_CHECK_EQUAL(2u, created);
+	BOOST_CHECK_EQUAL(first_address, reused.get());
+	BOOST_CHECK_EQUAL(0u, pool.idle());
+}
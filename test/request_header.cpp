@@ -0,0 +1,173 @@
+#include <server/request_header.hpp>
+#include <server/request_target.hpp>
+#include <boost/test/unit_test.hpp>
+#include <string>
+
+namespace
+{
+	Si::memory_range as_range(std::string const &text)
+	{
+		return Si::make_memory_range(text.data(), text.data() + text.size());
+	}
+
+	std::string as_string(Si::memory_range range)
+	{
+		return std::string(range.begin(), range.end());
+	}
+
+	fileserver::request_parse_result parse(std::string const &text)
+	{
+		return fileserver::parse_request_header(as_range(text));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(request_header_complete)
+{
+	std::string const text = "GET /get/name/a HTTP/1.1\r\nHost: localhost\r\nRange: bytes=0-1\r\n"
+	                         "If-None-Match: \"abc\"\r\n\r\nGET /next";
+	fileserver::request_parse_result const result = parse(text);
+	BOOST_REQUIRE(result.status == fileserver::request_parse_status::complete);
+	BOOST_CHECK_EQUAL(text.size() - 9, result.length);
+	BOOST_CHECK_EQUAL("GET", as_string(result.header.method));
+	BOOST_CHECK_EQUAL("/get/name/a", as_string(result.header.target));
+	BOOST_CHECK_EQUAL("HTTP/1.1", as_string(result.header.http_version));
+	BOOST_REQUIRE(result.header.range);
+	BOOST_CHECK_EQUAL("bytes=0-1", as_string(*result.header.range));
+	BOOST_REQUIRE(result.header.if_none_match);
+	BOOST_CHECK_EQUAL("\"abc\"", as_string(*result.header.if_none_match));
+	BOOST_CHECK(!result.header.if_range);
+	BOOST_CHECK(!result.header.connection);
+}
+
+BOOST_AUTO_TEST_CASE(request_header_field_names_ignore_case)
+{
+	fileserver::request_parse_result const result = parse("GET / HTTP/1.1\nCONNECTION:   close \t\n\n");
+	BOOST_REQUIRE(result.status == fileserver::request_parse_status::complete);
+	BOOST_REQUIRE(result.header.connection);
+	BOOST_CHECK_EQUAL("close", as_string(*result.header.connection));
+}
+
+BOOST_AUTO_TEST_CASE(request_header_incomplete)
+{
+	BOOST_CHECK(parse("").status == fileserver::request_parse_status::incomplete);
+	BOOST_CHECK(parse("GET / HTTP/1.1").status == fileserver::request_parse_status::incomplete);
+	BOOST_CHECK(parse("GET / HTTP/1.1\r\nHost: a\r\n").status == fileserver::request_parse_status::incomplete);
+	BOOST_CHECK(parse("\r\n\r\n").status == fileserver::request_parse_status::incomplete);
+}
+
+BOOST_AUTO_TEST_CASE(request_header_malformed)
+{
+	BOOST_CHECK(parse("GET\r\n\r\n").status == fileserver::request_parse_status::malformed);
+	BOOST_CHECK(parse("GET  HTTP/1.1\r\n\r\n").status == fileserver::request_parse_status::malformed);
+	BOOST_CHECK(parse("GET / HTTP/1.1 x\r\n\r\n").status == fileserver::request_parse_status::malformed);
+	BOOST_CHECK(parse("GET / HTTP/1.1\r\nno colon\r\n\r\n").status == fileserver::request_parse_status::malformed);
+	BOOST_CHECK(parse("GET / HTTP/1.1\r\nHost : a\r\n\r\n").status == fileserver::request_parse_status::malformed);
+	BOOST_CHECK(parse("GET / HTTP/1.1\r\n folded\r\n\r\n").status == fileserver::request_parse_status::malformed);
+}
+
+BOOST_AUTO_TEST_CASE(request_header_persistent_connection)
+{
+	auto const is_persistent = [](std::string const &text)
+	{
+		fileserver::request_parse_result const result = parse(text);
+		BOOST_REQUIRE(result.status == fileserver::request_parse_status::complete);
+		return fileserver::is_persistent_connection(result.header);
+	};
+	BOOST_CHECK(is_persistent("GET / HTTP/1.1\r\n\r\n"));
+	BOOST_CHECK(!is_persistent("GET / HTTP/1.1\r\nConnection: Close\r\n\r\n"));
+	BOOST_CHECK(!is_persistent("GET / HTTP/1.1\r\nConnection: upgrade, close\r\n\r\n"));
+	BOOST_CHECK(!is_persistent("GET / HTTP/1.0\r\n\r\n"));
+	BOOST_CHECK(is_persistent("GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n"));
+	BOOST_CHECK(is_persistent("GET / HTTP/1.1\r\nContent-Length: 0\r\n\r\n"));
+	BOOST_CHECK(!is_persistent("GET / HTTP/1.1\r\nContent-Length: 3\r\n\r\n"));
+	BOOST_CHECK(!is_persistent("GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"));
+}
+
+BOOST_AUTO_TEST_CASE(request_target_parse)
+{
+	std::string const hex(64, 'a');
+	std::string const by_hash = "/get/hash/" + hex + "?x=1";
+	Si::optional<fileserver::parsed_request> const get = fileserver::parse_request_target(as_range(by_hash));
+	BOOST_REQUIRE(get);
+	BOOST_CHECK(Si::visit<bool>(*get,
+	                            [](fileserver::browse_request const &)
+	                            {
+		                            return false;
+		                        },
+	                            [](fileserver::get_request const &request)
+	                            {
+		                            return Si::visit<bool>(request.what,
+		                                                   [](fileserver::sha256_digest const &digest)
+		                                                   {
+			                                                   return digest.bytes[0] == 0xaa;
+			                                               },
+		                                                   [](Si::memory_range const &)
+		                                                   {
+			                                                   return false;
+			                                               });
+		                        }));
+
+	std::string const by_name = "/browse/name/readme";
+	Si::optional<fileserver::parsed_request> const browse = fileserver::parse_request_target(as_range(by_name));
+	BOOST_REQUIRE(browse);
+	BOOST_CHECK(Si::visit<bool>(*browse,
+	                            [](fileserver::browse_request const &request)
+	                            {
+		                            return Si::visit<bool>(request.what,
+		                                                   [](fileserver::sha256_digest const &)
+		                                                   {
+			                                                   return false;
+			                                               },
+		                                                   [](Si::memory_range const &name)
+		                                                   {
+			                                                   return as_string(name) == "readme";
+			                                               });
+		                        },
+	                            [](fileserver::get_request const &)
+	                            {
+		                            return false;
+		                        }));
+
+	std::string const by_path = "/get/name/a/b/c.txt?x";
+	Si::optional<fileserver::parsed_request> const get_path = fileserver::parse_request_target(as_range(by_path));
+	BOOST_REQUIRE(get_path);
+	BOOST_CHECK(Si::visit<bool>(*get_path,
+	                            [](fileserver::browse_request const &)
+	                            {
+		                            return false;
+		                        },
+	                            [](fileserver::get_request const &request)
+	                            {
+		                            return Si::visit<bool>(request.what,
+		                                                   [](fileserver::sha256_digest const &)
+		                                                   {
+			                                                   return false;
+			                                               },
+		                                                   [](Si::memory_range const &name)
+		                                                   {
+			                                                   return as_string(name) == "a/b/c.txt";
+			                                               });
+		                        }));
+
+	BOOST_CHECK(fileserver::parse_request_target(as_range("/get")));
+	BOOST_CHECK(!fileserver::parse_request_target(as_range("")));
+	BOOST_CHECK(!fileserver::parse_request_target(as_range("/put/hash/" + hex)));
+	BOOST_CHECK(!fileserver::parse_request_target(as_range("/get/hash/" + hex.substr(1))));
+	BOOST_CHECK(!fileserver::parse_request_target(as_range("/get/hash/" + hex + "0")));
+	BOOST_CHECK(!fileserver::parse_request_target(as_range("/get/other/a")));
+}
+
+BOOST_AUTO_TEST_CASE(sha256_digest_lookup_hash)
+{
+	// the repository is searched with a sha256_digest instead of an unknown_digest, so both have to hash the same
+	fileserver::sha256_digest digest;
+	for (std::size_t i = 0; i < digest.bytes.size(); ++i)
+	{
+		digest.bytes[i] = static_cast<fileserver::byte>(i * 7);
+	}
+	fileserver::unknown_digest const unknown(digest.bytes.begin(), digest.bytes.end());
+	BOOST_CHECK_EQUAL(boost::hash<fileserver::unknown_digest>()(unknown), fileserver::sha256_digest_hash()(digest));
+	BOOST_CHECK(fileserver::sha256_digest_equal()(digest, unknown));
+	fileserver::unknown_digest const shorter(digest.bytes.begin(), digest.bytes.end() - 1);
+	BOOST_CHECK(!fileserver::sha256_digest_equal()(digest, shorter));
+}
@@ -0,0 +1,48 @@
+#include <server/response_headers.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+	std::string to_string(std::vector<char> const &bytes)
+	{
+		return std::string(bytes.begin(), bytes.end());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(response_headers_ok)
+{
+	fileserver::cached_response_headers const cached =
+	    fileserver::make_cached_response_headers(fileserver::unknown_digest{0x12, 0x34}, 1000);
+	std::vector<char> buffer;
+	fileserver::serialize_ok_header(buffer, cached, true, true);
+	BOOST_CHECK_EQUAL("HTTP/1.1 200 OK\r\n"
+	                  "Accept-Ranges: bytes\r\n"
+	                  "Content-Length: 1000\r\n"
+	                  "ETag: \"1234\"\r\n"
+	                  "Cache-Control: public, max-age=31536000, immutable\r\n"
+	                  "Connection: keep-alive\r\n"
+	                  "\r\n",
+	                  to_string(buffer));
+	fileserver::serialize_ok_header(buffer, cached, false, false);
+	BOOST_CHECK_EQUAL("HTTP/1.1 200 OK\r\n"
+	                  "Accept-Ranges: bytes\r\n"
+	                  "Content-Length: 1000\r\n"
+	                  "ETag: \"1234\"\r\n"
+	                  "Connection: close\r\n"
+	                  "\r\n",
+	                  to_string(buffer));
+}
+
+BOOST_AUTO_TEST_CASE(response_headers_not_modified)
+{
+	fileserver::cached_response_headers const cached =
+	    fileserver::make_cached_response_headers(fileserver::unknown_digest{0xab}, 0);
+	std::vector<char> buffer;
+	fileserver::serialize_not_modified_header(buffer, cached, true, false);
+	BOOST_CHECK_EQUAL("HTTP/1.1 304 Not Modified\r\n"
+	                  "ETag: \"ab\"\r\n"
+	                  "Cache-Control: public, max-age=31536000, immutable\r\n"
+	                  "Connection: close\r\n"
+	                  "\r\n",
+	                  to_string(buffer));
+}
@@ -0,0 +1,140 @@
+#include <server/scan_directory.hpp>
+#include <server/pool_executor.hpp>
+#include <ventura/open.hpp>
+#include <silicium/std_threading.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+namespace
+{
+	void write_file(boost::filesystem::path const &file, std::string const &content)
+	{
+		boost::filesystem::ofstream stream(file, std::ios::binary);
+		stream << content;
+	}
+
+	//! root/
+	//!     x.txt
+	//!     empty/
+	//!     a/
+	//!         y.txt
+	//!         0 ... 49 (i KB of 'm', hashed in batches)
+	//!         large (too large for a batch)
+	//!         b/
+	//!             z.txt (same content as x.txt)
+	struct temporary_tree
+	{
+		boost::filesystem::path root;
+
+		temporary_tree()
+		    : root(boost::filesystem::temp_directory_path() /
+		           boost::filesystem::unique_path("fileserver_scan_%%%%-%%%%-%%%%-%%%%"))
+		{
+			boost::filesystem::create_directories(root / "a" / "b");
+			boost::filesystem::create_directories(root / "empty");
+			write_file(root / "x.txt", "x");
+			write_file(root / "a" / "y.txt", "y");
+			write_file(root / "a" / "b" / "z.txt", "x");
+			for (std::size_t i = 0; i < 50; ++i)
+			{
+				write_file(root / "a" / std::to_string(i), std::string(i * 1000, 'm'));
+			}
+			write_file(root / "a" / "large", std::string(100 * 1000, 'l'));
+		}
+
+		~temporary_tree()
+		{
+			boost::system::error_code ignored;
+			boost::filesystem::remove_all(root, ignored);
+		}
+	};
+
+	std::size_t count_locations(std::pair<fileserver::file_repository, fileserver::name_tree> const &scanned,
+	                            char const *name)
+	{
+		fileserver::name_tree const *const found =
+		    fileserver::resolve_name(scanned.second, Si::make_memory_range(name, name + std::strlen(name)));
+		BOOST_REQUIRE(found);
+		fileserver::repository_entry const *const entry =
+		    scanned.first.find_entry(fileserver::to_unknown_digest(found->reference.referenced));
+		BOOST_REQUIRE(entry);
+		return entry->locations.size();
+	}
+
+	fileserver::sha256_digest hash_string(std::string const &content)
+	{
+		return fileserver::sha256(
+		    Si::make_single_source(Si::make_iterator_range(content.data(), content.data() + content.size())));
+	}
+
+	void check_digest(fileserver::name_tree const &root, std::string const &name, std::string const &content)
+	{
+		fileserver::name_tree const *const found =
+		    fileserver::resolve_name(root, Si::make_memory_range(name.data(), name.data() + name.size()));
+		BOOST_REQUIRE(found);
+		BOOST_CHECK_MESSAGE(
+		    fileserver::typed_reference(fileserver::blob_content_type, hash_string(content)) == found->reference, name);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(scan_directory_parallel_equals_serial)
+{
+	temporary_tree const tree;
+	std::pair<fileserver::file_repository, fileserver::name_tree> const serial = fileserver::scan_directory(
+	    tree.root, fileserver::directory_listing_to_json_bytes, fileserver::detail::hash_files);
+	fileserver::pool_executor<Si::std_threading> pool(4);
+	std::pair<fileserver::file_repository, fileserver::name_tree> const parallel = fileserver::scan_directory(
+	    tree.root, fileserver::directory_listing_to_json_bytes, fileserver::detail::hash_files, pool);
+	BOOST_CHECK(serial.second.reference == parallel.second.reference);
+	BOOST_CHECK_EQUAL(serial.first.size(), parallel.first.size());
+	BOOST_CHECK_EQUAL(2u, count_locations(parallel, "a/b/z.txt"));
+	BOOST_CHECK_EQUAL(1u, count_locations(parallel, "a/y.txt"));
+	BOOST_CHECK(count_locations(parallel, "empty") == 1);
+}
+
+BOOST_AUTO_TEST_CASE(scan_directory_batches_hash_like_single_files)
+{
+	temporary_tree const tree;
+	std::pair<fileserver::file_repository, fileserver::name_tree> const scanned = fileserver::scan_directory(
+	    tree.root, fileserver::directory_listing_to_json_bytes, fileserver::detail::hash_files);
+	for (std::size_t i = 0; i < 50; ++i)
+	{
+		check_digest(scanned.second, "a/" + std::to_string(i), std::string(i * 1000, 'm'));
+	}
+	check_digest(scanned.second, "a/large", std::string(100 * 1000, 'l'));
+	check_digest(scanned.second, "x.txt", "x");
+}
+
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE(scan_directory_remembers_identity_of_hashed_files)
+{
+	temporary_tree const tree;
+	std::pair<fileserver::file_repository, fileserver::name_tree> const scanned = fileserver::scan_directory(
+	    tree.root, fileserver::directory_listing_to_json_bytes, fileserver::detail::hash_files);
+	for (std::string const name : {"a/y.txt", "a/large"})
+	{
+		fileserver::name_tree const *const found =
+		    fileserver::resolve_name(scanned.second, Si::make_memory_range(name.data(), name.data() + name.size()));
+		BOOST_REQUIRE(found);
+		fileserver::repository_entry const *const entry =
+		    scanned.first.find_entry(fileserver::to_unknown_digest(found->reference.referenced));
+		BOOST_REQUIRE(entry);
+		fileserver::file_system_location const *const on_disk =
+		    Si::try_get_ptr<fileserver::file_system_location>(entry->locations[0]);
+		BOOST_REQUIRE(on_disk);
+		BOOST_REQUIRE(on_disk->identity);
+
+		boost::filesystem::path const file = tree.root / name;
+		{
+			Si::file_handle const unchanged = ventura::open_reading(ventura::safe_c_str(file.c_str())).move_value();
+			BOOST_CHECK(fileserver::identify_file(unchanged.handle) == on_disk->identity);
+		}
+
+		// written to in place, so the path is still the same
+		write_file(file, "changed");
+		Si::file_handle const changed = ventura::open_reading(ventura::safe_c_str(file.c_str())).move_value();
+		BOOST_CHECK(!(fileserver::identify_file(changed.handle) == on_disk->identity));
+	}
+}
+#endif
@@ -0,0 +1,119 @@
+#include <server/sha256_engine.hpp>
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+namespace
+{
+	std::vector<fileserver::sha256_engine> const all_engines = {
+	    fileserver::sha256_engine::openssl, fileserver::sha256_engine::sha_ni, fileserver::sha256_engine::avx2,
+	    fileserver::sha256_engine::avx512};
+
+	fileserver::sha256_digest hash_with_openssl(std::vector<char> const &message)
+	{
+		fileserver::sha256_digest result;
+		SHA256(reinterpret_cast<unsigned char const *>(message.data()), message.size(), result.bytes.data());
+		return result;
+	}
+
+	void check_all_engines(std::vector<std::vector<char>> const &messages)
+	{
+		std::vector<Si::memory_range> ranges;
+		for (std::vector<char> const &message : messages)
+		{
+			ranges.emplace_back(Si::make_memory_range(message.data(), message.data() + message.size()));
+		}
+		for (fileserver::sha256_engine const engine : all_engines)
+		{
+			if (!fileserver::is_supported(engine))
+			{
+				continue;
+			}
+			BOOST_TEST_CONTEXT(fileserver::sha256_engine_name(engine))
+			{
+				std::vector<fileserver::sha256_digest> digests(messages.size());
+				fileserver::sha256_many(engine, ranges.data(), ranges.size(), digests.data());
+				for (std::size_t i = 0; i < messages.size(); ++i)
+				{
+					BOOST_CHECK_MESSAGE(hash_with_openssl(messages[i]) == digests[i],
+					                    "message " << i << " of " << messages[i].size() << " bytes");
+				}
+			}
+		}
+	}
+
+	std::vector<char> make_message(std::size_t size, std::mt19937 &random)
+	{
+		std::vector<char> message(size);
+		std::uniform_int_distribution<int> byte_value(0, 255);
+		for (char &element : message)
+		{
+			element = static_cast<char>(byte_value(random));
+		}
+		return message;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(sha256_engine_known_digest)
+{
+	std::string const message = "abc";
+	fileserver::sha256_digest digest;
+	Si::memory_range const range = Si::make_memory_range(message.data(), message.data() + message.size());
+	fileserver::sha256_many(&range, 1, &digest);
+	fileserver::byte const expected[] = {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40,
+	                                     0xde, 0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17,
+	                                     0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+	BOOST_CHECK(fileserver::sha256_digest(expected) == digest);
+}
+
+BOOST_AUTO_TEST_CASE(sha256_engine_padding_boundaries)
+{
+	std::mt19937 random(1);
+	std::vector<std::vector<char>> messages;
+	// every length up to three blocks, so that the end of the message is at every offset of a block
+	for (std::size_t size = 0; size <= 192; ++size)
+	{
+		messages.emplace_back(make_message(size, random));
+	}
+	check_all_engines(messages);
+}
+
+BOOST_AUTO_TEST_CASE(sha256_engine_mixed_sizes)
+{
+	std::mt19937 random(2);
+	std::uniform_int_distribution<std::size_t> size(0, 5000);
+	std::vector<std::vector<char>> messages;
+	for (std::size_t i = 0; i < 100; ++i)
+	{
+		// a few long messages among many short ones keep some lanes busy after the others are done
+		messages.emplace_back(make_message(((i % 17) == 0) ? (size(random) * 20) : size(random), random));
+	}
+	check_all_engines(messages);
+}
+
+BOOST_AUTO_TEST_CASE(sha256_engine_fewer_messages_than_lanes)
+{
+	std::mt19937 random(3);
+	for (std::size_t count = 0; count <= 17; ++count)
+	{
+		std::vector<std::vector<char>> messages;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			messages.emplace_back(make_message(i * 100, random));
+		}
+		check_all_engines(messages);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(sha256_engine_portable_compress)
+{
+	// the multi-buffer engines finish their last messages with it where the CPU has no SHA extensions
+	std::mt19937 random(4);
+	for (std::size_t size = 0; size <= 300; size += 7)
+	{
+		std::vector<char> const message = make_message(size, random);
+		BOOST_CHECK(hash_with_openssl(message) ==
+		            fileserver::detail::sha256_single(fileserver::detail::sha256_compress_portable,
+		                                              Si::make_memory_range(message.data(),
+		                                                                    message.data() + message.size())));
+	}
+}
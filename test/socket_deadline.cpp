@@ -0,0 +1,73 @@
+#include <server/socket_deadline.hpp>
+#include <boost/test/unit_test.hpp>
+#include <limits>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(transfer_time_limit_rate)
+{
+	std::chrono::steady_clock::duration const grace = std::chrono::seconds(10);
+	BOOST_CHECK(grace == fileserver::transfer_time_limit(0, 1000, grace));
+	BOOST_CHECK((grace + std::chrono::seconds(3)) == fileserver::transfer_time_limit(3000, 1000, grace));
+	BOOST_CHECK((grace + std::chrono::milliseconds(1500)) == fileserver::transfer_time_limit(1500, 1000, grace));
+}
+
+BOOST_AUTO_TEST_CASE(transfer_time_limit_does_not_overflow)
+{
+	std::chrono::steady_clock::duration const limit =
+	    fileserver::transfer_time_limit(std::numeric_limits<boost::uint64_t>::max(), 1, std::chrono::seconds(0));
+	BOOST_CHECK(limit > std::chrono::hours(24 * 364));
+	BOOST_CHECK(limit < std::chrono::hours(24 * 366));
+}
+
+namespace
+{
+	struct recorded_deadline
+	{
+		std::vector<std::chrono::steady_clock::duration> armed;
+		std::size_t cancelled = 0;
+
+		void expires_from_now(std::chrono::steady_clock::duration timeout)
+		{
+			armed.push_back(timeout);
+		}
+
+		void cancel()
+		{
+			++cancelled;
+		}
+	};
+}
+
+BOOST_AUTO_TEST_CASE(send_pacer_bounds_a_stalled_reader_regardless_of_size)
+{
+	std::chrono::steady_clock::duration const grace = std::chrono::seconds(10);
+	boost::uint64_t const chunk = 64 * 1024;
+	boost::uint64_t const min_rate = 4096;
+	recorded_deadline small;
+	fileserver::send_pacer<recorded_deadline>(small, min_rate, grace).expect(chunk);
+	BOOST_REQUIRE_EQUAL(1u, small.armed.size());
+	BOOST_CHECK((grace + std::chrono::seconds(16)) == small.armed.front());
+
+	// a gigabyte, which would have been given days as a whole
+	recorded_deadline large;
+	fileserver::send_pacer<recorded_deadline> const pace(large, min_rate, grace);
+	for (boost::uint64_t sent = 0; sent < (1024 * 1024 * 1024); sent += chunk)
+	{
+		pace.expect(chunk);
+	}
+	BOOST_REQUIRE_EQUAL(16384u, large.armed.size());
+	// wherever the reader stalls, it is dropped as soon as in the small response
+	for (std::chrono::steady_clock::duration const limit : large.armed)
+	{
+		BOOST_CHECK(small.armed.front() == limit);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(send_pacer_without_minimum_rate)
+{
+	recorded_deadline deadline;
+	fileserver::send_pacer<recorded_deadline> const pace(deadline, 0, std::chrono::seconds(10));
+	pace.expect(1000);
+	BOOST_CHECK(deadline.armed.empty());
+	BOOST_CHECK_EQUAL(1u, deadline.cancelled);
+}
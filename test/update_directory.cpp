@@ -0,0 +1,131 @@
+#include <server/update_directory.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+namespace
+{
+	void write_file(boost::filesystem::path const &file, std::string const &content)
+	{
+		boost::filesystem::ofstream stream(file, std::ios::binary);
+		stream << content;
+	}
+
+	//! root/
+	//!     x.txt
+	//!     empty/
+	//!     a/
+	//!         y.txt
+	//!         b/
+	//!             z.txt
+	struct temporary_tree
+	{
+		boost::filesystem::path root;
+
+		temporary_tree()
+		    : root(boost::filesystem::temp_directory_path() /
+		           boost::filesystem::unique_path("fileserver_update_%%%%-%%%%-%%%%-%%%%"))
+		{
+			boost::filesystem::create_directories(root / "a" / "b");
+			boost::filesystem::create_directories(root / "empty");
+			write_file(root / "x.txt", "x");
+			write_file(root / "a" / "y.txt", "y");
+			write_file(root / "a" / "b" / "z.txt", "z");
+		}
+
+		~temporary_tree()
+		{
+			boost::system::error_code ignored;
+			boost::filesystem::remove_all(root, ignored);
+		}
+	};
+
+	std::pair<fileserver::file_repository, fileserver::name_tree> scan(boost::filesystem::path const &root)
+	{
+		std::pair<fileserver::file_repository, fileserver::name_tree> scanned = fileserver::scan_directory(
+		    root, fileserver::directory_listing_to_json_bytes, fileserver::detail::hash_files);
+		scanned.first.prepare_response_headers();
+		return scanned;
+	}
+
+	fileserver::name_tree apply_changes(boost::filesystem::path const &root, fileserver::name_tree const &old,
+	                                    std::vector<boost::filesystem::path> const &changed,
+	                                    fileserver::file_repository &repository)
+	{
+		fileserver::repository_update update;
+		fileserver::name_tree updated = fileserver::update_directory(
+		    root, old, changed, update, fileserver::directory_listing_to_json_bytes, fileserver::detail::hash_files);
+		update.apply_to(repository);
+		return updated;
+	}
+
+	fileserver::name_tree const &resolve(fileserver::name_tree const &root, char const *name)
+	{
+		fileserver::name_tree const *const found =
+		    fileserver::resolve_name(root, Si::make_memory_range(name, name + std::strlen(name)));
+		BOOST_REQUIRE(found);
+		return *found;
+	}
+
+	std::size_t count_locations(fileserver::file_repository const &repository)
+	{
+		std::size_t count = 0;
+		repository.for_each_entry(
+		    [&count](fileserver::unknown_digest const &, fileserver::repository_entry const &entry)
+		    {
+			    count += entry.locations.size();
+			});
+		return count;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(update_directory_equals_new_scan)
+{
+	temporary_tree const tree;
+	std::pair<fileserver::file_repository, fileserver::name_tree> const old = scan(tree.root);
+
+	write_file(tree.root / "x.txt", "changed");
+	boost::filesystem::remove_all(tree.root / "a" / "b");
+	boost::filesystem::create_directories(tree.root / "new" / "dir");
+	// the same content as a/y.txt
+	write_file(tree.root / "new" / "dir" / "n.txt", "y");
+	std::vector<boost::filesystem::path> const changed = {tree.root / "x.txt", tree.root / "a" / "b",
+	                                                      tree.root / "new" / "dir" / "n.txt"};
+
+	fileserver::file_repository repository = old.first;
+	fileserver::name_tree const updated = apply_changes(tree.root, old.second, changed, repository);
+	std::pair<fileserver::file_repository, fileserver::name_tree> const expected = scan(tree.root);
+	BOOST_CHECK(expected.second.reference == updated.reference);
+	BOOST_CHECK_EQUAL(expected.first.size(), repository.size());
+	BOOST_CHECK_EQUAL(count_locations(expected.first), count_locations(repository));
+	repository.for_each_entry([](fileserver::unknown_digest const &, fileserver::repository_entry const &entry)
+	                          {
+		                          BOOST_CHECK(!entry.headers.ok.empty());
+		                      });
+
+	fileserver::repository_entry const *const y =
+	    repository.find_entry(fileserver::to_unknown_digest(resolve(updated, "new/dir/n.txt").reference.referenced));
+	BOOST_REQUIRE(y);
+	BOOST_CHECK_EQUAL(2u, y->locations.size());
+
+	// unchanged directories are shared and the old tree is still intact
+	BOOST_CHECK(resolve(old.second, "empty").directory == resolve(updated, "empty").directory);
+	BOOST_CHECK(!(resolve(old.second, "x.txt").reference == resolve(updated, "x.txt").reference));
+	BOOST_CHECK(!resolve(old.second, "a/b/z.txt").directory);
+}
+
+BOOST_AUTO_TEST_CASE(update_directory_without_effect)
+{
+	temporary_tree const tree;
+	std::pair<fileserver::file_repository, fileserver::name_tree> const old = scan(tree.root);
+	// rewritten with the same content
+	write_file(tree.root / "a" / "y.txt", "y");
+	std::vector<boost::filesystem::path> const changed = {tree.root / "a" / "y.txt", tree.root / "a",
+	                                                      tree.root / "missing", boost::filesystem::path("/elsewhere")};
+	fileserver::repository_update update;
+	fileserver::name_tree const updated = fileserver::update_directory(
+	    tree.root, old.second, changed, update, fileserver::directory_listing_to_json_bytes,
+	    fileserver::detail::hash_files);
+	BOOST_CHECK(update.empty());
+	BOOST_CHECK(old.second.directory == updated.directory);
+}
@@ -0,0 +1,38 @@
+#include <server/zero_copy.hpp>
+#include <boost/test/unit_test.hpp>
+#ifdef __linux__
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+BOOST_AUTO_TEST_CASE(send_file_to_socket_survives_closed_client)
+{
+	fileserver::ignore_broken_pipes();
+
+	char name[] = "/tmp/fileserver_zero_copy_XXXXXX";
+	int const file = ::mkstemp(name);
+	BOOST_REQUIRE_GE(file, 0);
+	::unlink(name);
+	std::size_t const size = 4 * 1024 * 1024;
+	std::vector<char> const content(size, 'x');
+	BOOST_REQUIRE_EQUAL(static_cast<ssize_t>(size), ::write(file, content.data(), content.size()));
+
+	int sockets[2];
+	BOOST_REQUIRE_EQUAL(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+	Si::error_or<std::size_t> const first = fileserver::send_file_to_socket(sockets[0], file, 0, 1000);
+	BOOST_REQUIRE(!first.is_error());
+	BOOST_REQUIRE_GT(first.get(), 0u);
+
+	// the client goes away in the middle of the transfer
+	::close(sockets[1]);
+	Si::error_or<std::size_t> const rest =
+	    fileserver::send_file_to_socket(sockets[0], file, first.get(), size - first.get());
+	BOOST_REQUIRE(rest.is_error());
+	BOOST_CHECK(rest.error() == boost::system::errc::broken_pipe);
+
+	::close(sockets[0]);
+	::close(file);
+}
+#endif